@@ -17,7 +17,28 @@ SOURCES += main.cpp\
     allocationrendercontroller.cpp \
     allocationrenderitem.cpp \
     scenecontroller.cpp \
-    allocationscenecontroller.cpp
+    allocationscenecontroller.cpp \
+    eventqueue.cpp \
+    framescheduler.cpp \
+    poolstate.cpp \
+    occupancyscenecontroller.cpp \
+    traceindex.cpp \
+    tracefile.cpp \
+    tracerecorder.cpp \
+    packetdecoder.cpp \
+    shmring.cpp \
+    pipelinestats.cpp \
+    tracetimestamps.cpp \
+    fragmentationplot.cpp \
+    allocatorsimulator.cpp \
+    simulationscenecontroller.cpp \
+    flightrecorder.cpp \
+    persistentpool.cpp \
+    poolhistory.cpp \
+    traceindexer.cpp \
+    usagepyramid.cpp \
+    usagetimeline.cpp \
+    occupancypyramid.cpp
 
 HEADERS  += \
     rendertarget.h \
@@ -27,12 +48,35 @@ HEADERS  += \
     allocationrendercontroller.h \
     allocationrenderitem.h \
     scenecontroller.h \
-    allocationscenecontroller.h
+    allocationscenecontroller.h \
+    eventqueue.h \
+    framescheduler.h \
+    poolstate.h \
+    occupancyscenecontroller.h \
+    traceindex.h \
+    tracefile.h \
+    tracerecorder.h \
+    packetdecoder.h \
+    shmring.h \
+    pipelinestats.h \
+    tracetimestamps.h \
+    fragmentationplot.h \
+    allocatorsimulator.h \
+    simulationscenecontroller.h \
+    flightrecorder.h \
+    persistentpool.h \
+    poolhistory.h \
+    traceindexer.h \
+    usagepyramid.h \
+    usagetimeline.h \
+    occupancypyramid.h
 
 FORMS    += \
     tracecontrollerdialog.ui \
     mainwindow.ui
 
+LIBS += -lrt
+
 INCLUDEPATH += /home/ilyes/DirectFB-git/src
 INCLUDEPATH += /home/ilyes/DirectFB-git/include
 INCLUDEPATH += /home/ilyes/DirectFB-git/lib
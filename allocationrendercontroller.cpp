@@ -16,54 +16,151 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
 #include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <errno.h>
 #include <assert.h>
 
+#ifndef SO_RXQ_OVFL
+#define SO_RXQ_OVFL 40
+#endif
+
+#define DEFAULT_RECEIVE_BUFFER_SIZE (4 * 1024 * 1024)
+#define DEFAULT_RECEIVE_BATCH_SIZE 64
+
+#define DEFAULT_REORDER_PACKETS 64
+#define DEFAULT_REORDER_TIME 20 // in ms
+
+#define EVENT_QUEUE_CAPACITY 16384
+#define MAX_DRAINED_EVENTS EVENT_QUEUE_CAPACITY // per frame, the rest waits for the next one
+#define DRAIN_CHECK_EVENTS 256 // between two looks at the clock
+
+#define MAX_EPOLL_EVENTS 16
+
+#define SHM_RING_CAPACITY 16384 // in packets
+#define SHM_IDLE_SLEEP 200 // in us
+#define EPOLL_TIMEOUT 100 // in ms, when no reorder window is set
+
+#define NOMINAL_PACKET_INTERVAL 240000000ULL // in ns, for traces without timestamps
+#define MAX_PACING_SLEEP 50000 // in us, keeps pauses and seeks responsive
+#define MAX_PLAYBACK_LAG 1000000000ULL // in ns, late playback resynchronizes instead of bursting
+#define TIMELINE_UPDATE_PERIOD 33000000ULL // in ns
+
 #include "allocationrenderitem.h"
 #include "allocationscenecontroller.h"
+#include "occupancyscenecontroller.h"
+#include "simulationscenecontroller.h"
 #include "allocationrendercontroller.h"
 
-AllocationRenderController::AllocationRenderController(QString ipAddr, int port, bool saveToFile)
+static unsigned long long monotonicNs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+AllocationRenderController::AllocationRenderController(QString ipAddr, int port, bool saveToFile) : m_eventQueue(EVENT_QUEUE_CAPACITY),
+                                                                                                     m_decoderListener(this, 0),
+                                                                                                     m_decoder(&m_decoderListener)
 {
+    m_decoder.setStatistics(&m_pipelineStats);
+
     m_ipAddr = ipAddr;
     m_port = port;
 
-    m_currentNseq = m_expectedNseq = 0;
+    m_ports.append(port);
+    m_epollFd = -1;
+
+    m_transport = TRANSPORT_UDP;
 
     m_saveToFile = saveToFile;
 
+    m_playbackSpeed = 1.0;
+    m_pacingEpoch = 0;
+
+    m_playbackPosition = m_playbackLength = 0;
+
     m_receiver = 0;
+    m_indexer = 0;
     m_traceController = 0;
 
-    time_t t = time(NULL);
-    localtime_r(&t, &m_startingDate);
+    m_droppedEvents = m_reportedDroppedEvents = 0;
 
-    if (m_saveToFile) {
-        char buf[64];
-        sprintf(buf, "packettrace-%04d%02d%02d%02d%02d", m_startingDate.tm_year,
-                                                         m_startingDate.tm_mon,
-                                                         m_startingDate.tm_mday,
-                                                         m_startingDate.tm_hour,
-                                                         m_startingDate.tm_min);
+    m_renderMode = RENDER_ITEMS;
 
-        m_outputTrace.open(buf, ios_base::out | ios_base::app);
-    }
+    QObject::connect(&m_frameScheduler, SIGNAL(frameStarted()), this, SLOT(drainEvents()));
+    QObject::connect(&m_frameScheduler, SIGNAL(frameStatistics(unsigned int, unsigned int)),
+                     this, SIGNAL(frameStatistics(unsigned int, unsigned int)));
+
+    m_receiveBufferSize = DEFAULT_RECEIVE_BUFFER_SIZE;
+    m_receiveBatchSize = DEFAULT_RECEIVE_BATCH_SIZE;
+
+    m_reorderPackets = DEFAULT_REORDER_PACKETS;
+    m_reorderTime = DEFAULT_REORDER_TIME;
+
+    m_checkpointInterval = DEFAULT_CHECKPOINT_INTERVAL;
+    m_historyMemory = DEFAULT_HISTORY_MEMORY;
+
+    QObject::connect(&m_recorder, SIGNAL(statistics(unsigned int, unsigned int, unsigned int)),
+                     this, SIGNAL(recorderStatistics(unsigned int, unsigned int, unsigned int)));
+
+    QObject::connect(&m_recorder, SIGNAL(rotationFailed(QString)),
+                     this, SIGNAL(recorderRotationFailed(QString)));
+
+    QObject::connect(&m_flightRecorder, SIGNAL(dumped(QString, QString)),
+                     this, SIGNAL(flightRecorderDumped(QString, QString)));
+
+    QObject::connect(&m_flightRecorder, SIGNAL(dumpFailed(QString)),
+                     this, SIGNAL(flightRecorderDumpFailed(QString)));
+
+    if (m_saveToFile)
+        m_recorder.startRecording();
 }
 
-AllocationRenderController::AllocationRenderController(QString traceFile, int period) : m_renderingSemaphore(1)
+AllocationRenderController::AllocationRenderController(QString traceFile, double speed) : m_renderingSemaphore(1),
+                                                                                         m_eventQueue(EVENT_QUEUE_CAPACITY),
+                                                                                         m_decoderListener(this, 0),
+                                                                                         m_decoder(&m_decoderListener)
 {
+    m_decoder.setStatistics(&m_pipelineStats);
+
     m_ipAddr = "";
     m_port = -1;
 
+    m_epollFd = -1;
+
+    m_transport = TRANSPORT_UDP;
+
     m_saveToFile = false;
 
     m_receiver = 0;
+    m_indexer = 0;
+
+    m_droppedEvents = m_reportedDroppedEvents = 0;
+
+    m_renderMode = RENDER_ITEMS;
+
+    QObject::connect(&m_frameScheduler, SIGNAL(frameStarted()), this, SLOT(drainEvents()));
+    QObject::connect(&m_frameScheduler, SIGNAL(frameStatistics(unsigned int, unsigned int)),
+                     this, SIGNAL(frameStatistics(unsigned int, unsigned int)));
 
     m_trace = traceFile;
-    m_renderPeriod = period;
 
-    m_currentNseq = m_expectedNseq = 0;
+    m_playbackSpeed = speed;
+    m_pacingEpoch = 0;
+
+    m_playbackPosition = m_playbackLength = 0;
+
+    m_receiveBufferSize = DEFAULT_RECEIVE_BUFFER_SIZE;
+    m_receiveBatchSize = 1;
+
+    m_checkpointInterval = DEFAULT_CHECKPOINT_INTERVAL;
+    m_historyMemory = DEFAULT_HISTORY_MEMORY;
 }
 
 AllocationRenderController::~AllocationRenderController()
@@ -74,80 +171,236 @@ AllocationRenderController::~AllocationRenderController()
 
 void AllocationRenderController::saveTraceToFile(bool save)
 {
-    if (!m_saveToFile && save) {
-        char buf[64];
-        sprintf(buf, "packettrace-%04d%02d%02d%02d%02d", m_startingDate.tm_year,
-                                                         m_startingDate.tm_mon,
-                                                         m_startingDate.tm_mday,
-                                                         m_startingDate.tm_hour,
-                                                         m_startingDate.tm_min);
-
-        m_outputTrace.open(buf, ios_base::out | ios_base::app);
-    }
+    if (!m_saveToFile && save)
+        m_recorder.startRecording();
 
     if (m_saveToFile && !save)
-        m_outputTrace.close();
+        m_recorder.stopRecording();
 
     m_saveToFile = save;
 }
 
+void AllocationRenderController::setTraceRotation(unsigned int megabytes, unsigned int seconds)
+{
+    m_recorder.setRotation(megabytes, seconds);
+}
+
+void AllocationRenderController::setFrameBudget(int ms)
+{
+    m_frameScheduler.setFrameBudget(ms);
+}
+
+void AllocationRenderController::setFlightRecorder(unsigned int megabytes, unsigned int seconds,
+                                                   float usage, unsigned int largestFree, unsigned int lostPackets)
+{
+    if (!megabytes) {
+        m_flightRecorder.stop();
+        return;
+    }
+
+    m_flightRecorder.setTriggers(usage, largestFree, lostPackets);
+    m_flightRecorder.start(megabytes, seconds);
+}
+
+bool AllocationRenderController::dumpFlightRecorder()
+{
+    return m_flightRecorder.dump();
+}
+
+void AllocationRenderController::setRenderMode(RenderMode mode)
+{
+    // Only affects the pools discovered from now on
+    m_renderMode = mode;
+}
+
+void AllocationRenderController::setReceiveBufferSize(int bytes)
+{
+    m_receiveBufferSize = bytes;
+}
+
+void AllocationRenderController::setReceiveBatchSize(int packets)
+{
+    m_receiveBatchSize = (packets > 0) ? packets : 1;
+}
+
+void AllocationRenderController::setReorderWindow(unsigned int packets, unsigned int ms)
+{
+    // Applied on connect(), the decoder belongs to the receiver thread
+    m_reorderPackets = packets;
+    m_reorderTime = ms;
+}
+
+void AllocationRenderController::setHistoryCheckpointing(unsigned int packets, unsigned int megabytes)
+{
+    // Applied when the playback starts
+    m_checkpointInterval = packets;
+    m_historyMemory = megabytes;
+}
+
+void AllocationRenderController::addListenPort(int port)
+{
+    if ((port > 0) && !m_ports.contains(port))
+        m_ports.append(port);
+}
+
+void AllocationRenderController::setTransport(Transport transport, QString shmName)
+{
+    m_transport = transport;
+    m_shmName = shmName;
+}
+
 bool AllocationRenderController::connect()
 {
     struct sockaddr_in addrIn;
+    int i;
+
+    if (m_transport == TRANSPORT_SHM) {
+        if (!m_shmRing.create(m_shmName.toStdString().c_str(), SHM_RING_CAPACITY))
+            return false;
+
+        return startReceiver();
+    }
 
     if (m_port < 0)
         return false;
 
-    m_udpSocket = socket(AF_INET,SOCK_DGRAM, 0);
+    m_epollFd = epoll_create(m_ports.size());
 
-    if (m_udpSocket < 0)
+    if (m_epollFd < 0)
         return false;
 
-    memset(&addrIn, 0, sizeof(addrIn));
+    for (i = 0; i < m_ports.size(); i++) {
+        int udpSocket = socket(AF_INET, SOCK_DGRAM, 0);
 
-    addrIn.sin_family = AF_INET;
-    addrIn.sin_port = htons(m_port);
-    addrIn.sin_addr.s_addr = INADDR_ANY;
+        if (udpSocket < 0)
+            break;
 
-    if (bind(m_udpSocket, (const sockaddr*)&addrIn, sizeof(addrIn)) < 0)
-    {
-        close(m_udpSocket);
+        m_udpSockets.append(udpSocket);
+
+        // A large socket buffer absorbs bursts while the receiver is busy, and
+        // SO_RXQ_OVFL lets us account for the datagrams the kernel still dropped
+        int opt = m_receiveBufferSize;
+        if (setsockopt(udpSocket, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(opt)) < 0)
+            break;
+
+        opt = 1;
+        setsockopt(udpSocket, SOL_SOCKET, SO_RXQ_OVFL, &opt, sizeof(opt));
+
+        // Arrival times, for the kernel receive latency
+        if (setsockopt(udpSocket, SOL_SOCKET, SO_TIMESTAMPNS, &opt, sizeof(opt)) < 0)
+            break;
+
+        // Sockets are drained until empty once epoll reports them readable
+        fcntl(udpSocket, F_SETFL, fcntl(udpSocket, F_GETFL) | O_NONBLOCK);
+
+        memset(&addrIn, 0, sizeof(addrIn));
+
+        addrIn.sin_family = AF_INET;
+        addrIn.sin_port = htons(m_ports[i]);
+        addrIn.sin_addr.s_addr = INADDR_ANY;
+
+        if (bind(udpSocket, (const sockaddr*)&addrIn, sizeof(addrIn)) < 0)
+            break;
+
+        struct epoll_event event;
+
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.u32 = i;
+
+        if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, udpSocket, &event) < 0)
+            break;
+    }
+
+    if (i != m_ports.size()) {
+        closeSockets();
         return false;
     }
 
+    return startReceiver();
+}
+
+bool AllocationRenderController::startReceiver()
+{
+    m_poolStateMap.clear();
     m_controllerSceneMap.clear();
+    m_sourceNames.clear();
+
+    m_decoder.reset();
+
+    m_receivedPackets = m_receiveSyscalls = m_kernelDrops = 0;
+    m_reorderedPackets = m_latePackets = 0;
 
-    m_controllerStatus = STATUS_IDLE;
+    m_pipelineStats.reset();
+
+    m_liveStart = monotonicNs();
 
     m_runThread = true;
 
+    m_frameScheduler.start();
+
     m_receiver = new ReceiverThread(this);
     m_receiver->start();
 
     return true;
 }
 
+void AllocationRenderController::closeSockets()
+{
+    for (int i = 0; i < m_udpSockets.size(); i++)
+        close(m_udpSockets[i]);
+
+    m_udpSockets.clear();
+
+    if (m_epollFd >= 0) {
+        close(m_epollFd);
+        m_epollFd = -1;
+    }
+
+    m_shmRing.close();
+}
+
 bool AllocationRenderController::renderTrace()
 {
     m_port = -1;
 
+    m_poolStateMap.clear();
     m_controllerSceneMap.clear();
 
-    m_controllerStatus = STATUS_IDLE;
+    m_decoder.reset();
+    m_pipelineStats.reset();
 
-    m_traceController = new TraceControllerDialog(this, m_renderPeriod);
+    m_traceController = new TraceControllerDialog(this, m_playbackSpeed);
 
     if (!m_traceController)
         return false;
 
-    QObject::connect(m_traceController, SIGNAL(renderPaceChanged(int)), this, SLOT(changeRenderPace(int)));
+    QObject::connect(m_traceController, SIGNAL(playbackSpeedChanged(double)), this, SLOT(changePlaybackSpeed(double)));
     QObject::connect(m_traceController, SIGNAL(pausePlayback()), this, SLOT(pauseTraceRendering()));
     QObject::connect(m_traceController, SIGNAL(resumePlayback()), this, SLOT(resumeTraceRendering()));
     QObject::connect(m_traceController, SIGNAL(timeLineTracking(int)), this, SLOT(timeLineTracking(int)));
     QObject::connect(m_traceController, SIGNAL(timeLineReleased(int)), this, SLOT(timeLineReleased(int)));
 
+    // The dialog is only touched from the GUI thread
+    QObject::connect(this, SIGNAL(timeLineRangeChanged(int, int, double)),
+                     m_traceController, SLOT(setTimeLineMinMax(int, int, double)), Qt::QueuedConnection);
+    QObject::connect(this, SIGNAL(timeLinePositionChanged(int, double)),
+                     m_traceController, SLOT(setTimeLinePosition(int, double)), Qt::QueuedConnection);
+
     m_traceController->show();
 
+    // Playback doesn't wait for it, seeks get faster as it goes
+    m_indexer = new TraceIndexer(m_trace);
+
+    QObject::connect(m_indexer, SIGNAL(indexProgress(unsigned int, unsigned int)),
+                     this, SLOT(traceIndexProgress(unsigned int, unsigned int)), Qt::QueuedConnection);
+
+    m_indexer->start(QThread::LowPriority);
+
+    m_traceController->setIndexer(m_indexer);
+
+    m_frameScheduler.start();
+
     m_trackingTraceOffset = -1;
 
     m_isPaused = true;
@@ -160,10 +413,10 @@ void AllocationRenderController::disconnect()
 {
     if (m_runThread) {
         m_runThread = false;
-        shutdown(m_udpSocket, SHUT_RDWR);
 
-        close(m_udpSocket);
-        m_udpSocket = -1;
+        // The receiver notices within an epoll timeout
+        for (int i = 0; i < m_udpSockets.size(); i++)
+            shutdown(m_udpSockets[i], SHUT_RDWR);
     }
 
     if (m_receiver) {
@@ -176,15 +429,37 @@ void AllocationRenderController::disconnect()
         m_receiver = 0;
     }
 
+    closeSockets();
+
+    m_frameScheduler.stop();
+    m_eventQueue.clear();
+
     QList<SceneController*> scenes = m_controllerSceneMap.values();
     for (QList<SceneController*>::iterator it = scenes.begin(); it != scenes.end(); ++it)
         delete (*it);
 
     m_controllerSceneMap.clear();
 
-    m_controllerStatus = STATUS_IDLE;
+    // Views go first, they observe the pool states
+    QList<PoolState*> states = m_poolStateMap.values();
+    for (QList<PoolState*>::iterator it = states.begin(); it != states.end(); ++it)
+        delete (*it);
+
+    m_poolStateMap.clear();
+
+    m_decoder.reset();
+
+    m_recorder.stopRecording();
 
-    m_outputTrace.close();
+    if (m_indexer) {
+        if (m_traceController)
+            m_traceController->setIndexer(0);
+
+        m_indexer->stop();
+
+        delete m_indexer;
+        m_indexer = 0;
+    }
 
     if (m_traceController) {
         m_traceController->close();
@@ -194,120 +469,500 @@ void AllocationRenderController::disconnect()
     }
 }
 
-AllocationRenderController::ReceiverThread::ReceiverThread(AllocationRenderController *parent)
+AllocationRenderController::ReceiverThread::ReceiverThread(AllocationRenderController *parent) : m_historyDecoder(&m_history)
 {
     m_parent = parent;
 
-    QObject::connect(m_parent, SIGNAL(bufferAllocation(DFBTracingPacket)), m_parent, SLOT(allocationEvent(DFBTracingPacket)));
-    QObject::connect(m_parent, SIGNAL(bufferRelease(DFBTracingPacket)), m_parent, SLOT(releaseEvent(DFBTracingPacket)));
+    m_slotCount = m_parent->m_receiveBatchSize;
+
+    m_slots = new PacketSlot[m_slotCount];
+    m_msgs = new struct mmsghdr[m_slotCount];
+
+    for (int i = 0; i < m_slotCount; i++) {
+        m_slots[i].iov.iov_base = m_slots[i].buf;
+        m_slots[i].iov.iov_len = sizeof(m_slots[i].buf);
+    }
+
+    m_lastSender = 0;
+    m_lastSenderKey = 0;
+
+    m_anchorWall = m_anchorTrace = 0;
+    m_pacingEpoch = m_parent->m_pacingEpoch - 1; // synchronize on the first packet
+    m_lastTimeLineUpdate = 0;
+
+    // A ring reports its drops like a single socket
+    m_socketDrops.resize(m_parent->m_udpSockets.isEmpty() ? 1 : m_parent->m_udpSockets.size(), 0);
+
+    m_history.setCheckpointing(m_parent->m_checkpointInterval, m_parent->m_historyMemory);
 }
 
 AllocationRenderController::ReceiverThread::~ReceiverThread()
 {
-    QObject::disconnect(m_parent, SIGNAL(bufferAllocation(DFBTracingPacket)));
-    QObject::disconnect(m_parent, SIGNAL(bufferRelease(DFBTracingPacket)));
+    std::map<unsigned long long, Sender *>::iterator it;
+
+    for (it = m_senders.begin(); it != m_senders.end(); ++it)
+        delete it->second;
+
+    delete[] m_msgs;
+    delete[] m_slots;
+}
+
+AllocationRenderController::ReceiverThread::Sender* AllocationRenderController::ReceiverThread::lookupSender(int socketIndex, const struct sockaddr_in& addrIn)
+{
+    unsigned long long key = ((unsigned long long)socketIndex << 48)
+                             | ((unsigned long long)ntohl(addrIn.sin_addr.s_addr) << 16)
+                             | ntohs(addrIn.sin_port);
+
+    // Datagrams of a batch mostly come from the same sender
+    if (m_lastSender && (key == m_lastSenderKey))
+        return m_lastSender;
+
+    std::map<unsigned long long, Sender *>::iterator it = m_senders.find(key);
+    Sender *sender;
+
+    if (it == m_senders.end()) {
+        char name[32];
+
+        snprintf(name, sizeof(name), "%s:%d", inet_ntoa(addrIn.sin_addr), ntohs(addrIn.sin_port));
+
+        sender = addSender(key, name, m_parent->m_ports[socketIndex], true);
+    } else
+        sender = it->second;
+
+    m_lastSender = sender;
+    m_lastSenderKey = key;
+
+    return sender;
+}
+
+AllocationRenderController::ReceiverThread::Sender* AllocationRenderController::ReceiverThread::addSender(unsigned long long key, const char* name,
+                                                                                                          int port, bool reorder)
+{
+    DFBTracingBufferData data;
+    unsigned int source = m_senders.size() + 1;
+
+    Sender *sender = new Sender(m_parent, source);
+
+    if (reorder)
+        sender->decoder.setReorderWindow(m_parent->m_reorderPackets, m_parent->m_reorderTime);
+
+    sender->decoder.setStatistics(&m_parent->m_pipelineStats);
+
+    strncpy(sender->name, name, sizeof(sender->name) - 1);
+    sender->name[sizeof(sender->name) - 1] = 0;
+
+    m_senders.insert(std::make_pair(key, sender));
+
+    // Let the main thread know how to name the pools of this sender
+    memset(&data, 0, sizeof(data));
+
+    data.poolId = port;
+    strncpy(data.name, sender->name, sizeof(data.name) - 1);
+
+    m_parent->pushEvent(EVENT_SOURCE_ADDED, source, &data);
+
+    return sender;
+}
+
+int AllocationRenderController::ReceiverThread::receiveRing()
+{
+    ShmRing& ring = m_parent->m_shmRing;
+
+    unsigned int n = ring.available();
+
+    if (!n)
+        return 0;
+
+    if (n > (unsigned int)m_slotCount)
+        n = m_slotCount;
+
+    m_parent->m_receiveSyscalls++;
+    m_parent->m_receivedPackets += n;
+
+    // Decode the records where they are and hand the slots back at once
+    for (unsigned int i = 0; i < n; i++) {
+        unsigned int size;
+        const char *record = ring.record(i, size);
+
+        m_lastSender->decoder.receivePacket(record, size);
+    }
+
+    ring.release(n);
+
+    m_socketDrops[0] = ring.dropped();
+
+    return n;
+}
+
+void AllocationRenderController::ReceiverThread::reportStatistics()
+{
+    std::map<unsigned long long, Sender *>::iterator it;
+
+    m_parent->m_kernelDrops = 0;
+
+    for (unsigned int i = 0; i < m_socketDrops.size(); i++)
+        m_parent->m_kernelDrops += m_socketDrops[i];
+
+    emit m_parent->receiveStatistics(m_parent->m_receivedPackets,
+                                     m_parent->m_receiveSyscalls,
+                                     m_parent->m_kernelDrops,
+                                     m_parent->m_reorderedPackets,
+                                     m_parent->m_latePackets);
+
+    // A single sender is already covered by the totals
+    if (m_senders.size() < 2)
+        return;
+
+    QString summary, line;
+
+    for (it = m_senders.begin(); it != m_senders.end(); ++it) {
+        Sender *sender = it->second;
+
+        line.sprintf("%s -> port %d, Lost: %d, Reordered: %d, Late: %d\n",
+                     sender->name, m_parent->m_ports[it->first >> 48],
+                     sender->listener.m_lostPackets, sender->listener.m_reorderedPackets,
+                     sender->listener.m_latePackets);
+
+        summary += line;
+    }
+
+    emit m_parent->senderStatistics(summary);
+}
+
+int AllocationRenderController::ReceiverThread::receiveBatch(int socketIndex)
+{
+    for (int i = 0; i < m_slotCount; i++) {
+        struct msghdr *hdr = &m_msgs[i].msg_hdr;
+
+        memset(hdr, 0, sizeof(*hdr));
+
+        hdr->msg_name = &m_slots[i].addrIn;
+        hdr->msg_namelen = sizeof(m_slots[i].addrIn);
+        hdr->msg_iov = &m_slots[i].iov;
+        hdr->msg_iovlen = 1;
+        hdr->msg_control = m_slots[i].control;
+        hdr->msg_controllen = sizeof(m_slots[i].control);
+
+        m_msgs[i].msg_len = 0;
+    }
+
+    // The socket is non-blocking, take whatever is already queued
+    int n = recvmmsg(m_parent->m_udpSockets[socketIndex], m_msgs, m_slotCount, MSG_DONTWAIT, NULL);
+
+    if (n <= 0)
+        return n;
+
+    m_parent->m_receiveSyscalls++;
+    m_parent->m_receivedPackets += n;
+
+    // The kernel reports a running drop counter with every datagram, the last one is the freshest
+    struct msghdr *hdr = &m_msgs[n - 1].msg_hdr;
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+        if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SO_RXQ_OVFL))
+            memcpy(&m_socketDrops[socketIndex], CMSG_DATA(cmsg), sizeof(unsigned int));
+    }
+
+    if (m_parent->m_pipelineStats.isEnabled())
+        recordKernelLatency(n);
+
+    return n;
+}
+
+void AllocationRenderController::ReceiverThread::recordKernelLatency(int count)
+{
+    struct timespec now;
+
+    // The kernel stamps datagrams with the wall clock
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    for (int i = 0; i < count; i++) {
+        struct msghdr *hdr = &m_msgs[i].msg_hdr;
+
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+            if ((cmsg->cmsg_level != SOL_SOCKET) || (cmsg->cmsg_type != SCM_TIMESTAMPNS))
+                continue;
+
+            struct timespec arrival;
+
+            memcpy(&arrival, CMSG_DATA(cmsg), sizeof(arrival));
+
+            long long ns = (now.tv_sec - arrival.tv_sec) * 1000000000LL + (now.tv_nsec - arrival.tv_nsec);
+
+            // Wall clock steps can't be told apart from a real latency
+            if (ns >= 0)
+                m_parent->m_pipelineStats.record(STAGE_KERNEL_RECEIVE, ns);
+        }
+    }
 }
 
 void AllocationRenderController::ReceiverThread::run()
 {
-    FILE* trace = NULL;
+    TraceFile trace;
     int trackingTraceOffset, currentPosition = 0;
 
-    struct sockaddr_in addrIn;
-    socklen_t addrLen;
-    char buf[2048];
+    const char* packet;
 
+    time_t lastReport = 0;
     int s;
 
-    TracePlaybackMode mode = NORMAL;
+    TraceIndex index;
+    TraceKeyframe keyframe;
 
-    // m_port > 0 -> read from the network
-    if (m_parent->m_port > 0)
-        memset(&addrIn, 0, sizeof(addrIn));
-    else {
-        trace = fopen(m_parent->m_trace.toStdString().c_str(), "rb");
-        if (!trace)
-            return;
+    // Live -> read from the network or the shared memory ring
+    if (m_parent->m_transport == TRANSPORT_SHM) {
+        char name[32];
 
-        fseek(trace, 0, SEEK_END);
-        long size = ftell(trace);
+        snprintf(name, sizeof(name), "shm:%s", m_parent->m_shmName.toStdString().c_str());
 
-        if (size < (long)sizeof(DFBTracingPacket)) {
-            fclose(trace);
+        // The ring holds a single, ordered sequence
+        m_lastSender = addSender(0, name, 0, false);
+    } else if (!m_parent->isLive()) {
+        // Map the trace: nothing gets read until a packet is actually touched
+        if (!trace.open(m_parent->m_trace.toStdString().c_str()))
             return;
+
+        if (!trace.packetCount())
+            return;
+
+        index.load(m_parent->m_trace.toStdString().c_str());
+
+        // Without them, packets are played at a nominal interval
+        m_timestamps.load(m_parent->m_trace.toStdString().c_str());
+
+        // A rotated trace starts from the state carried over from the previous one
+        if (index.keyframe(0, keyframe) && !keyframe.pools.empty()) {
+            m_history.load(keyframe);
+            m_history.diff(PoolHistory::Version(), &m_parent->m_decoderListener);
+
+            m_parent->m_decoder.resynchronize(keyframe.nSeq);
+            m_historyDecoder.resynchronize(keyframe.nSeq);
         }
 
-        fseek(trace, 0, SEEK_SET);
+        // Rewinding always has this one to fall back on
+        m_history.checkpoint(0);
 
         trackingTraceOffset = m_parent->m_trackingTraceOffset;
 
-        m_parent->m_traceController->setTimeLineMinMax(0, size / sizeof(DFBTracingPacket));
+        m_parent->m_playbackLength = trace.packetCount();
+
+        emit m_parent->timeLineRangeChanged(0, trace.packetCount(), packetTime(trace.packetCount() - 1) / 1e9);
     }
 
     while (m_parent->m_runThread)
     {
-        if (m_parent->m_port > 0) {
-            addrLen = sizeof(addrIn);
-            s = recvfrom(m_parent->m_udpSocket, buf, sizeof(buf), 0, (sockaddr*)&addrIn, &addrLen);
+        if (m_parent->m_transport == TRANSPORT_SHM) {
+            if (!receiveRing())
+                usleep(SHM_IDLE_SLEEP);
+
+            time_t now = time(NULL);
+
+            if (now != lastReport) {
+                reportStatistics();
+                lastReport = now;
+
+                m_parent->m_flightRecorder.poll();
+            }
+
+            continue;
+        } else if (m_parent->isLive()) {
+            struct epoll_event events[MAX_EPOLL_EVENTS];
+
+            // The timeout also lets held packets expire when senders stall
+            int timeout = (m_parent->m_reorderPackets && m_parent->m_reorderTime) ? m_parent->m_reorderTime : EPOLL_TIMEOUT;
+            int n = epoll_wait(m_parent->m_epollFd, events, MAX_EPOLL_EVENTS, timeout);
+
+            if ((n < 0) && (errno != EINTR))
+                break;
+
+            for (int e = 0; e < n; e++) {
+                int socketIndex = events[e].data.u32;
+
+                // Drain the socket, a short batch means it's empty
+                do {
+                    s = receiveBatch(socketIndex);
+
+                    for (int i = 0; i < s; i++) {
+                        Sender *sender = lookupSender(socketIndex, m_slots[i].addrIn);
+
+                        sender->decoder.receivePacket(m_slots[i].buf, m_msgs[i].msg_len);
+                    }
+                } while ((s == m_slotCount) && m_parent->m_runThread);
+            }
+
+            std::map<unsigned long long, Sender *>::iterator it;
+
+            for (it = m_senders.begin(); it != m_senders.end(); ++it)
+                it->second->decoder.expire();
+
+            time_t now = time(NULL);
+
+            if (now != lastReport) {
+                reportStatistics();
+                lastReport = now;
+
+                m_parent->m_flightRecorder.poll();
+            }
+
+            continue;
         } else
         {
+            bool seeking;
+
             m_parent->m_renderingSemaphore.acquire();
 
-            if ((mode == NORMAL) && (trackingTraceOffset != m_parent->m_trackingTraceOffset)) {
-                trackingTraceOffset = m_parent->m_trackingTraceOffset;
-                mode = (currentPosition < trackingTraceOffset) ? FAST_FORWARD : FAST_REWIND;
-            }
+            seeking = (trackingTraceOffset != m_parent->m_trackingTraceOffset);
+            trackingTraceOffset = m_parent->m_trackingTraceOffset;
 
-            if (mode == FAST_REWIND)
-                fseek(trace, -sizeof(DFBTracingPacket), SEEK_CUR);
+            packet = seeking ? NULL : trace.packet(currentPosition);
 
-            s = fread(buf, sizeof(DFBTracingPacket), 1, trace);
-            s = (s == 1) ? sizeof(DFBTracingPacket) : 0;
+            if (packet)
+                currentPosition++;
 
-            if (mode == FAST_REWIND)
-                fseek(trace, -sizeof(DFBTracingPacket), SEEK_CUR);
+            m_parent->m_renderingSemaphore.release();
 
-            currentPosition = ftell(trace);
-            currentPosition /= sizeof(DFBTracingPacket);
+            // Out of the semaphore, the main thread may have to drain the
+            // changes before they all fit in the queue
+            if (seeking) {
+                currentPosition = seek(trace, index, currentPosition, trackingTraceOffset);
+                m_parent->m_playbackPosition = currentPosition;
 
-            if ((mode != NORMAL) && (currentPosition == trackingTraceOffset))
-                mode = NORMAL;
+                continue;
+            }
 
-            m_parent->m_renderingSemaphore.release();
+            m_parent->m_playbackPosition = currentPosition;
 
-            if (!s && feof(trace))
+            if (!packet)
                 break;
 
-            if (mode == NORMAL) {
-                if (!m_parent->m_isTracking)
-                    m_parent->m_traceController->setTimeLinePosition(currentPosition);
+            unsigned long long now = monotonicNs();
 
-                usleep(m_parent->m_renderPeriod * 1000);
+            // Fast playback would otherwise flood the dialog
+            if (!m_parent->m_isTracking && ((now - m_lastTimeLineUpdate) >= TIMELINE_UPDATE_PERIOD)) {
+                emit m_parent->timeLinePositionChanged(currentPosition, packetTime(currentPosition - 1) / 1e9);
+                m_lastTimeLineUpdate = now;
             }
-        }
 
-        if (s <= 0) {
-            m_parent->m_controllerStatus = (s == 0) ? STATUS_IDLE : STATUS_ERROR;
-            break;
+            pace(currentPosition - 1);
+
+            s = sizeof(DFBTracingPacket);
+
+            m_history.advance(currentPosition - 1);
+            m_historyDecoder.receivePacket(packet, s);
         }
 
-        m_parent->receivePacket(buf, s, mode);
+        m_parent->m_decoder.receivePacket(packet, s);
     }
 
-    m_parent->m_controllerStatus = STATUS_IDLE;
+    emit m_parent->tracePlaybackEnded();
+}
+
+unsigned int AllocationRenderController::ReceiverThread::seek(TraceFile& trace, TraceIndex& index, unsigned int position, unsigned int target)
+{
+    PoolHistory::Version shown = m_history.current();
+    TraceKeyframe keyframe;
 
-    if (m_parent->m_traceController)
-        m_parent->m_traceController->stop();
+    unsigned int start = position, checkpointIndex;
 
-    if (trace)
-        fclose(trace);
+    if (target > trace.packetCount())
+        target = trace.packetCount();
 
-    emit m_parent->tracePlaybackEnded();
+    // Going forward, the state reached so far is as good unless a
+    // checkpoint is closer to the target
+    if (m_history.nearestCheckpoint(target, checkpointIndex)
+        && ((target < position) || (checkpointIndex > position))) {
+        m_history.restore(target, checkpointIndex);
+        start = checkpointIndex;
+    }
+
+    // The index may still be being built
+    index.update();
+
+    // Keyframes may be closer than any checkpoint taken so far
+    if (index.keyframe(target, keyframe) && ((keyframe.traceOffset / sizeof(DFBTracingPacket)) > start)) {
+        start = keyframe.traceOffset / sizeof(DFBTracingPacket);
+
+        m_history.load(keyframe);
+        m_history.checkpoint(start);
+    }
+
+    if ((start != position) && (start < trace.packetCount()))
+        m_historyDecoder.resynchronize(reinterpret_cast<const DFBTracingPacket*>(trace.packet(start))->header.nSeq);
+
+    if (start < target) {
+        trace.advise(TraceFile::ACCESS_SEQUENTIAL);
+        trace.prefetch(start, target);
+    }
+
+    // Taking the checkpoints due on the way
+    for (unsigned int i = start; i < target; i++) {
+        m_history.advance(i);
+        m_historyDecoder.receivePacket(trace.packet(i), sizeof(DFBTracingPacket));
+    }
+
+    // Only what differs from the pools shown goes through the event queue
+    m_history.diff(shown, &m_parent->m_decoderListener);
+
+    if (target < trace.packetCount())
+        m_parent->m_decoder.resynchronize(reinterpret_cast<const DFBTracingPacket*>(trace.packet(target))->header.nSeq);
+
+    return target;
 }
 
-void AllocationRenderController::changeRenderPace(int value)
+void AllocationRenderController::ReceiverThread::pace(unsigned int packetIndex)
 {
-    m_renderPeriod = value;
+    double speed = m_parent->m_playbackSpeed;
+
+    // As fast as possible: the event queue pushes back when full and each
+    // display frame applies whatever got queued meanwhile
+    if (speed <= 0.0)
+        return;
+
+    unsigned long long traceTime = packetTime(packetIndex);
+    unsigned long long now = monotonicNs();
+
+    if ((m_pacingEpoch != m_parent->m_pacingEpoch) || (traceTime < m_anchorTrace)) {
+        m_pacingEpoch = m_parent->m_pacingEpoch;
+
+        m_anchorWall = now;
+        m_anchorTrace = traceTime;
+        return;
+    }
+
+    unsigned long long due = m_anchorWall + (unsigned long long)((traceTime - m_anchorTrace) / speed);
+
+    if (now > (due + MAX_PLAYBACK_LAG)) {
+        m_anchorWall = now;
+        m_anchorTrace = traceTime;
+        return;
+    }
+
+    // Long idle periods of the trace are slept in slices
+    while ((due > now) && m_parent->m_runThread && (m_pacingEpoch == m_parent->m_pacingEpoch)) {
+        unsigned long long us = (due - now) / 1000;
+
+        usleep((us < MAX_PACING_SLEEP) ? us : MAX_PACING_SLEEP);
+
+        now = monotonicNs();
+    }
+}
+
+unsigned long long AllocationRenderController::ReceiverThread::packetTime(unsigned int packetIndex) const
+{
+    if (packetIndex < m_timestamps.count())
+        return m_timestamps.at(packetIndex);
+
+    // Past the recorded times, e.g. a trace still being written
+    unsigned long long last = m_timestamps.count() ? m_timestamps.at(m_timestamps.count() - 1) : 0;
+    unsigned int extra = packetIndex - (m_timestamps.count() ? (m_timestamps.count() - 1) : 0);
+
+    return last + extra * NOMINAL_PACKET_INTERVAL;
+}
+
+void AllocationRenderController::changePlaybackSpeed(double speed)
+{
+    m_playbackSpeed = speed;
+    m_pacingEpoch++;
 }
 
 void AllocationRenderController::pauseTraceRendering()
@@ -334,6 +989,9 @@ void AllocationRenderController::resumeTraceRendering()
     }
 
     if (m_isPaused) {
+        // Don't try to catch up with the time spent paused
+        m_pacingEpoch++;
+
         m_renderingSemaphore.release();
         m_isPaused = false;
     }
@@ -342,21 +1000,36 @@ void AllocationRenderController::resumeTraceRendering()
 void AllocationRenderController::timeLineTracking(int value)
 {
     m_isTracking = true;
+
+    // Seeks are cheap enough to follow the slider
+    timeLineSeek(value);
 }
 
 void AllocationRenderController::timeLineReleased(int value)
 {
     m_isTracking = false;
 
+    timeLineSeek(value);
+}
+
+void AllocationRenderController::timeLineSeek(int value)
+{
     if (!m_isPaused)
         m_renderingSemaphore.acquire();
 
     m_trackingTraceOffset = value;
+    m_pacingEpoch++;
 
     if (!m_isPaused)
         m_renderingSemaphore.release();
 }
 
+void AllocationRenderController::traceIndexProgress(unsigned int packets, unsigned int packetCount)
+{
+    if (m_traceController)
+        m_traceController->setIndexProgress(packets, packetCount);
+}
+
 void AllocationRenderController::tracePlaybackEndedEvent()
 {
     if (m_receiver)
@@ -370,183 +1043,319 @@ void AllocationRenderController::tracePlaybackEndedEvent()
         m_receiver = 0;
 
         QObject::disconnect(this, SIGNAL(tracePlaybackEnded()));
+
+        // After the last queued timeline position
+        if (m_traceController)
+            m_traceController->stop();
     }
 }
 
 void AllocationRenderController::renderAllocation(SceneController *scene, DFBTracingBufferData* data)
 {
-    AllocationRenderItem *allocationItem = new AllocationRenderItem(scene, data);
-
-    allocationItem->setPosition();
+    scene->state()->allocate(data);
 
-    scene->addItem(allocationItem);
-    scene->update();
+    m_frameScheduler.invalidate(scene, scene->spanRect(data->offset, data->size));
 }
 
 void AllocationRenderController::releaseAllocation(SceneController *scene, DFBTracingBufferData* data)
 {
-    QGraphicsItem* item = scene->lookup(data->offset);
+    if (scene->state()->release(data->offset))
+        m_frameScheduler.invalidate(scene, scene->spanRect(data->offset, data->size));
+}
+
+void AllocationRenderController::pushEvent(AllocationEventType type, unsigned int source, const DFBTracingBufferData* data)
+{
+    AllocationEvent event;
 
-    AllocationRenderItem* allocationItem = static_cast<AllocationRenderItem*>(item);
+    event.type = type;
+    event.source = source;
+    event.data = *data;
+    event.timestamp = m_pipelineStats.isEnabled() ? PipelineStats::now() : 0;
 
-    if (allocationItem) {
-        scene->removeItem(allocationItem);
-        scene->update();
+    if (m_eventQueue.push(event))
+        return;
+
+    // Live traffic can't be held back: account for the event and move on.
+    // A trace being played back waits for the main thread to catch up instead.
+    if (isLive()) {
+        __atomic_add_fetch(&m_droppedEvents, 1, __ATOMIC_RELAXED);
+        return;
     }
+
+    while (m_runThread && !m_eventQueue.push(event))
+        usleep(1000);
 }
 
-void AllocationRenderController::processSnapshotEvent(char* buf, int size)
+bool AllocationRenderController::pushEvents(const AllocationEvent* events, unsigned int count)
 {
-    DFBTracingPacket *packet = reinterpret_cast<DFBTracingPacket*>(buf);
+    // Would never fit, even with the main thread fully caught up
+    if (count > m_eventQueue.capacity()) {
+        __atomic_add_fetch(&m_droppedEvents, count, __ATOMIC_RELAXED);
+        return false;
+    }
 
-    if (packet->Payload.pool.count)
-    {
-        DFBTracingPoolData* pool = &packet->Payload.pool;
-        SceneController *scene = 0;
-
-        // Clear any QGraphicsItem objects already inserted
-        // WARN: assumes all stats belong to the same poolId
-        if (m_controllerSceneMap.contains(pool->stats[0].poolId)) {
-            SceneController *scene = m_controllerSceneMap.value(pool->stats[0].poolId);
-            assert(scene);
-            scene->clear();
-        }
+    if (m_eventQueue.push(events, count))
+        return true;
 
-        size -= sizeof(DFBTracingPacketHeader);
-        size -= offsetof(DFBTracingPoolData, stats);
+    if (isLive()) {
+        __atomic_add_fetch(&m_droppedEvents, count, __ATOMIC_RELAXED);
+        return false;
+    }
 
-        assert(size > 0);
+    while (m_runThread) {
+        if (m_eventQueue.push(events, count))
+            return true;
 
-        for (unsigned int i = 0; (i < pool->count) && ((unsigned int)size >= sizeof(DFBTracingBufferData)); i++)
-        {
-            // Create a new ControllerScene if this is a new poolId
-            if (!m_controllerSceneMap.contains(pool->stats[i].poolId))
-            {
-                scene = new AllocationSceneController(this, &pool->stats[i]);
+        usleep(1000);
+    }
+
+    return false;
+}
+
+void AllocationRenderController::drainEvents()
+{
+    AllocationEvent event;
+
+    bool timed = m_pipelineStats.isEnabled();
+    bool drained = false;
 
-                m_controllerSceneMap.insert(pool->stats[i].poolId, scene);
+    // A trace played back fast refills the queue as soon as there is room,
+    // leave time in the frame for painting and input
+    unsigned long long deadline = monotonicNs() + m_frameScheduler.frameBudget() * 1000000ULL / 2;
+    unsigned int count = 0;
 
-                emit newSurfacePool(scene, pool->stats[i].name);
-            } else
-                scene = m_controllerSceneMap.value(pool->stats[i].poolId);
+    while (m_eventQueue.pop(event)) {
+        drained = true;
+        count++;
 
-            assert(scene);
+        unsigned long long start = 0;
 
-            renderAllocation(scene, &pool->stats[i]);
+        if (timed && event.timestamp) {
+            start = PipelineStats::now();
 
-            size -= sizeof(DFBTracingBufferData);
+            m_pipelineStats.record(STAGE_QUEUE, start - event.timestamp);
         }
 
-        assert(size == 0);
+        switch (event.type) {
+        case EVENT_POOL_RESET:
+            resetEvent(event.source, &event.data);
+            break;
+        case EVENT_BUFFER_ALLOCATION:
+            allocationEvent(event.source, &event.data);
+            break;
+        case EVENT_BUFFER_RELEASE:
+            releaseEvent(event.source, &event.data);
+            break;
+        case EVENT_POOL_STALE:
+            staleEvent(event.source, &event.data, true);
+            break;
+        case EVENT_POOL_SYNCED:
+            staleEvent(event.source, &event.data, false);
+            break;
+        case EVENT_SOURCE_ADDED:
+            sourceEvent(event.source, &event.data);
+            break;
+        default:
+            break;
+        }
+
+        if (start)
+            m_pipelineStats.record(STAGE_SCENE, PipelineStats::now() - start);
+
+        if (count >= MAX_DRAINED_EVENTS)
+            break;
+
+        if (!(count % DRAIN_CHECK_EVENTS) && (monotonicNs() > deadline))
+            break;
+    }
+
+    m_pipelineStats.updateRates();
+
+    // The free space figures only move with events, one sample per frame
+    if (drained) {
+        double position = isLive() ? ((monotonicNs() - m_liveStart) / 1e9) : m_playbackPosition;
+
+        QMap<quint64, SceneController *>::iterator it;
+
+        for (it = m_controllerSceneMap.begin(); it != m_controllerSceneMap.end(); ++it)
+            it.value()->sampleFragmentation(position);
+    }
+
+    unsigned int dropped = __atomic_load_n(&m_droppedEvents, __ATOMIC_RELAXED);
+
+    if (dropped != m_reportedDroppedEvents) {
+        m_reportedDroppedEvents = dropped;
+        emit droppedEvents(dropped);
+    }
+}
+
+void AllocationRenderController::resetEvent(unsigned int source, DFBTracingBufferData* data)
+{
+    SceneController *scene = m_controllerSceneMap.value(poolKey(source, data->poolId));
 
-        if (size)
-            emit badPacket(packet->header.nSeq);
+    if (scene) {
+        scene->state()->reset();
 
-        m_controllerStatus = STATUS_RECEIVING;
+        m_frameScheduler.invalidate(scene);
     }
 }
 
-void AllocationRenderController::allocationEvent(DFBTracingPacket packet)
+void AllocationRenderController::staleEvent(unsigned int source, DFBTracingBufferData* data, bool stale)
+{
+    PoolState *state = m_poolStateMap.value(poolKey(source, data->poolId));
+
+    if (state)
+        state->setStale(stale);
+}
+
+void AllocationRenderController::sourceEvent(unsigned int source, DFBTracingBufferData* data)
 {
-    DFBTracingBufferData* data = &packet.Payload.buffer;
+    m_sourceNames.insert(source, QString(data->name));
+}
 
+void AllocationRenderController::allocationEvent(unsigned int source, DFBTracingBufferData* data)
+{
     SceneController *scene;
+    quint64 key = poolKey(source, data->poolId);
 
-    scene = m_controllerSceneMap.value(data->poolId);
+    scene = m_controllerSceneMap.value(key);
 
-    if (!m_controllerSceneMap.contains(data->poolId))
+    if (!m_controllerSceneMap.contains(key))
         assert(!scene);
 
     // Create a new ControllerScene if this is a new poolId
-    if (!scene && !m_controllerSceneMap.contains(data->poolId))
+    if (!scene && !m_controllerSceneMap.contains(key))
     {
-        scene = new AllocationSceneController(this, data);
+        PoolState *state = new PoolState(data);
+
+        m_poolStateMap.insert(key, state);
+
+        if (m_renderMode == RENDER_OCCUPANCY)
+            scene = new OccupancySceneController(this, state);
+        else if (m_renderMode == RENDER_SIMULATION)
+            scene = new SimulationSceneController(this, state);
+        else
+            scene = new AllocationSceneController(this, state);
+
+        m_controllerSceneMap.insert(key, scene);
 
-        m_controllerSceneMap.insert(data->poolId, scene);
+        // Tell the pools of each sender apart
+        if (m_sourceNames.contains(source)) {
+            QByteArray name = QString("%1 @ %2").arg(data->name).arg(m_sourceNames.value(source)).toAscii();
 
-        emit newSurfacePool(scene, data->name);
+            emit newSurfacePool(scene, name.data());
+        } else
+            emit newSurfacePool(scene, data->name);
     }
 
     renderAllocation(scene, data);
 }
 
-void AllocationRenderController::releaseEvent(DFBTracingPacket packet)
+void AllocationRenderController::releaseEvent(unsigned int source, DFBTracingBufferData* data)
 {
-    DFBTracingBufferData* data = &packet.Payload.buffer;
-
-    SceneController *scene = m_controllerSceneMap.value(data->poolId);
+    SceneController *scene = m_controllerSceneMap.value(poolKey(source, data->poolId));
 
     if (scene)
         releaseAllocation(scene, data);
 }
 
-void AllocationRenderController::processBufferEvent(char* buf)
+AllocationRenderController::DecoderListener::DecoderListener(AllocationRenderController *parent, unsigned int source)
 {
-    DFBTracingPacket *packet = reinterpret_cast<DFBTracingPacket*>(buf);
+    m_parent = parent;
+    m_source = source;
 
-    switch (packet->header.type) {
-    case DTE_POOL_BUFFER_ALLOCATION:
-        emit bufferAllocation(*packet); // Copy the object before switching the the main thread
-        break;
-    case DTE_POOL_BUFFER_RELEASE:
-        emit bufferRelease(*packet); // Copy the object before switching the the main thread
-        break;
-    default:
-        break;
-    }
+    m_lostPackets = m_reorderedPackets = m_latePackets = 0;
 }
 
-void AllocationRenderController::processPacket(char* buf, int size, TracePlaybackMode mode)
+void AllocationRenderController::DecoderListener::packetAccepted(const char* buf, int size)
 {
-    DFBTracingPacket *packet = reinterpret_cast<DFBTracingPacket*>(buf);
+    // A trace holds a single sequence, only the first sender gets recorded
+    if (m_parent->m_saveToFile && (m_source <= 1))
+        m_parent->m_recorder.write(buf, size);
 
-    m_currentNseq = packet->header.nSeq;
-    m_expectedNseq = m_currentNseq + 1;
+    if (m_parent->m_flightRecorder.isRunning() && (m_source <= 1))
+        m_parent->m_flightRecorder.write(buf, size);
+}
 
-    if (m_saveToFile)
-        m_outputTrace.write(buf, size);
+void AllocationRenderController::DecoderListener::lostPackets(unsigned int lastValidNseq, unsigned int expectedNseq)
+{
+    // A late packet or a restarted sender goes backwards, nothing was lost
+    if (lastValidNseq > expectedNseq)
+        m_lostPackets += lastValidNseq - expectedNseq;
 
-    switch (m_controllerStatus) {
-    case STATUS_SYNCING:
-        if (packet->header.type != DTE_POOL_FULL_SNAPSHOT)
-            return;
+    emit m_parent->lostPackets(lastValidNseq, expectedNseq);
+}
 
-        processSnapshotEvent(buf, size);
-        break;
-    case STATUS_RECEIVING:
-        if ((packet->header.type != DTE_POOL_BUFFER_ALLOCATION)
-            && (packet->header.type != DTE_POOL_BUFFER_RELEASE))
-            return;
+void AllocationRenderController::DecoderListener::badPacket(unsigned int nseq)
+{
+    emit m_parent->badPacket(nseq);
+}
+
+void AllocationRenderController::DecoderListener::missingInformation(unsigned int nseq)
+{
+    emit m_parent->missingInformation(nseq);
+}
 
-        if (mode == FAST_REWIND) // Force a release event if we're rewinding the trace
-            packet->header.type = DTE_POOL_BUFFER_RELEASE;
+void AllocationRenderController::DecoderListener::reorderedPacket(unsigned int nseq)
+{
+    (void)nseq;
 
-        processBufferEvent(buf);
-        break;
-    default:
-        break;
-    }
+    m_reorderedPackets++;
+    m_parent->m_reorderedPackets++;
 }
 
-void AllocationRenderController::receivePacket(char* buf, int size, TracePlaybackMode mode)
+void AllocationRenderController::DecoderListener::latePacket(unsigned int nseq)
 {
-    // Inspect the header for the sequence number
-    DFBTracingPacket *packet = reinterpret_cast<DFBTracingPacket*>(buf);
+    (void)nseq;
 
-    if ((mode != FAST_REWIND) && (packet->header.nSeq != m_expectedNseq)) {
-        m_currentNseq = packet->header.nSeq;
+    m_latePackets++;
+    m_parent->m_latePackets++;
+}
 
-        emit lostPackets(m_currentNseq, m_expectedNseq);
-        m_expectedNseq = m_currentNseq + 1;
+void AllocationRenderController::DecoderListener::poolReset(const DFBTracingBufferData* data)
+{
+    m_parent->pushEvent(EVENT_POOL_RESET, m_source, data);
+}
 
-        m_controllerStatus = STATUS_RECEIVING; //STATUS_SYNCING;
-    } else {
-        if (m_controllerStatus == STATUS_IDLE)
-            m_controllerStatus = STATUS_RECEIVING; //STATUS_SYNCING;
+void AllocationRenderController::DecoderListener::bufferAllocation(const DFBTracingBufferData* data)
+{
+    m_parent->pushEvent(EVENT_BUFFER_ALLOCATION, m_source, data);
+}
 
-        if (size != (sizeof(DFBTracingPacketHeader) + packet->header.size))
-            emit missingInformation(packet->header.nSeq);
-        else
-            processPacket(buf, size, mode);
+void AllocationRenderController::DecoderListener::bufferRelease(const DFBTracingBufferData* data)
+{
+    m_parent->pushEvent(EVENT_BUFFER_RELEASE, m_source, data);
+}
+
+void AllocationRenderController::DecoderListener::poolStale(unsigned int poolId, bool stale)
+{
+    DFBTracingBufferData data;
+
+    memset(&data, 0, sizeof(data));
+    data.poolId = poolId;
+
+    m_parent->pushEvent(stale ? EVENT_POOL_STALE : EVENT_POOL_SYNCED, m_source, &data);
+}
+
+bool AllocationRenderController::DecoderListener::poolSnapshot(const DFBTracingBufferData* stats, unsigned int count)
+{
+    AllocationEvent event;
+
+    // Queue the rebuild as one batch so that no frame shows it half done
+    m_snapshotEvents.clear();
+
+    event.type = EVENT_POOL_RESET;
+    event.source = m_source;
+    event.data = stats[0];
+    event.timestamp = m_parent->m_pipelineStats.isEnabled() ? PipelineStats::now() : 0;
+    m_snapshotEvents.push_back(event);
+
+    event.type = EVENT_BUFFER_ALLOCATION;
+
+    for (unsigned int i = 0; i < count; i++) {
+        event.data = stats[i];
+        m_snapshotEvents.push_back(event);
     }
+
+    return m_parent->pushEvents(&m_snapshotEvents[0], m_snapshotEvents.size());
 }
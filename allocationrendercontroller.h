@@ -20,14 +20,32 @@
 #include <QSemaphore>
 #include <QThreadPool>
 #include <QRunnable>
+#include <QVector>
 
 #include <time.h>
 #include <fstream>
+#include <map>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
 
 using namespace std;
 
 #include "allocationrenderitem.h"
 #include "tracecontrollerdialog.h"
+#include "eventqueue.h"
+#include "framescheduler.h"
+#include "poolstate.h"
+#include "packetdecoder.h"
+#include "traceindex.h"
+#include "tracefile.h"
+#include "tracerecorder.h"
+#include "tracetimestamps.h"
+#include "shmring.h"
+#include "pipelinestats.h"
+#include "poolhistory.h"
+#include "traceindexer.h"
+#include "flightrecorder.h"
 
 class SceneController;
 class TraceControllerDialog;
@@ -36,8 +54,19 @@ class AllocationRenderController : public QObject
 {
     Q_OBJECT
 public:
+    typedef enum {
+        RENDER_ITEMS,
+        RENDER_OCCUPANCY,
+        RENDER_SIMULATION // replays the pools through other allocators
+    } RenderMode;
+
+    typedef enum {
+        TRANSPORT_UDP,
+        TRANSPORT_SHM
+    } Transport;
+
     explicit AllocationRenderController(QString ipAddr, int port, bool saveToFile);
-    explicit AllocationRenderController(QString traceFile, int period_ms);
+    explicit AllocationRenderController(QString traceFile, double speed);
     ~AllocationRenderController();
 
     bool connect();
@@ -46,6 +75,41 @@ public:
     void disconnect();
 
     void saveTraceToFile(bool save);
+    void setTraceRotation(unsigned int megabytes, unsigned int seconds);
+
+    void setFrameBudget(int ms);
+    void setRenderMode(RenderMode mode);
+
+    void setReceiveBufferSize(int bytes);
+    void setReceiveBatchSize(int packets);
+    void setReorderWindow(unsigned int packets, unsigned int ms);
+
+    // Seeking a trace restores a checkpoint taken every so many packets,
+    // the interval doubles whenever they hold more than megabytes
+    void setHistoryCheckpointing(unsigned int packets, unsigned int megabytes);
+
+    // Also listen on port, each sender gets its own pools and sequence
+    void addListenPort(int port);
+
+    // Receive from a shared memory ring created on connect(), for a
+    // traced process running on the same host
+    void setTransport(Transport transport, QString shmName = QString());
+
+    // Keep the last packets in memory and dump them on a trigger, 0 megabytes
+    // turns it off. Thresholds in % of a pool, bytes and lost packets per
+    // second, 0 disables the trigger.
+    void setFlightRecorder(unsigned int megabytes, unsigned int seconds,
+                           float usage, unsigned int largestFree, unsigned int lostPackets);
+    bool dumpFlightRecorder();
+
+    // Per-stage latencies from datagram reception to repaint
+    PipelineStats* pipelineStats() { return &m_pipelineStats; }
+
+    // Usage summaries of the trace played, 0 when live
+    TraceIndexer* traceIndexer() { return m_indexer; }
+
+    // In packets for a trace, 0 when live: the timeline grows with time
+    double timelineLength() const { return isLive() ? 0 : m_playbackLength; }
 
 signals:
     void newSurfacePool(SceneController* scene, char* name);
@@ -53,37 +117,64 @@ signals:
     void badPacket(unsigned int nseq);
     void missingInformation(unsigned int nseq);
     void finished();
-
-    void bufferAllocation(DFBTracingPacket packet);
-    void bufferRelease(DFBTracingPacket packet);
+    void receiveStatistics(unsigned int packets, unsigned int syscalls, unsigned int kernelDrops,
+                           unsigned int reordered, unsigned int late);
+    void senderStatistics(QString summary);
+    void droppedEvents(unsigned int count);
+    void recorderStatistics(unsigned int bytesPerSecond, unsigned int queueDepth, unsigned int droppedPackets);
+    void recorderRotationFailed(QString traceName);
+    void frameStatistics(unsigned int mergedEvents, unsigned int peakMergedEvents);
+    void flightRecorderDumped(QString traceName, QString trigger);
+    void flightRecorderDumpFailed(QString trigger);
 
     void tracePlaybackEnded();
 
+    // From the receiver thread, queued to the trace controller dialog
+    void timeLineRangeChanged(int min, int max, double duration);
+    void timeLinePositionChanged(int value, double time);
+
 private slots:
-    void changeRenderPace(int value);
+    void changePlaybackSpeed(double speed);
     void pauseTraceRendering();
     void resumeTraceRendering();
     void timeLineTracking(int value);
     void timeLineReleased(int value);
 
-    void allocationEvent(DFBTracingPacket packet);
-    void releaseEvent(DFBTracingPacket packet);
+    void traceIndexProgress(unsigned int packets, unsigned int packetCount);
+
+    void drainEvents();
 
     void tracePlaybackEndedEvent();
 
 private:
-    typedef enum {
-        STATUS_IDLE,
-        STATUS_RECEIVING,
-        STATUS_SYNCING,
-        STATUS_ERROR
-    } ControllerStatus;
+    class DecoderListener : public PacketListener {
+    public:
+        DecoderListener(AllocationRenderController* parent, unsigned int source);
 
-    typedef enum {
-        NORMAL,
-        FAST_FORWARD,
-        FAST_REWIND
-    } TracePlaybackMode;
+        void packetAccepted(const char* buf, int size);
+        void lostPackets(unsigned int lastValidNseq, unsigned int expectedNseq);
+        void badPacket(unsigned int nseq);
+        void missingInformation(unsigned int nseq);
+        void reorderedPacket(unsigned int nseq);
+        void latePacket(unsigned int nseq);
+
+        void poolReset(const DFBTracingBufferData* data);
+        void bufferAllocation(const DFBTracingBufferData* data);
+        void bufferRelease(const DFBTracingBufferData* data);
+
+        void poolStale(unsigned int poolId, bool stale);
+        bool poolSnapshot(const DFBTracingBufferData* stats, unsigned int count);
+
+        unsigned int m_lostPackets;
+        unsigned int m_reorderedPackets;
+        unsigned int m_latePackets;
+
+    private:
+        AllocationRenderController *m_parent;
+        unsigned int m_source;
+
+        std::vector<AllocationEvent> m_snapshotEvents;
+    };
 
     class ReceiverThread : public QThread {
     public:
@@ -93,26 +184,112 @@ private:
         void run();
 
     private:
+        // A remote process, told apart by its address and the port it sends to
+        struct Sender {
+            Sender(AllocationRenderController* parent, unsigned int source) : listener(parent, source),
+                                                                             decoder(&listener) {}
+
+            DecoderListener listener;
+            PacketDecoder decoder;
+
+            char name[32];
+        };
+
+        // Sleeps until packetIndex is due, following the recorded timing
+        void pace(unsigned int packetIndex);
+        unsigned long long packetTime(unsigned int packetIndex) const;
+
+        // Moves the pools shown from position to target, returns the new position
+        unsigned int seek(TraceFile& trace, TraceIndex& index, unsigned int position, unsigned int target);
+
+        int receiveBatch(int socketIndex);
+        void recordKernelLatency(int count);
+        int receiveRing();
+
+        Sender* addSender(unsigned long long key, const char* name, int port, bool reorder);
+        Sender* lookupSender(int socketIndex, const struct sockaddr_in& addrIn);
+        void reportStatistics();
+
         AllocationRenderController *m_parent;
+
+        std::map<unsigned long long, Sender *> m_senders;
+        Sender *m_lastSender;
+        unsigned long long m_lastSenderKey;
+
+        std::vector<unsigned int> m_socketDrops;
+
+        // Preallocated packet slots filled by a single recvmmsg() call
+        struct PacketSlot {
+            char buf[2048];
+            char control[CMSG_SPACE(sizeof(unsigned int)) + CMSG_SPACE(sizeof(struct timespec))];
+            struct iovec iov;
+            struct sockaddr_in addrIn;
+        };
+
+        PacketSlot *m_slots;
+        struct mmsghdr *m_msgs;
+        int m_slotCount;
+
+        TraceTimestamps m_timestamps;
+
+        // Wall clock and trace times playback was last synchronized at
+        unsigned long long m_anchorWall;
+        unsigned long long m_anchorTrace;
+        unsigned int m_pacingEpoch;
+
+        unsigned long long m_lastTimeLineUpdate;
+
+        // Versions of the pools as played, to seek in the trace
+        PoolHistory m_history;
+        PacketDecoder m_historyDecoder;
     };
 
-    void receivePacket(char* buf, int size, TracePlaybackMode mode);
-    void processPacket(char* buf, int size, TracePlaybackMode mode);
+    // Pools of different senders live in separate namespaces
+    static quint64 poolKey(unsigned int source, unsigned int poolId) { return ((quint64)source << 32) | poolId; }
+
+    void pushEvent(AllocationEventType type, unsigned int source, const DFBTracingBufferData* data);
+    bool pushEvents(const AllocationEvent* events, unsigned int count);
 
-    void processSnapshotEvent(char* buf, int size);
-    void processBufferEvent(char* buf);
+    bool startReceiver();
+    void closeSockets();
+
+    bool isLive() const { return (m_port > 0) || (m_transport == TRANSPORT_SHM); }
+
+    void timeLineSeek(int value);
+
+    void resetEvent(unsigned int source, DFBTracingBufferData* data);
+    void staleEvent(unsigned int source, DFBTracingBufferData* data, bool stale);
+    void sourceEvent(unsigned int source, DFBTracingBufferData* data);
+    void allocationEvent(unsigned int source, DFBTracingBufferData* data);
+    void releaseEvent(unsigned int source, DFBTracingBufferData* data);
 
     void renderAllocation(SceneController *scene, DFBTracingBufferData* data);
     void releaseAllocation(SceneController *scene, DFBTracingBufferData* data);
 
-    QMap<unsigned int, SceneController *> m_controllerSceneMap;
+    QMap<quint64, PoolState *> m_poolStateMap;
+    QMap<quint64, SceneController *> m_controllerSceneMap;
+    QMap<unsigned int, QString> m_sourceNames;
 
     QString m_ipAddr;
     int m_port;
-    int m_udpSocket;
+    QList<int> m_ports;
+    QVector<int> m_udpSockets;
+    int m_epollFd;
+
+    Transport m_transport;
+    QString m_shmName;
+    ShmRing m_shmRing;
 
     QString m_trace;
-    int m_renderPeriod; // in ms
+    double m_playbackSpeed; // 0 plays as fast as possible
+    unsigned int m_playbackPosition; // packets read so far
+    unsigned int m_playbackLength; // in packets
+    unsigned int m_pacingEpoch; // bumped on pause, seek and speed changes
+
+    unsigned int m_checkpointInterval; // in packets
+    unsigned int m_historyMemory; // in MB
+
+    RenderMode m_renderMode;
 
     TraceControllerDialog *m_traceController;
     long m_trackingTraceOffset;
@@ -121,16 +298,41 @@ private:
     bool m_runThread;
     ReceiverThread *m_receiver;
 
+    TraceIndexer *m_indexer; // while playing a trace
+
+    int m_receiveBufferSize; // SO_RCVBUF, in bytes
+    int m_receiveBatchSize; // packets per recvmmsg() call
+
+    unsigned int m_reorderPackets;
+    unsigned int m_reorderTime; // in ms
+
+    unsigned long long m_liveStart; // in ns
+
+    unsigned int m_receivedPackets;
+    unsigned int m_receiveSyscalls;
+    unsigned int m_kernelDrops;
+    unsigned int m_reorderedPackets;
+    unsigned int m_latePackets;
+
     QSemaphore m_renderingSemaphore;
     bool m_isPaused;
 
+    EventQueue m_eventQueue;
+    FrameScheduler m_frameScheduler;
+
+    unsigned int m_droppedEvents; // bumped by the receiver thread, accessed atomically
+    unsigned int m_reportedDroppedEvents;
+
+    PipelineStats m_pipelineStats;
+
     bool m_saveToFile;
-    ofstream m_outputTrace;
-    struct tm m_startingDate;
+    TraceRecorder m_recorder;
 
-    unsigned int m_currentNseq, m_expectedNseq;
+    FlightRecorder m_flightRecorder;
 
-    ControllerStatus m_controllerStatus;
+    // Trace playback, live senders have their own
+    DecoderListener m_decoderListener;
+    PacketDecoder m_decoder;
 };
 
 #endif // ALLOCATIONRENDERCONTROLLER_H
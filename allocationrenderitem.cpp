@@ -20,14 +20,21 @@
 
 #define UNUSED_PARAM(a) (a) = (a)
 
+// Below that, no label fits anyway
+#define MIN_LABEL_HEIGHT 8 // in pixels
+
+// Sizes and formats seen, before starting over
+#define MAX_CACHED_LABELS 4096
+
 DirectFBPixelFormatNames(pf_names);
 
-AllocationRenderItem::AllocationRenderItem(SceneController *scene, DFBTracingBufferData *data)
+QHash<quint64, QStaticText> AllocationRenderItem::s_labels;
+
+AllocationRenderItem::AllocationRenderItem(SceneController *scene, const PoolAllocation& allocation)
 {
     m_age = 0;
     m_scene = scene;
-    m_allocation = *data;
-    m_text = 0;
+    m_allocation = allocation;
 }
 
 void AllocationRenderItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
@@ -43,8 +50,7 @@ void AllocationRenderItem::paint(QPainter *painter, const QStyleOptionGraphicsIt
     x2 = (int)((m_allocation.offset + m_allocation.size) * m_scene->aspectRatio()) % (int)m_scene->width();
     y2 = (int)((m_allocation.offset + m_allocation.size) * m_scene->aspectRatio()) / (int)m_scene->width();
 
-    int idx = (DFB_PIXELFORMAT_INDEX(m_allocation.format) * 255) / DFB_NUM_PIXELFORMATS;
-    QColor color = QColor((idx + 32) % 256, (idx + 64) % 256, (idx + 128) % 256);
+    QColor color = QColor(SceneController::formatColor(m_allocation.format));
 
     if (y2 > y1) {
         painter->setPen(color);
@@ -55,6 +61,56 @@ void AllocationRenderItem::paint(QPainter *painter, const QStyleOptionGraphicsIt
         painter->setPen(color);
         painter->drawLine(x1, y1, x2, y1);
     }
+
+    // The full rows when there are some, the first one otherwise
+    if (y2 > (y1 + 1))
+        drawLabel(painter, QRectF(0, y1 + 1, m_scene->width(), y2 - y1 - 1));
+    else
+        drawLabel(painter, QRectF(x1, y1, ((y2 > y1) ? m_scene->width() : x2) - x1 + 1, 1));
+}
+
+void AllocationRenderItem::drawLabel(QPainter *painter, const QRectF& area)
+{
+    QRectF device = painter->worldTransform().mapRect(area);
+
+    if (device.height() < MIN_LABEL_HEIGHT)
+        return;
+
+    const QStaticText& text = label(m_allocation);
+
+    if ((device.width() < text.size().width()) || (device.height() < text.size().height()))
+        return;
+
+    // Drawn at the same size whatever the zoom
+    painter->save();
+    painter->resetTransform();
+    painter->setPen(QColor(0, 0, 0));
+    painter->drawStaticText(device.topLeft(), text);
+    painter->restore();
+}
+
+const QStaticText& AllocationRenderItem::label(const PoolAllocation& allocation)
+{
+    quint64 key = ((quint64)(allocation.width & 0xffffff) << 40) | ((quint64)(allocation.height & 0xffffff) << 16)
+                  | DFB_PIXELFORMAT_INDEX(allocation.format);
+
+    QHash<quint64, QStaticText>::iterator it = s_labels.find(key);
+
+    if (it != s_labels.end())
+        return it.value();
+
+    if (s_labels.size() >= MAX_CACHED_LABELS)
+        s_labels.clear();
+
+    char buf[256];
+
+    sprintf(buf, "%dx%d, %s", allocation.width, allocation.height, pf_names[DFB_PIXELFORMAT_INDEX(allocation.format)].name);
+
+    QStaticText text(buf);
+
+    text.setPerformanceHint(QStaticText::AggressiveCaching);
+
+    return s_labels.insert(key, text).value();
 }
 
 QRectF AllocationRenderItem::boundingRect () const
@@ -70,33 +126,25 @@ QRectF AllocationRenderItem::boundingRect () const
     x2 = (int)((m_allocation.offset + m_allocation.size) * m_scene->aspectRatio()) % (int)m_scene->width();
     y2 = (int)((m_allocation.offset + m_allocation.size) * m_scene->aspectRatio())/ (int)m_scene->width();
 
+    // Exposure decides what gets painted, labels included
     if (y2 > y1) {
         width = m_scene->width();
         height = (y2 - y1 + 1);
+
+        rect.setRect(0, y1, width, height);
     } else {
-        width = (x2 - x1);
+        width = (x2 - x1 + 1);
         height = 1;
-    }
 
-    rect.setCoords(x1, y1, width, height);
+        rect.setRect(x1, y1, width, height);
+    }
 
     return rect;
 }
 
 void AllocationRenderItem::setPosition()
 {
-    char buf[256];
-
-    int x1 = (int)(m_allocation.offset * m_scene->aspectRatio()) % (int)m_scene->width();
-    int y1 = (int)(m_allocation.offset * m_scene->aspectRatio()) / (int)m_scene->width();
-
     setPos(0, 0);
-
-    sprintf(buf, "%dx%d, %s", m_allocation.width, m_allocation.height, pf_names[DFB_PIXELFORMAT_INDEX(m_allocation.format)].name);
-
-    m_text = m_scene->addText(buf);
-    m_text->setPos(x1, y1);
-    m_text->setParentItem(this);
 }
 
 int AllocationRenderItem::elder()
@@ -19,6 +19,8 @@
 
 #include <QGraphicsItem>
 #include <QGraphicsScene>
+#include <QStaticText>
+#include <QHash>
 
 #include <directfb.h>
 #include <directfb_strings.h>
@@ -26,11 +28,15 @@
 #include <core/remote_tracing.h>
 
 #include "scenecontroller.h"
+#include "poolstate.h"
 
+// An allocation in the linear pool layout. Its "WxH, FORMAT" label is only
+// laid out when the item is painted, i.e. exposed, and big enough at the
+// current zoom to hold it.
 class AllocationRenderItem : public QGraphicsItem
 {
 public:
-    explicit AllocationRenderItem(SceneController *scene, DFBTracingBufferData *data);
+    explicit AllocationRenderItem(SceneController *scene, const PoolAllocation& allocation);
 
     QRectF boundingRect () const;
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = 0);
@@ -38,17 +44,23 @@ public:
     int elder();
     void setPosition();
 
-    const DFBTracingBufferData& allocation() { return m_allocation; }
+    const PoolAllocation& allocation() { return m_allocation; }
 
 signals:
 
 public slots:
 
 private:
-    DFBTracingBufferData m_allocation;
+    void drawLabel(QPainter *painter, const QRectF& area);
+
+    // Many allocations share their size and format
+    static const QStaticText& label(const PoolAllocation& allocation);
+
+    static QHash<quint64, QStaticText> s_labels;
+
+    PoolAllocation m_allocation;
 
     SceneController *m_scene;
-    QGraphicsTextItem *m_text;
 
     int m_age;
 };
@@ -23,15 +23,11 @@
 #include "allocationscenecontroller.h"
 #include "allocationrenderitem.h"
 
-AllocationSceneController::AllocationSceneController(QObject *parent, DFBTracingBufferData *data) : SceneController(parent, data)
+AllocationSceneController::AllocationSceneController(QObject *parent, PoolState *state) : SceneController(parent, state)
 {
-    m_poolSize = data->poolSize;
+    m_poolSize = state->poolSize();
 
     m_allocationItemsHash.clear();
-
-    memset(&m_info, 0, sizeof(m_info));
-
-    m_info.lowestUsage = 0xffffffff;
 }
 
 void AllocationSceneController::setSceneRect(const QRectF &rect)
@@ -53,41 +49,39 @@ float AllocationSceneController::aspectRatio()
     return m_renderAspectRatio;
 }
 
-void AllocationSceneController::addItem(QGraphicsItem *item)
+void AllocationSceneController::allocationAdded(const PoolAllocation& allocation)
 {
-    AllocationRenderItem* allocationItem = static_cast<AllocationRenderItem*>(item);
-
-    m_allocationItemsHash.insert(allocationItem->allocation().offset, allocationItem);
-    QGraphicsScene::addItem(item);
+    AllocationRenderItem* allocationItem = new AllocationRenderItem(this, allocation);
 
-    m_info.allocated += allocationItem->allocation().size;
-    m_info.totalSize = allocationItem->allocation().poolSize;
+    allocationItem->setPosition();
 
-    m_info.usageRatio = (m_info.allocated / (float)m_info.totalSize) * 100;
-    m_info.peakUsage = (m_info.peakUsage < m_info.allocated) ? m_info.allocated : m_info.peakUsage;
-    m_info.lowestUsage = (m_info.lowestUsage > m_info.allocated) ? m_info.allocated : m_info.lowestUsage;
+    m_allocationItemsHash.insert(allocation.offset, allocationItem);
+    QGraphicsScene::addItem(allocationItem);
 
     emit statusChanged();
 }
 
-void AllocationSceneController::removeItem(QGraphicsItem *item)
+void AllocationSceneController::allocationRemoved(const PoolAllocation& allocation)
 {
-    AllocationRenderItem* allocationItem = static_cast<AllocationRenderItem*>(item);
+    AllocationRenderItem* allocationItem = m_allocationItemsHash.take(allocation.offset);
 
-    m_allocationItemsHash.remove(allocationItem->allocation().offset);
-    QGraphicsScene::removeItem(item);
+    if (allocationItem) {
+        QGraphicsScene::removeItem(allocationItem);
+        delete allocationItem;
+    }
 
-    m_info.allocated -= allocationItem->allocation().size;
-    m_info.totalSize = allocationItem->allocation().poolSize;
+    emit statusChanged();
+}
 
-    m_info.usageRatio = (m_info.allocated / (float)m_info.totalSize) * 100;
-    m_info.peakUsage = (m_info.peakUsage < m_info.allocated) ? m_info.allocated : m_info.peakUsage;
-    m_info.lowestUsage = (m_info.lowestUsage > m_info.allocated) ? m_info.allocated : m_info.lowestUsage;
+void AllocationSceneController::poolReset()
+{
+    m_allocationItemsHash.clear();
+    QGraphicsScene::clear();
 
     emit statusChanged();
 }
 
-QGraphicsItem* AllocationSceneController::lookup(unsigned int offset)
+AllocationRenderItem* AllocationSceneController::lookup(unsigned int offset)
 {
     return m_allocationItemsHash.value(offset);
 }
@@ -96,5 +90,10 @@ void AllocationSceneController::getStatus(QString& status)
 {
     status.sprintf("Currently allocated: %d (ratio: %.2f%%)\n"
                    "Peak usage: %d, Lowest usage: %d\n",
-                   m_info.allocated, m_info.usageRatio, m_info.peakUsage, m_info.lowestUsage);
+                   m_state->allocated(), m_state->usageRatio(), m_state->peakUsage(), m_state->lowestUsage());
+
+    appendFragmentationStatus(status);
+
+    if (m_state->isStale())
+        status += "Out of sync, waiting for a pool snapshot\n";
 }
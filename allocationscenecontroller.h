@@ -33,29 +33,22 @@ class AllocationSceneController : public SceneController
 {
     Q_OBJECT
 public:
-    explicit AllocationSceneController(QObject *parent, DFBTracingBufferData* data);
+    explicit AllocationSceneController(QObject *parent, PoolState* state);
 
     void setSceneRect(const QRectF &rect);
     void setSceneRect(qreal x, qreal y, qreal w, qreal h);
 
     float aspectRatio();
 
-    void addItem(QGraphicsItem *item);
-    void removeItem(QGraphicsItem *item);
+    void allocationAdded(const PoolAllocation& allocation);
+    void allocationRemoved(const PoolAllocation& allocation);
+    void poolReset();
 
-    QGraphicsItem* lookup(unsigned int offset);
+    AllocationRenderItem* lookup(unsigned int offset);
 
     void getStatus(QString& status);
 
 private:
-    struct ControllerStatus {
-        unsigned int allocated;
-        unsigned int totalSize;
-        unsigned int peakUsage;
-        unsigned int lowestUsage;
-        float usageRatio;
-    } m_info;
-
     unsigned int m_poolSize;
 
     QHash<unsigned int, AllocationRenderItem *> m_allocationItemsHash;
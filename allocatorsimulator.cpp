@@ -0,0 +1,548 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <string.h>
+
+#include "allocatorsimulator.h"
+
+// Smallest buddy block, surfaces rarely go below a page
+#define MIN_BUDDY_ORDER 12
+
+// Size classes of the segregated policy, from 4K to 256K slots
+#define SEGREGATED_MIN_ORDER 12
+#define SEGREGATED_MAX_ORDER 18
+#define SEGREGATED_SLAB_SIZE (1 << 20)
+
+static const char* const policyNames[] = { "first-fit", "best-fit", "buddy", "segregated", 0 };
+
+AllocatorPolicy* AllocatorPolicy::create(const char* name)
+{
+    if (!strcmp(name, "first-fit"))
+        return new FirstFitPolicy();
+    else if (!strcmp(name, "best-fit"))
+        return new BestFitPolicy();
+    else if (!strcmp(name, "buddy"))
+        return new BuddyPolicy();
+    else if (!strcmp(name, "segregated"))
+        return new SegregatedPolicy();
+
+    return 0;
+}
+
+const char* const* AllocatorPolicy::names()
+{
+    return policyNames;
+}
+
+void FreeList::reset(unsigned int offset, unsigned int size)
+{
+    m_blocks.clear();
+    m_bySize.clear();
+
+    if (size)
+        insert(offset, size);
+}
+
+void FreeList::insert(unsigned int offset, unsigned int size)
+{
+    m_blocks.insert(std::make_pair(offset, size));
+    m_bySize.insert(std::make_pair(size, offset));
+}
+
+void FreeList::erase(BlockMap::iterator it)
+{
+    m_bySize.erase(std::make_pair(it->second, it->first));
+    m_blocks.erase(it);
+}
+
+void FreeList::take(BlockMap::iterator it, unsigned int size)
+{
+    unsigned int offset = it->first;
+    unsigned int blockSize = it->second;
+
+    erase(it);
+
+    if (blockSize > size)
+        insert(offset + size, blockSize - size);
+}
+
+bool FreeList::firstFit(unsigned int size, unsigned int& offset)
+{
+    for (BlockMap::iterator it = m_blocks.begin(); it != m_blocks.end(); ++it) {
+        if (it->second >= size) {
+            offset = it->first;
+            take(it, size);
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool FreeList::bestFit(unsigned int size, unsigned int& offset)
+{
+    std::set<std::pair<unsigned int, unsigned int> >::iterator fit = m_bySize.lower_bound(std::make_pair(size, 0u));
+
+    if (fit == m_bySize.end())
+        return false;
+
+    offset = fit->second;
+    take(m_blocks.find(offset), size);
+
+    return true;
+}
+
+void FreeList::release(unsigned int offset, unsigned int size)
+{
+    BlockMap::iterator next = m_blocks.lower_bound(offset);
+
+    if ((next != m_blocks.end()) && (next->first == (offset + size))) {
+        size += next->second;
+        erase(next);
+    }
+
+    BlockMap::iterator prev = m_blocks.lower_bound(offset);
+
+    if (prev != m_blocks.begin()) {
+        --prev;
+
+        if ((prev->first + prev->second) == offset) {
+            offset = prev->first;
+            size += prev->second;
+            erase(prev);
+        }
+    }
+
+    insert(offset, size);
+}
+
+unsigned int BuddyPolicy::order(unsigned int size)
+{
+    unsigned int o = MIN_BUDDY_ORDER;
+
+    while ((o < 32) && ((1ull << o) < size))
+        o++;
+
+    return o;
+}
+
+void BuddyPolicy::reset(unsigned int poolSize)
+{
+    unsigned long long offset = 0;
+
+    for (int o = 0; o < 32; o++)
+        m_free[o].clear();
+
+    // Largest aligned blocks first, the tail below the smallest is lost
+    while (true) {
+        unsigned long long remaining = poolSize - offset;
+        int o = 31;
+
+        while ((o >= MIN_BUDDY_ORDER) && (((1ull << o) > remaining) || (offset & ((1ull << o) - 1))))
+            o--;
+
+        if (o < MIN_BUDDY_ORDER)
+            break;
+
+        m_free[o].insert((unsigned int)offset);
+        offset += 1ull << o;
+    }
+}
+
+unsigned int BuddyPolicy::reservedSize(unsigned int size) const
+{
+    unsigned int o = order(size);
+
+    return (o < 32) ? (1u << o) : size;
+}
+
+bool BuddyPolicy::allocate(unsigned int size, unsigned int& offset)
+{
+    unsigned int o = order(size);
+    unsigned int k = o;
+
+    while ((k < 32) && m_free[k].empty())
+        k++;
+
+    if (k >= 32)
+        return false;
+
+    offset = *m_free[k].begin();
+    m_free[k].erase(m_free[k].begin());
+
+    // Hand the upper halves back on the way down
+    while (k > o) {
+        k--;
+        m_free[k].insert(offset + (1u << k));
+    }
+
+    return true;
+}
+
+void BuddyPolicy::release(unsigned int offset, unsigned int size)
+{
+    unsigned int o = order(size);
+
+    while (o < 31) {
+        std::set<unsigned int>::iterator buddy = m_free[o].find(offset ^ (1u << o));
+
+        if (buddy == m_free[o].end())
+            break;
+
+        m_free[o].erase(buddy);
+        offset &= ~(1u << o);
+        o++;
+    }
+
+    m_free[o].insert(offset);
+}
+
+int SegregatedPolicy::sizeClass(unsigned int size)
+{
+    int c = SEGREGATED_MIN_ORDER;
+
+    if (size > (1u << SEGREGATED_MAX_ORDER))
+        return -1;
+
+    while ((1u << c) < size)
+        c++;
+
+    return c;
+}
+
+void SegregatedPolicy::reset(unsigned int poolSize)
+{
+    m_heap.reset(0, poolSize);
+    m_slabs.clear();
+
+    for (int c = 0; c < 32; c++)
+        m_partialSlabs[c].clear();
+}
+
+unsigned int SegregatedPolicy::reservedSize(unsigned int size) const
+{
+    int c = sizeClass(size);
+
+    return (c < 0) ? size : (1u << c);
+}
+
+bool SegregatedPolicy::allocate(unsigned int size, unsigned int& offset)
+{
+    int c = sizeClass(size);
+
+    if (c < 0)
+        return m_heap.bestFit(size, offset);
+
+    if (m_partialSlabs[c].empty()) {
+        unsigned int slabOffset;
+
+        if (!m_heap.bestFit(SEGREGATED_SLAB_SIZE, slabOffset))
+            return false;
+
+        Slab& slab = m_slabs[slabOffset];
+
+        slab.sizeClass = c;
+        slab.used = 0;
+
+        // Lowest slots are handed out first
+        for (unsigned int slot = SEGREGATED_SLAB_SIZE >> c; slot > 0; slot--)
+            slab.freeSlots.push_back(slot - 1);
+
+        m_partialSlabs[c].insert(slabOffset);
+    }
+
+    unsigned int slabOffset = *m_partialSlabs[c].begin();
+    Slab& slab = m_slabs[slabOffset];
+
+    offset = slabOffset + (slab.freeSlots.back() << c);
+
+    slab.freeSlots.pop_back();
+    slab.used++;
+
+    if (slab.freeSlots.empty())
+        m_partialSlabs[c].erase(slabOffset);
+
+    return true;
+}
+
+void SegregatedPolicy::release(unsigned int offset, unsigned int size)
+{
+    int c = sizeClass(size);
+
+    if (c < 0) {
+        m_heap.release(offset, size);
+        return;
+    }
+
+    std::map<unsigned int, Slab>::iterator it = m_slabs.upper_bound(offset);
+
+    if (it == m_slabs.begin())
+        return;
+
+    --it;
+
+    Slab& slab = it->second;
+
+    if ((offset - it->first) >= SEGREGATED_SLAB_SIZE || (slab.sizeClass != (unsigned int)c))
+        return;
+
+    slab.freeSlots.push_back((offset - it->first) >> c);
+    slab.used--;
+
+    // Empty slabs go back to the heap, for any class or size to use
+    if (!slab.used) {
+        m_partialSlabs[c].erase(it->first);
+        m_heap.release(it->first, SEGREGATED_SLAB_SIZE);
+        m_slabs.erase(it);
+    } else
+        m_partialSlabs[c].insert(it->first);
+}
+
+AllocatorSimulator::AllocatorSimulator(PoolState* recorded)
+{
+    m_recorded = recorded;
+
+    m_allocations = 0;
+    m_position = 0;
+
+    SimulationLane *lane = new SimulationLane();
+
+    lane->policy = 0;
+    lane->state = recorded;
+
+    resetLane(lane);
+    updateLane(lane);
+
+    m_lanes.push_back(lane);
+
+    m_recorded->addObserver(this);
+}
+
+AllocatorSimulator::~AllocatorSimulator()
+{
+    m_recorded->removeObserver(this);
+
+    for (unsigned int i = 0; i < m_lanes.size(); i++) {
+        if (m_lanes[i]->policy) {
+            delete m_lanes[i]->policy;
+            delete m_lanes[i]->state;
+        }
+
+        delete m_lanes[i];
+    }
+}
+
+void AllocatorSimulator::addPolicy(AllocatorPolicy* policy)
+{
+    DFBTracingBufferData info;
+
+    memset(&info, 0, sizeof(info));
+
+    info.poolId = m_recorded->poolId();
+    info.poolSize = m_recorded->poolSize();
+    strncpy(info.name, policy->name(), sizeof(info.name) - 1);
+
+    SimulationLane *lane = new SimulationLane();
+
+    lane->policy = policy;
+    lane->state = new PoolState(&info);
+
+    policy->reset(info.poolSize);
+
+    resetLane(lane);
+
+    // Catch up with what is already live in the pool
+    for (unsigned int i = 0; i < m_recorded->count(); i++)
+        place(lane, m_recorded->at(i));
+
+    updateLane(lane);
+
+    m_lanes.push_back(lane);
+}
+
+const char* AllocatorSimulator::laneName(unsigned int i) const
+{
+    return m_lanes[i]->policy ? m_lanes[i]->policy->name() : "recorded";
+}
+
+void AllocatorSimulator::resetLane(SimulationLane* lane)
+{
+    lane->placements.clear();
+
+    lane->footprint = lane->peakFootprint = 0;
+    lane->peakFragmentation = 0;
+    lane->lowestLargestFree = lane->state->largestFreeBlock();
+    lane->wasted = lane->peakWasted = 0;
+
+    lane->failures = lane->failedBytes = 0;
+    lane->firstFailure = 0;
+    lane->firstFailurePosition = 0;
+    lane->firstFailureSize = 0;
+}
+
+void AllocatorSimulator::updateLane(SimulationLane* lane)
+{
+    PoolState *state = lane->state;
+
+    if (state->count()) {
+        const PoolAllocation& last = state->at(state->count() - 1);
+
+        lane->footprint = last.offset + last.size;
+    } else
+        lane->footprint = 0;
+
+    if (lane->footprint > lane->peakFootprint)
+        lane->peakFootprint = lane->footprint;
+
+    if (state->fragmentation() > lane->peakFragmentation)
+        lane->peakFragmentation = state->fragmentation();
+
+    if (state->largestFreeBlock() < lane->lowestLargestFree)
+        lane->lowestLargestFree = state->largestFreeBlock();
+
+    if (lane->wasted > lane->peakWasted)
+        lane->peakWasted = lane->wasted;
+}
+
+void AllocatorSimulator::place(SimulationLane* lane, const PoolAllocation& allocation)
+{
+    // Zero sized allocations still need an offset of their own
+    unsigned int size = allocation.size ? allocation.size : 1;
+    unsigned int offset;
+
+    if (!lane->policy->allocate(size, offset)) {
+        lane->failures++;
+        lane->failedBytes += size;
+
+        if (!lane->firstFailure) {
+            lane->firstFailure = m_allocations;
+            lane->firstFailurePosition = m_position;
+            lane->firstFailureSize = size;
+        }
+
+        return;
+    }
+
+    unsigned int reserved = lane->policy->reservedSize(size);
+    DFBTracingBufferData data;
+
+    memset(&data, 0, sizeof(data));
+
+    data.poolId = m_recorded->poolId();
+    data.poolSize = m_recorded->poolSize();
+    data.offset = offset;
+    data.size = reserved;
+    data.width = allocation.width;
+    data.height = allocation.height;
+    data.format = allocation.format;
+
+    lane->state->allocate(&data);
+    lane->placements[allocation.offset] = offset;
+    lane->wasted += reserved - size;
+}
+
+void AllocatorSimulator::remove(SimulationLane* lane, const PoolAllocation& allocation)
+{
+    std::map<unsigned int, unsigned int>::iterator it = lane->placements.find(allocation.offset);
+
+    // It failed to fit in the first place
+    if (it == lane->placements.end())
+        return;
+
+    unsigned int size = allocation.size ? allocation.size : 1;
+
+    lane->policy->release(it->second, size);
+    lane->state->release(it->second);
+    lane->wasted -= lane->policy->reservedSize(size) - size;
+
+    lane->placements.erase(it);
+}
+
+void AllocatorSimulator::allocationAdded(const PoolAllocation& allocation)
+{
+    m_allocations++;
+
+    for (unsigned int i = 0; i < m_lanes.size(); i++) {
+        if (m_lanes[i]->policy)
+            place(m_lanes[i], allocation);
+
+        updateLane(m_lanes[i]);
+    }
+}
+
+void AllocatorSimulator::allocationRemoved(const PoolAllocation& allocation)
+{
+    for (unsigned int i = 0; i < m_lanes.size(); i++) {
+        if (m_lanes[i]->policy)
+            remove(m_lanes[i], allocation);
+
+        updateLane(m_lanes[i]);
+    }
+}
+
+void AllocatorSimulator::poolReset()
+{
+    // The peaks and failures so far still hold
+    for (unsigned int i = 0; i < m_lanes.size(); i++) {
+        SimulationLane *lane = m_lanes[i];
+
+        if (lane->policy) {
+            lane->policy->reset(m_recorded->poolSize());
+            lane->state->reset();
+            lane->placements.clear();
+            lane->wasted = 0;
+        }
+
+        updateLane(lane);
+    }
+}
+
+void AllocatorSimulator::writeJson(FILE* out, int indent) const
+{
+    fprintf(out, "{\n");
+    fprintf(out, "%*s\"allocations\": %llu,\n", indent + 2, "", m_allocations);
+    fprintf(out, "%*s\"policies\": [", indent + 2, "");
+
+    for (unsigned int i = 0; i < m_lanes.size(); i++) {
+        const SimulationLane *lane = m_lanes[i];
+
+        fprintf(out, "%s\n%*s{\n", i ? "," : "", indent + 4, "");
+        fprintf(out, "%*s\"policy\": \"%s\",\n", indent + 6, "", laneName(i));
+        fprintf(out, "%*s\"peakFootprint\": %u,\n", indent + 6, "", lane->peakFootprint);
+        fprintf(out, "%*s\"peakUsage\": %u,\n", indent + 6, "", lane->state->peakUsage());
+        fprintf(out, "%*s\"peakWasted\": %u,\n", indent + 6, "", lane->peakWasted);
+        fprintf(out, "%*s\"lowestLargestFreeBlock\": %u,\n", indent + 6, "", lane->lowestLargestFree);
+        fprintf(out, "%*s\"fragmentation\": %.2f,\n", indent + 6, "", lane->state->fragmentation());
+        fprintf(out, "%*s\"peakFragmentation\": %.2f,\n", indent + 6, "", lane->peakFragmentation);
+        fprintf(out, "%*s\"failures\": %llu,\n", indent + 6, "", lane->failures);
+        fprintf(out, "%*s\"failedBytes\": %llu,\n", indent + 6, "", lane->failedBytes);
+
+        if (lane->firstFailure) {
+            fprintf(out, "%*s\"firstFailure\": {\n", indent + 6, "");
+            fprintf(out, "%*s\"allocation\": %llu,\n", indent + 8, "", lane->firstFailure);
+            fprintf(out, "%*s\"position\": %.3f,\n", indent + 8, "", lane->firstFailurePosition);
+            fprintf(out, "%*s\"size\": %u\n", indent + 8, "", lane->firstFailureSize);
+            fprintf(out, "%*s}\n", indent + 6, "");
+        } else
+            fprintf(out, "%*s\"firstFailure\": null\n", indent + 6, "");
+
+        fprintf(out, "%*s}", indent + 4, "");
+    }
+
+    fprintf(out, "\n%*s]\n%*s}", indent + 2, "", indent, "");
+}
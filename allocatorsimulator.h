@@ -0,0 +1,211 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef ALLOCATORSIMULATOR_H
+#define ALLOCATORSIMULATOR_H
+
+#include <stdio.h>
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "poolstate.h"
+
+// Places allocations in a pool of its own, ignoring the offsets the traced
+// allocator picked. Release gets the size that was asked for at allocation.
+class AllocatorPolicy
+{
+public:
+    virtual ~AllocatorPolicy() {}
+
+    virtual const char* name() const = 0;
+
+    virtual void reset(unsigned int poolSize) = 0;
+
+    // Bytes taken out of the pool for an allocation of size, with rounding
+    virtual unsigned int reservedSize(unsigned int size) const { return size; }
+
+    virtual bool allocate(unsigned int size, unsigned int& offset) = 0;
+    virtual void release(unsigned int offset, unsigned int size) = 0;
+
+    // first-fit, best-fit, buddy or segregated, 0 for an unknown name
+    static AllocatorPolicy* create(const char* name);
+    static const char* const* names();
+};
+
+// Free blocks sorted by offset and by size, coalesced on release
+class FreeList
+{
+public:
+    void reset(unsigned int offset, unsigned int size);
+
+    bool firstFit(unsigned int size, unsigned int& offset);
+    bool bestFit(unsigned int size, unsigned int& offset);
+    void release(unsigned int offset, unsigned int size);
+
+private:
+    typedef std::map<unsigned int, unsigned int> BlockMap;
+
+    void take(BlockMap::iterator it, unsigned int size);
+    void insert(unsigned int offset, unsigned int size);
+    void erase(BlockMap::iterator it);
+
+    BlockMap m_blocks; // offset -> size
+    std::set<std::pair<unsigned int, unsigned int> > m_bySize; // (size, offset)
+};
+
+class FirstFitPolicy : public AllocatorPolicy
+{
+public:
+    const char* name() const { return "first-fit"; }
+
+    void reset(unsigned int poolSize) { m_free.reset(0, poolSize); }
+
+    bool allocate(unsigned int size, unsigned int& offset) { return m_free.firstFit(size, offset); }
+    void release(unsigned int offset, unsigned int size) { m_free.release(offset, size); }
+
+private:
+    FreeList m_free;
+};
+
+class BestFitPolicy : public AllocatorPolicy
+{
+public:
+    const char* name() const { return "best-fit"; }
+
+    void reset(unsigned int poolSize) { m_free.reset(0, poolSize); }
+
+    bool allocate(unsigned int size, unsigned int& offset) { return m_free.bestFit(size, offset); }
+    void release(unsigned int offset, unsigned int size) { m_free.release(offset, size); }
+
+private:
+    FreeList m_free;
+};
+
+// Binary buddy allocator, the pool is cut in the largest aligned power of
+// two blocks it holds when its size isn't a power of two
+class BuddyPolicy : public AllocatorPolicy
+{
+public:
+    const char* name() const { return "buddy"; }
+
+    void reset(unsigned int poolSize);
+
+    unsigned int reservedSize(unsigned int size) const;
+
+    bool allocate(unsigned int size, unsigned int& offset);
+    void release(unsigned int offset, unsigned int size);
+
+private:
+    static unsigned int order(unsigned int size);
+
+    std::set<unsigned int> m_free[32];
+};
+
+// Small allocations share slabs of power of two slots, one size class per
+// slab, larger ones and the slabs themselves come from a best-fit heap
+class SegregatedPolicy : public AllocatorPolicy
+{
+public:
+    const char* name() const { return "segregated"; }
+
+    void reset(unsigned int poolSize);
+
+    unsigned int reservedSize(unsigned int size) const;
+
+    bool allocate(unsigned int size, unsigned int& offset);
+    void release(unsigned int offset, unsigned int size);
+
+private:
+    struct Slab {
+        unsigned int sizeClass;
+        unsigned int used;
+        std::vector<unsigned int> freeSlots;
+    };
+
+    static int sizeClass(unsigned int size);
+
+    FreeList m_heap;
+
+    std::map<unsigned int, Slab> m_slabs; // by offset
+    std::set<unsigned int> m_partialSlabs[32]; // slabs with free slots, per class
+};
+
+struct SimulationLane {
+    AllocatorPolicy *policy; // 0 for the recorded offsets
+    PoolState *state;
+
+    std::map<unsigned int, unsigned int> placements; // recorded -> simulated offset
+
+    unsigned int footprint; // end of the highest live allocation
+    unsigned int peakFootprint;
+    float peakFragmentation;
+    unsigned int lowestLargestFree;
+    unsigned int wasted; // lost to the rounding of the policy
+    unsigned int peakWasted;
+
+    unsigned long long failures;
+    unsigned long long failedBytes;
+    unsigned long long firstFailure; // allocation number, 0 when none failed
+    double firstFailurePosition;
+    unsigned int firstFailureSize;
+};
+
+// Replays the allocations and releases of a pool through allocator policies
+// as they happen, to compare footprint, fragmentation and failures against
+// the recorded offsets. Lane 0 is the recorded pool itself.
+class AllocatorSimulator : public PoolStateObserver
+{
+public:
+    explicit AllocatorSimulator(PoolState* recorded);
+    ~AllocatorSimulator();
+
+    // Takes ownership of the policy
+    void addPolicy(AllocatorPolicy* policy);
+
+    // Timeline position credited to the failures from now on
+    void setPosition(double position) { m_position = position; }
+
+    unsigned int laneCount() const { return m_lanes.size(); }
+    const SimulationLane& lane(unsigned int i) const { return *m_lanes[i]; }
+    const char* laneName(unsigned int i) const;
+
+    unsigned long long allocations() const { return m_allocations; }
+
+    void allocationAdded(const PoolAllocation& allocation);
+    void allocationRemoved(const PoolAllocation& allocation);
+    void poolReset();
+
+    void writeJson(FILE* out, int indent) const;
+
+private:
+    void resetLane(SimulationLane* lane);
+    void updateLane(SimulationLane* lane);
+
+    void place(SimulationLane* lane, const PoolAllocation& allocation);
+    void remove(SimulationLane* lane, const PoolAllocation& allocation);
+
+    PoolState *m_recorded;
+
+    std::vector<SimulationLane *> m_lanes;
+
+    unsigned long long m_allocations;
+    double m_position;
+};
+
+#endif // ALLOCATORSIMULATOR_H
@@ -0,0 +1,33 @@
+#-------------------------------------------------
+#
+# Headless trace analyzer, shares the packet decoding
+# with the viewer but doesn't link against Qt.
+#
+#-------------------------------------------------
+
+CONFIG   += console
+CONFIG   -= qt app_bundle
+
+TARGET = dfbperf-analyze
+TEMPLATE = app
+
+SOURCES += main.cpp \
+    ../packetdecoder.cpp \
+    ../poolstate.cpp \
+    ../allocatorsimulator.cpp \
+    ../pipelinestats.cpp \
+    ../tracefile.cpp \
+    ../tracetimestamps.cpp
+
+HEADERS += \
+    ../packetdecoder.h \
+    ../poolstate.h \
+    ../allocatorsimulator.h \
+    ../pipelinestats.h \
+    ../tracefile.h \
+    ../tracetimestamps.h
+
+INCLUDEPATH += ..
+INCLUDEPATH += /home/ilyes/DirectFB-git/src
+INCLUDEPATH += /home/ilyes/DirectFB-git/include
+INCLUDEPATH += /home/ilyes/DirectFB-git/lib
@@ -0,0 +1,471 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// dfbperf-analyze: replays recorded traces through the packet decoder as
+// fast as they can be read and prints per pool statistics as JSON. There
+// is no GUI, no scene and no pacing, so it can run on build servers.
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "tracefile.h"
+#include "tracetimestamps.h"
+#include "packetdecoder.h"
+#include "allocatorsimulator.h"
+
+// Times come from the ".ts" files recorded along the traces, without them
+// rates are per accepted packet
+class PoolStatistics : public PoolStateObserver
+{
+public:
+    PoolStatistics(PoolState* state)
+    {
+        m_state = state;
+
+        allocations = releases = resets = 0;
+        peakUsage = 0;
+        peakPacket = 0;
+        peakTime = 0;
+        usageSum = 0;
+        samples = 0;
+        currentPacket = 0;
+        currentTime = createdTime = 0;
+
+        lowestLargestFree = state->largestFreeBlock();
+        peakFragmentation = 0;
+
+        simulator = 0;
+    }
+
+    ~PoolStatistics()
+    {
+        delete simulator;
+    }
+
+    void allocationAdded(const PoolAllocation& allocation)
+    {
+        (void)allocation;
+
+        allocations++;
+
+        if (m_state->allocated() > peakUsage) {
+            peakUsage = m_state->allocated();
+            peakPacket = currentPacket;
+            peakTime = currentTime;
+        }
+    }
+
+    void allocationRemoved(const PoolAllocation& allocation)
+    {
+        (void)allocation;
+
+        releases++;
+    }
+
+    void poolReset()
+    {
+        resets++;
+    }
+
+    void sample(unsigned long long packet, double time)
+    {
+        currentPacket = packet;
+        currentTime = time;
+
+        usageSum += m_state->allocated();
+        samples++;
+
+        if (m_state->largestFreeBlock() < lowestLargestFree)
+            lowestLargestFree = m_state->largestFreeBlock();
+
+        if (m_state->fragmentation() > peakFragmentation)
+            peakFragmentation = m_state->fragmentation();
+
+        if (simulator)
+            simulator->setPosition(packet);
+    }
+
+    PoolState* state() const { return m_state; }
+
+    unsigned long long allocations, releases, resets;
+    unsigned int peakUsage;
+    unsigned long long peakPacket;
+    double peakTime; // in s
+    unsigned long long usageSum, samples;
+    unsigned long long currentPacket;
+    double currentTime, createdTime; // in s
+    unsigned int lowestLargestFree;
+    float peakFragmentation;
+
+    // Set when the allocations are replayed through other allocators
+    AllocatorSimulator *simulator;
+
+private:
+    PoolState *m_state;
+};
+
+class TraceAnalyzer : public PoolStateTracker
+{
+public:
+    TraceAnalyzer()
+    {
+        packets = lostPacketCount = gaps = missingInfo = badPackets = 0;
+        staleMarks = resyncs = 0;
+        m_lastPacket = 0;
+
+        timed = false;
+        m_time = 0;
+    }
+
+    ~TraceAnalyzer()
+    {
+        std::map<unsigned int, PoolStatistics *>::iterator it;
+
+        for (it = m_statistics.begin(); it != m_statistics.end(); ++it) {
+            it->second->state()->removeObserver(it->second);
+            delete it->second;
+        }
+    }
+
+    void packetAccepted(const char* buf, int size)
+    {
+        (void)buf;
+        (void)size;
+
+        std::map<unsigned int, PoolStatistics *>::iterator it;
+
+        packets++;
+
+        // Sampled before the packet is applied, the packet index is the one
+        // its events are credited to
+        for (it = m_statistics.begin(); it != m_statistics.end(); ++it)
+            it->second->sample(packets, m_time);
+
+        m_lastPacket = packets;
+    }
+
+    // Arrival time of the packet about to be decoded, in s since the first
+    void setTime(double time) { m_time = time; }
+
+    void lostPackets(unsigned int lastValidNseq, unsigned int expectedNseq)
+    {
+        gaps++;
+
+        // lastValidNseq is the sequence number that was actually received
+        if (lastValidNseq > expectedNseq)
+            lostPacketCount += lastValidNseq - expectedNseq;
+    }
+
+    void badPacket(unsigned int nseq)
+    {
+        (void)nseq;
+        badPackets++;
+    }
+
+    void missingInformation(unsigned int nseq)
+    {
+        (void)nseq;
+        missingInfo++;
+    }
+
+    void poolStale(unsigned int poolId, bool stale)
+    {
+        (void)poolId;
+
+        if (stale)
+            staleMarks++;
+        else
+            resyncs++;
+    }
+
+    // Compare each pool against these allocators, see AllocatorPolicy::create()
+    void simulate(const std::vector<std::string>& policies) { m_policies = policies; }
+
+    void print(FILE* out) const;
+
+    unsigned long long packets, lostPacketCount, gaps, missingInfo, badPackets;
+    unsigned long long staleMarks, resyncs;
+
+    // All traces came with their timestamps
+    bool timed;
+
+protected:
+    void poolCreated(PoolState* state)
+    {
+        PoolStatistics *statistics = new PoolStatistics(state);
+
+        // The pool is created by the packet currently being decoded
+        statistics->currentPacket = m_lastPacket;
+        statistics->currentTime = statistics->createdTime = m_time;
+
+        if (!m_policies.empty()) {
+            statistics->simulator = new AllocatorSimulator(state);
+            statistics->simulator->setPosition(m_lastPacket);
+
+            for (unsigned int i = 0; i < m_policies.size(); i++)
+                statistics->simulator->addPolicy(AllocatorPolicy::create(m_policies[i].c_str()));
+        }
+
+        state->addObserver(statistics);
+        m_statistics.insert(std::make_pair(state->poolId(), statistics));
+    }
+
+private:
+    std::map<unsigned int, PoolStatistics *> m_statistics;
+    unsigned long long m_lastPacket;
+    double m_time;
+
+    std::vector<std::string> m_policies;
+};
+
+static void printString(FILE* out, const char* str)
+{
+    fputc('"', out);
+
+    for (; *str; str++) {
+        if ((*str == '"') || (*str == '\\'))
+            fprintf(out, "\\%c", *str);
+        else if ((unsigned char)*str < 0x20)
+            fprintf(out, "\\u%04x", (unsigned char)*str);
+        else
+            fputc(*str, out);
+    }
+
+    fputc('"', out);
+}
+
+void TraceAnalyzer::print(FILE* out) const
+{
+    std::map<unsigned int, PoolStatistics *>::const_iterator it;
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"packets\": %llu,\n", packets);
+
+    if (timed)
+        fprintf(out, "  \"durationSeconds\": %.6f,\n", m_time);
+
+    fprintf(out, "  \"loss\": {\n");
+    fprintf(out, "    \"lostPackets\": %llu,\n", lostPacketCount);
+    fprintf(out, "    \"gaps\": %llu,\n", gaps);
+    fprintf(out, "    \"missingInformation\": %llu,\n", missingInfo);
+    fprintf(out, "    \"badPackets\": %llu,\n", badPackets);
+    fprintf(out, "    \"staleMarks\": %llu,\n", staleMarks);
+    fprintf(out, "    \"resynchronizations\": %llu\n", resyncs);
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"pools\": [");
+
+    for (it = m_statistics.begin(); it != m_statistics.end(); ++it) {
+        const PoolStatistics *statistics = it->second;
+        const PoolState *state = statistics->state();
+
+        unsigned int lowest = (state->lowestUsage() == 0xffffffff) ? 0 : state->lowestUsage();
+        double average = statistics->samples ? (statistics->usageSum / (double)statistics->samples) : 0.0;
+        double span = statistics->samples ? (double)statistics->samples : 1.0;
+        double duration = m_time - statistics->createdTime;
+
+        fprintf(out, "%s\n    {\n", (it == m_statistics.begin()) ? "" : ",");
+        fprintf(out, "      \"poolId\": %u,\n", state->poolId());
+        fprintf(out, "      \"name\": ");
+        printString(out, state->name());
+        fprintf(out, ",\n");
+        fprintf(out, "      \"poolSize\": %u,\n", state->poolSize());
+        fprintf(out, "      \"peakUsage\": %u,\n", statistics->peakUsage);
+        fprintf(out, "      \"lowestUsage\": %u,\n", lowest);
+        fprintf(out, "      \"averageUsage\": %.1f,\n", average);
+        fprintf(out, "      \"finalUsage\": %u,\n", state->allocated());
+        fprintf(out, "      \"timeToPeakPackets\": %llu,\n", statistics->peakPacket);
+
+        if (timed)
+            fprintf(out, "      \"timeToPeakSeconds\": %.6f,\n", statistics->peakTime);
+
+        fprintf(out, "      \"freeBlocks\": %u,\n", state->freeBlockCount());
+        fprintf(out, "      \"largestFreeBlock\": %u,\n", state->largestFreeBlock());
+        fprintf(out, "      \"lowestLargestFreeBlock\": %u,\n", statistics->lowestLargestFree);
+        fprintf(out, "      \"fragmentation\": %.2f,\n", state->fragmentation());
+        fprintf(out, "      \"peakFragmentation\": %.2f,\n", statistics->peakFragmentation);
+        fprintf(out, "      \"allocations\": %llu,\n", statistics->allocations);
+        fprintf(out, "      \"releases\": %llu,\n", statistics->releases);
+        fprintf(out, "      \"resets\": %llu,\n", statistics->resets);
+
+        if (timed) {
+            fprintf(out, "      \"allocationsPerSecond\": %.3f,\n", (duration > 0) ? (statistics->allocations / duration) : 0.0);
+            fprintf(out, "      \"releasesPerSecond\": %.3f%s\n", (duration > 0) ? (statistics->releases / duration) : 0.0,
+                    statistics->simulator ? "," : "");
+        } else {
+            fprintf(out, "      \"allocationsPerKPacket\": %.3f,\n", statistics->allocations * 1000.0 / span);
+            fprintf(out, "      \"releasesPerKPacket\": %.3f%s\n", statistics->releases * 1000.0 / span,
+                    statistics->simulator ? "," : "");
+        }
+
+        if (statistics->simulator) {
+            fprintf(out, "      \"simulation\": ");
+            statistics->simulator->writeJson(out, 6);
+            fprintf(out, "\n");
+        }
+        fprintf(out, "    }");
+    }
+
+    fprintf(out, "%s]\n}\n", m_statistics.empty() ? "" : "\n  ");
+}
+
+static bool parsePolicies(const char* list, std::vector<std::string>& policies)
+{
+    std::string names(list);
+    size_t start = 0;
+
+    while (start <= names.size()) {
+        size_t end = names.find(',', start);
+        std::string name = names.substr(start, (end == std::string::npos) ? std::string::npos : (end - start));
+
+        if (name == "all") {
+            for (const char* const* p = AllocatorPolicy::names(); *p; p++)
+                policies.push_back(*p);
+        } else {
+            AllocatorPolicy *policy = AllocatorPolicy::create(name.c_str());
+
+            if (!policy)
+                return false;
+
+            delete policy;
+            policies.push_back(name);
+        }
+
+        if (end == std::string::npos)
+            break;
+
+        start = end + 1;
+    }
+
+    return true;
+}
+
+static void usage(const char* program)
+{
+    fprintf(stderr, "usage: %s [-o output.json] [-s policy[,policy...]] trace [trace...]\n", program);
+    fprintf(stderr, "Traces are decoded in sequence, as consecutive rotation segments. Rates are\n");
+    fprintf(stderr, "per second when every trace has its .ts timestamps, per packet otherwise.\n");
+    fprintf(stderr, "  -s  replay the allocations through other allocators and compare them with the\n");
+    fprintf(stderr, "      recorded offsets: first-fit, best-fit, buddy, segregated or all\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char* outputName = NULL;
+    std::vector<std::string> policies;
+    int c;
+
+    while ((c = getopt(argc, argv, "o:s:h")) != -1) {
+        switch (c) {
+        case 'o':
+            outputName = optarg;
+            break;
+        case 's':
+            if (!parsePolicies(optarg, policies)) {
+                fprintf(stderr, "%s: unknown allocator policy in %s\n", argv[0], optarg);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return (c == 'h') ? 0 : 1;
+        }
+    }
+
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    TraceAnalyzer analyzer;
+    PacketDecoder decoder(&analyzer);
+
+    analyzer.simulate(policies);
+
+    // Time is only meaningful if it covers every packet of every segment
+    analyzer.timed = true;
+
+    for (int i = optind; (i < argc) && analyzer.timed; i++) {
+        TraceFile trace;
+        TraceTimestamps timestamps;
+
+        if (trace.open(argv[i]) && (!timestamps.load(argv[i]) || (timestamps.count() < trace.packetCount())))
+            analyzer.timed = false;
+    }
+
+    unsigned long long origin = 0;
+    double last = 0;
+
+    for (int i = optind; i < argc; i++) {
+        TraceFile trace;
+        TraceTimestamps timestamps;
+
+        if (!trace.open(argv[i])) {
+            fprintf(stderr, "%s: can't open %s\n", argv[0], argv[i]);
+            return 1;
+        }
+
+        if (analyzer.timed) {
+            timestamps.load(argv[i]);
+
+            if (i == optind)
+                origin = timestamps.origin();
+        }
+
+        unsigned int count = trace.packetCount();
+
+        for (unsigned int p = 0; p < count; p++) {
+            if (analyzer.timed) {
+                unsigned long long at = timestamps.origin() + timestamps.at(p);
+                double time = (at > origin) ? ((at - origin) / 1e9) : 0;
+
+                // Merged senders may step back a little
+                if (time > last)
+                    last = time;
+
+                analyzer.setTime(last);
+            }
+
+            decoder.receivePacket(trace.packet(p), sizeof(DFBTracingPacket));
+        }
+
+        // Unmap as soon as possible, segments can be large
+        timestamps.clear();
+        trace.close();
+    }
+
+    FILE* out = stdout;
+
+    if (outputName) {
+        out = fopen(outputName, "w");
+
+        if (!out) {
+            fprintf(stderr, "%s: can't write %s\n", argv[0], outputName);
+            return 1;
+        }
+    }
+
+    analyzer.print(out);
+
+    if (out != stdout)
+        fclose(out);
+
+    return 0;
+}
@@ -0,0 +1,37 @@
+#-------------------------------------------------
+#
+# Benchmarks of the decode, pool model and render hot
+# paths, results are written as JSON.
+#
+#-------------------------------------------------
+
+QT       += core gui
+
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TARGET = dfbperf-benchmark
+TEMPLATE = app
+
+SOURCES += main.cpp \
+    ../packetdecoder.cpp \
+    ../pipelinestats.cpp \
+    ../poolstate.cpp \
+    ../scenecontroller.cpp \
+    ../allocationscenecontroller.cpp \
+    ../allocationrenderitem.cpp
+
+HEADERS += \
+    ../packetdecoder.h \
+    ../pipelinestats.h \
+    ../poolstate.h \
+    ../scenecontroller.h \
+    ../allocationscenecontroller.h \
+    ../allocationrenderitem.h
+
+LIBS += -lrt
+
+INCLUDEPATH += ..
+INCLUDEPATH += /home/ilyes/DirectFB-git/src
+INCLUDEPATH += /home/ilyes/DirectFB-git/include
+INCLUDEPATH += /home/ilyes/DirectFB-git/lib
@@ -0,0 +1,573 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// dfbperf-benchmark: times the decode, pool model and render hot paths
+// and writes the results as JSON, so that releases can be compared. No
+// window is ever shown, items are painted into an offscreen QImage.
+
+#include <QApplication>
+#include <QImage>
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "packetdecoder.h"
+#include "pipelinestats.h"
+#include "poolstate.h"
+#include "allocationscenecontroller.h"
+#include "allocationrenderitem.h"
+
+#define DEFAULT_REPETITIONS 7
+
+#define PACKET_COUNT 16384
+#define REORDER_WINDOW 64
+
+#define POOL_SIZE (1U << 30)
+#define SLOT_SIZE (8U << 10) // 100k live allocations fit in the pool
+#define ALLOCATION_SIZE (4U << 10)
+
+#define CHURN_BATCH 1000
+#define LOOKUP_COUNT 100000
+
+#define SCENE_WIDTH 1024
+#define SCENE_HEIGHT 768
+
+#define PAINTED_ITEMS 1000
+#define RENDER_STRIDE ((POOL_SIZE / PAINTED_ITEMS) & ~4095U)
+
+class Benchmark
+{
+public:
+    explicit Benchmark(const std::string& name) : m_name(name) {}
+    virtual ~Benchmark() {}
+
+    const std::string& name() const { return m_name; }
+
+    // Untimed, once before the first repetition
+    virtual void prepare() {}
+
+    // Untimed, before and after each repetition
+    virtual void setUp() {}
+    virtual void tearDown() {}
+
+    // Timed, returns the number of operations done
+    virtual unsigned long long run() = 0;
+
+private:
+    std::string m_name;
+};
+
+struct BenchmarkResult {
+    std::string name;
+    unsigned long long operations; // per repetition
+    double bestNs; // per operation
+    double medianNs;
+};
+
+static void fillBuffer(DFBTracingBufferData* data, unsigned int offset)
+{
+    memset(data, 0, sizeof(*data));
+
+    data->poolId = 1;
+    data->poolSize = POOL_SIZE;
+    data->offset = offset;
+    data->size = ALLOCATION_SIZE;
+    data->width = 32;
+    data->height = 32;
+    data->format = DSPF_ARGB;
+
+    strcpy(data->name, "benchmark");
+}
+
+static std::string sceneBenchmarkName(const char* operation, unsigned int liveCount)
+{
+    char buf[64];
+
+    sprintf(buf, "scene/%s/%u", operation, liveCount);
+
+    return buf;
+}
+
+// Only counts, so that the decoder itself is measured
+class CountingListener : public PacketListener
+{
+public:
+    CountingListener() : events(0) {}
+
+    void missingInformation(unsigned int nseq) { (void)nseq; events++; }
+
+    void poolReset(const DFBTracingBufferData* data) { (void)data; events++; }
+    void bufferAllocation(const DFBTracingBufferData* data) { (void)data; events++; }
+    void bufferRelease(const DFBTracingBufferData* data) { (void)data; events++; }
+
+    unsigned long long events;
+};
+
+// Allocation and release packets through PacketDecoder::receivePacket()
+class DecodeBenchmark : public Benchmark
+{
+public:
+    DecodeBenchmark(const std::string& name, unsigned int reorderWindow, bool truncated) : Benchmark(name),
+                                                                                         m_decoder(&m_listener),
+                                                                                         m_reorderWindow(reorderWindow),
+                                                                                         m_truncated(truncated)
+    {
+    }
+
+    void prepare()
+    {
+        m_packets.resize(PACKET_COUNT);
+
+        for (unsigned int i = 0; i < PACKET_COUNT; i++) {
+            DFBTracingPacket& packet = m_packets[i];
+
+            memset(&packet, 0, sizeof(packet));
+
+            packet.header.type = (i & 1) ? DTE_POOL_BUFFER_RELEASE : DTE_POOL_BUFFER_ALLOCATION;
+            packet.header.nSeq = i;
+            packet.header.size = sizeof(packet.Payload);
+
+            fillBuffer(&packet.Payload.buffer, (i / 2) * SLOT_SIZE);
+        }
+
+        // Swap neighbours so that one packet in four is held, then released.
+        // The very first packet sets the sequence and has to come first.
+        if (m_reorderWindow) {
+            for (unsigned int i = 2; (i + 1) < PACKET_COUNT; i += 4)
+                std::swap(m_packets[i], m_packets[i + 1]);
+        }
+
+        m_decoder.setReorderWindow(m_reorderWindow, 1000);
+    }
+
+    void setUp()
+    {
+        m_decoder.reset();
+    }
+
+    unsigned long long run()
+    {
+        // A truncated packet is validated then rejected, never dispatched
+        int size = m_truncated ? (int)sizeof(DFBTracingPacketHeader) : (int)sizeof(DFBTracingPacket);
+
+        for (unsigned int i = 0; i < PACKET_COUNT; i++)
+            m_decoder.receivePacket(reinterpret_cast<const char*>(&m_packets[i]), size);
+
+        return PACKET_COUNT;
+    }
+
+private:
+    CountingListener m_listener;
+    PacketDecoder m_decoder;
+
+    std::vector<DFBTracingPacket> m_packets;
+
+    unsigned int m_reorderWindow;
+    bool m_truncated;
+};
+
+// Full pool snapshots, rebuilt into a PoolState by the tracker
+class SnapshotBenchmark : public Benchmark
+{
+public:
+    SnapshotBenchmark() : Benchmark("decode/snapshot"), m_decoder(&m_tracker)
+    {
+    }
+
+    void prepare()
+    {
+        DFBTracingPacket packet;
+        const unsigned int count = sizeof(packet.Payload.pool.stats) / sizeof(packet.Payload.pool.stats[0]);
+
+        m_packets.resize(PACKET_COUNT / 4);
+
+        for (unsigned int i = 0; i < m_packets.size(); i++) {
+            DFBTracingPacket& snapshot = m_packets[i];
+
+            memset(&snapshot, 0, sizeof(snapshot));
+
+            snapshot.header.type = DTE_POOL_FULL_SNAPSHOT;
+            snapshot.header.nSeq = i;
+            snapshot.header.size = offsetof(DFBTracingPoolData, stats) + count * sizeof(DFBTracingBufferData);
+
+            snapshot.Payload.pool.count = count;
+
+            for (unsigned int j = 0; j < count; j++)
+                fillBuffer(&snapshot.Payload.pool.stats[j], j * SLOT_SIZE);
+        }
+    }
+
+    void setUp()
+    {
+        m_decoder.reset();
+        m_tracker.clear();
+    }
+
+    unsigned long long run()
+    {
+        for (unsigned int i = 0; i < m_packets.size(); i++)
+            m_decoder.receivePacket(reinterpret_cast<const char*>(&m_packets[i]), sizeof(DFBTracingPacket));
+
+        return m_packets.size();
+    }
+
+private:
+    PoolStateTracker m_tracker;
+    PacketDecoder m_decoder;
+
+    std::vector<DFBTracingPacket> m_packets;
+};
+
+// A scene holding liveCount allocations, one every stride bytes of the pool
+class SceneBenchmark : public Benchmark
+{
+public:
+    SceneBenchmark(const std::string& name, unsigned int liveCount,
+                   unsigned int stride = SLOT_SIZE, unsigned int size = ALLOCATION_SIZE) : Benchmark(name)
+    {
+        m_liveCount = liveCount;
+        m_stride = stride;
+        m_size = size;
+
+        m_state = 0;
+        m_scene = 0;
+    }
+
+    ~SceneBenchmark()
+    {
+        // The scene deletes its items and stops observing the state
+        delete m_scene;
+        delete m_state;
+    }
+
+    void prepare()
+    {
+        DFBTracingBufferData info;
+
+        fillBuffer(&info, 0);
+
+        m_state = new PoolState(&info);
+        m_scene = new AllocationSceneController(0, m_state);
+
+        m_scene->setSceneRect(0, 0, SCENE_WIDTH, SCENE_HEIGHT);
+
+        for (unsigned int i = 0; i < m_liveCount; i++)
+            m_scene->allocationAdded(allocation(i));
+    }
+
+protected:
+    PoolAllocation allocation(unsigned int slot) const
+    {
+        PoolAllocation result;
+
+        result.offset = slot * m_stride;
+        result.size = m_size;
+        result.width = 32;
+        result.height = 32;
+        result.format = DSPF_ARGB;
+
+        return result;
+    }
+
+    // Churned slots, spread over the whole pool
+    unsigned int churnSlot(unsigned int i) const { return (i * (m_liveCount / CHURN_BATCH)) % m_liveCount; }
+
+    unsigned int m_liveCount;
+    unsigned int m_stride;
+    unsigned int m_size;
+
+    PoolState *m_state;
+    AllocationSceneController *m_scene;
+};
+
+// AllocationSceneController::allocationAdded(), items are taken out beforehand
+class SceneAddBenchmark : public SceneBenchmark
+{
+public:
+    SceneAddBenchmark(unsigned int liveCount) : SceneBenchmark(sceneBenchmarkName("add", liveCount), liveCount) {}
+
+    void setUp()
+    {
+        for (unsigned int i = 0; i < CHURN_BATCH; i++)
+            m_scene->allocationRemoved(allocation(churnSlot(i)));
+    }
+
+    unsigned long long run()
+    {
+        for (unsigned int i = 0; i < CHURN_BATCH; i++)
+            m_scene->allocationAdded(allocation(churnSlot(i)));
+
+        return CHURN_BATCH;
+    }
+};
+
+// AllocationSceneController::allocationRemoved(), items are put back afterwards
+class SceneRemoveBenchmark : public SceneBenchmark
+{
+public:
+    SceneRemoveBenchmark(unsigned int liveCount) : SceneBenchmark(sceneBenchmarkName("remove", liveCount), liveCount) {}
+
+    unsigned long long run()
+    {
+        for (unsigned int i = 0; i < CHURN_BATCH; i++)
+            m_scene->allocationRemoved(allocation(churnSlot(i)));
+
+        return CHURN_BATCH;
+    }
+
+    void tearDown()
+    {
+        for (unsigned int i = 0; i < CHURN_BATCH; i++)
+            m_scene->allocationAdded(allocation(churnSlot(i)));
+    }
+};
+
+// AllocationSceneController::lookup(), hits and misses
+class SceneLookupBenchmark : public SceneBenchmark
+{
+public:
+    SceneLookupBenchmark(unsigned int liveCount) : SceneBenchmark(sceneBenchmarkName("lookup", liveCount), liveCount) {}
+
+    void prepare()
+    {
+        unsigned int seed = 1;
+
+        SceneBenchmark::prepare();
+
+        for (unsigned int i = 0; i < LOOKUP_COUNT; i++) {
+            seed = seed * 1103515245 + 12345;
+
+            // One in four misses between two slots
+            m_offsets.push_back(((seed >> 8) % m_liveCount) * SLOT_SIZE + ((i & 3) ? 0 : ALLOCATION_SIZE));
+        }
+    }
+
+    unsigned long long run()
+    {
+        unsigned int found = 0;
+
+        for (unsigned int i = 0; i < LOOKUP_COUNT; i++) {
+            if (m_scene->lookup(m_offsets[i]))
+                found++;
+        }
+
+        m_found = found;
+
+        return LOOKUP_COUNT;
+    }
+
+private:
+    std::vector<unsigned int> m_offsets;
+    volatile unsigned int m_found;
+};
+
+// AllocationRenderItem::paint() and boundingRect() into an offscreen image
+class RenderBenchmark : public SceneBenchmark
+{
+public:
+    // Allocations spread over the whole scene, some of them span rows
+    RenderBenchmark(const std::string& name, bool paint) : SceneBenchmark(name, PAINTED_ITEMS, RENDER_STRIDE, (RENDER_STRIDE / 4) * 3),
+                                                           m_image(SCENE_WIDTH, SCENE_HEIGHT, QImage::Format_RGB32),
+                                                           m_paint(paint)
+    {
+    }
+
+    void prepare()
+    {
+        SceneBenchmark::prepare();
+
+        for (unsigned int i = 0; i < PAINTED_ITEMS; i++) {
+            AllocationRenderItem *item = m_scene->lookup(allocation(i).offset);
+
+            if (item)
+                m_items.push_back(item);
+        }
+    }
+
+    unsigned long long run()
+    {
+        QStyleOptionGraphicsItem option;
+        qreal area = 0;
+
+        if (m_paint) {
+            QPainter painter(&m_image);
+
+            for (unsigned int i = 0; i < m_items.size(); i++)
+                m_items[i]->paint(&painter, &option, 0);
+        } else {
+            for (unsigned int i = 0; i < m_items.size(); i++) {
+                QRectF rect = m_items[i]->boundingRect();
+
+                area += rect.width() * rect.height();
+            }
+        }
+
+        m_area = area;
+
+        return m_items.size();
+    }
+
+private:
+    QImage m_image;
+    bool m_paint;
+
+    std::vector<AllocationRenderItem *> m_items;
+    volatile qreal m_area;
+};
+
+static BenchmarkResult measure(Benchmark* benchmark, unsigned int repetitions)
+{
+    std::vector<double> samples;
+    BenchmarkResult result;
+
+    result.name = benchmark->name();
+    result.operations = 0;
+
+    benchmark->prepare();
+
+    // One untimed round to warm up the caches and the allocator
+    for (unsigned int r = 0; r <= repetitions; r++) {
+        benchmark->setUp();
+
+        unsigned long long start = PipelineStats::now();
+        unsigned long long operations = benchmark->run();
+        unsigned long long elapsed = PipelineStats::now() - start;
+
+        benchmark->tearDown();
+
+        if (!r || !operations)
+            continue;
+
+        result.operations = operations;
+        samples.push_back((double)elapsed / operations);
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    result.bestNs = samples.empty() ? 0.0 : samples[0];
+    result.medianNs = samples.empty() ? 0.0 : samples[samples.size() / 2];
+
+    fprintf(stderr, "%-28s %12.1f ns/op (median %.1f)\n", result.name.c_str(), result.bestNs, result.medianNs);
+
+    return result;
+}
+
+static void writeResults(FILE* out, const std::vector<BenchmarkResult>& results, unsigned int repetitions)
+{
+    fprintf(out, "{\n");
+    fprintf(out, "  \"qtVersion\": \"%s\",\n", qVersion());
+    fprintf(out, "  \"repetitions\": %u,\n", repetitions);
+    fprintf(out, "  \"benchmarks\": [");
+
+    for (unsigned int i = 0; i < results.size(); i++) {
+        const BenchmarkResult& result = results[i];
+
+        fprintf(out, "%s\n    {\n", i ? "," : "");
+        fprintf(out, "      \"name\": \"%s\",\n", result.name.c_str());
+        fprintf(out, "      \"operations\": %llu,\n", result.operations);
+        fprintf(out, "      \"bestNsPerOperation\": %.2f,\n", result.bestNs);
+        fprintf(out, "      \"medianNsPerOperation\": %.2f,\n", result.medianNs);
+        fprintf(out, "      \"operationsPerSecond\": %.0f\n", result.bestNs ? (1000000000.0 / result.bestNs) : 0.0);
+        fprintf(out, "    }");
+    }
+
+    fprintf(out, "%s]\n}\n", results.empty() ? "" : "\n  ");
+}
+
+static void usage(const char* program)
+{
+    fprintf(stderr, "usage: %s [-o results.json] [-r repetitions] [-f filter]\n", program);
+}
+
+int main(int argc, char *argv[])
+{
+#if QT_VERSION >= 0x050000
+    // Never needs a display
+    if (qgetenv("QT_QPA_PLATFORM").isEmpty())
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+#endif
+
+    QApplication app(argc, argv);
+
+    const char* outName = NULL;
+    const char* filter = NULL;
+    unsigned int repetitions = DEFAULT_REPETITIONS;
+    int c;
+
+    while ((c = getopt(argc, argv, "o:r:f:h")) != -1) {
+        switch (c) {
+        case 'o': outName = optarg; break;
+        case 'r': repetitions = strtoul(optarg, NULL, 0); break;
+        case 'f': filter = optarg; break;
+        default:
+            usage(argv[0]);
+            return (c == 'h') ? 0 : 1;
+        }
+    }
+
+    if (!repetitions) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    static const unsigned int liveCounts[] = { 1000, 10000, 100000 };
+    std::vector<Benchmark *> benchmarks;
+
+    benchmarks.push_back(new DecodeBenchmark("decode/inOrder", 0, false));
+    benchmarks.push_back(new DecodeBenchmark("decode/reordered", REORDER_WINDOW, false));
+    benchmarks.push_back(new DecodeBenchmark("decode/truncated", 0, true));
+    benchmarks.push_back(new SnapshotBenchmark());
+
+    for (unsigned int i = 0; i < sizeof(liveCounts) / sizeof(liveCounts[0]); i++) {
+        benchmarks.push_back(new SceneAddBenchmark(liveCounts[i]));
+        benchmarks.push_back(new SceneRemoveBenchmark(liveCounts[i]));
+        benchmarks.push_back(new SceneLookupBenchmark(liveCounts[i]));
+    }
+
+    benchmarks.push_back(new RenderBenchmark("render/paint", true));
+    benchmarks.push_back(new RenderBenchmark("render/boundingRect", false));
+
+    std::vector<BenchmarkResult> results;
+
+    for (unsigned int i = 0; i < benchmarks.size(); i++) {
+        if (!filter || strstr(benchmarks[i]->name().c_str(), filter))
+            results.push_back(measure(benchmarks[i], repetitions));
+
+        delete benchmarks[i];
+    }
+
+    FILE *out = outName ? fopen(outName, "w") : stdout;
+
+    if (!out) {
+        fprintf(stderr, "%s: can't open %s\n", argv[0], outName);
+        return 1;
+    }
+
+    writeResults(out, results, repetitions);
+
+    if (out != stdout)
+        fclose(out);
+
+    return 0;
+}
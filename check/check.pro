@@ -0,0 +1,36 @@
+#-------------------------------------------------
+#
+# Randomized cross-checks of the persistent pool
+# structures and the occupancy pyramid against
+# reference models, without Qt.
+#
+#-------------------------------------------------
+
+CONFIG   += console
+CONFIG   -= qt app_bundle
+
+TARGET = dfbperf-check
+TEMPLATE = app
+
+SOURCES += main.cpp \
+    ../persistentpool.cpp \
+    ../poolhistory.cpp \
+    ../packetdecoder.cpp \
+    ../poolstate.cpp \
+    ../pipelinestats.cpp \
+    ../traceindex.cpp \
+    ../occupancypyramid.cpp
+
+HEADERS += \
+    ../persistentpool.h \
+    ../poolhistory.h \
+    ../packetdecoder.h \
+    ../poolstate.h \
+    ../pipelinestats.h \
+    ../traceindex.h \
+    ../occupancypyramid.h
+
+INCLUDEPATH += ..
+INCLUDEPATH += /home/ilyes/DirectFB-git/src
+INCLUDEPATH += /home/ilyes/DirectFB-git/include
+INCLUDEPATH += /home/ilyes/DirectFB-git/lib
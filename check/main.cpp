@@ -0,0 +1,648 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// dfbperf-check: drives the persistent pool structures and the occupancy
+// pyramid with random operations and compares every result against a
+// plain model. Seeks and zoomed views silently show the wrong pools when
+// these go wrong, so run it after touching them. Prints one line per
+// check, exits with 1 on a mismatch.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "persistentpool.h"
+#include "poolhistory.h"
+#include "occupancypyramid.h"
+
+#define PERSISTENT_STEPS 20000
+#define PERSISTENT_SLOTS 512 // distinct offsets, so that erases hit
+#define PERSISTENT_VERSION_PERIOD 37 // steps between two versions kept
+
+#define HISTORY_PACKETS 8000
+#define HISTORY_POOLS 3
+#define HISTORY_SLOTS 1024
+#define HISTORY_INTERVAL 8 // in packets
+#define HISTORY_MEMORY 1 // in MB, low enough for checkpoints to get thinned
+#define HISTORY_SEEKS 2000
+
+#define SLOT_SIZE 4096
+
+#define OCCUPANCY_POOL_SIZE (4U << 20)
+#define OCCUPANCY_STEPS 4000
+#define OCCUPANCY_QUERIES 200
+#define OCCUPANCY_MAX_SIZE (64U << 10)
+
+// The reference: allocations by offset, per pool
+typedef std::map<unsigned int, PoolAllocation> PoolModel;
+typedef std::map<unsigned int, PoolModel> HistoryModel;
+
+// Deterministic across platforms, unlike rand()
+static unsigned int random32(unsigned long long& state)
+{
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+
+    return (unsigned int)(state >> 33);
+}
+
+static bool sameAllocation(const PoolAllocation& a, const PoolAllocation& b)
+{
+    return (a.offset == b.offset) && (a.size == b.size) && (a.width == b.width)
+            && (a.height == b.height) && (a.format == b.format);
+}
+
+static PoolAllocation randomAllocation(unsigned long long& state, unsigned int slots)
+{
+    PoolAllocation allocation;
+
+    allocation.offset = (random32(state) % slots) * SLOT_SIZE;
+    allocation.size = (random32(state) % SLOT_SIZE) + 1;
+    allocation.width = random32(state) % 2048;
+    allocation.height = random32(state) % 2048;
+    allocation.format = (random32(state) & 1) ? DSPF_ARGB : DSPF_RGB16;
+
+    return allocation;
+}
+
+static bool samePool(const PersistentPool& pool, const PoolModel& model, std::string& error)
+{
+    std::vector<PoolAllocation> allocations;
+
+    pool.allocations(allocations);
+
+    if ((pool.count() != model.size()) || (allocations.size() != model.size())) {
+        error = "allocation count differs";
+        return false;
+    }
+
+    PoolModel::const_iterator it = model.begin();
+
+    for (unsigned int i = 0; i < allocations.size(); i++, ++it) {
+        if (!sameAllocation(allocations[i], it->second)) {
+            error = "allocations differ";
+            return false;
+        }
+
+        const PoolAllocation *found = pool.lookup(it->first);
+
+        if (!found || !sameAllocation(*found, it->second)) {
+            error = "lookup differs";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+class Check
+{
+public:
+    explicit Check(const std::string& name) : m_name(name) {}
+    virtual ~Check() {}
+
+    const std::string& name() const { return m_name; }
+
+    // Fills error on the first mismatch
+    virtual bool run(unsigned long long seed, std::string& error) = 0;
+
+    // Anything worth printing along with a success
+    const std::string& detail() const { return m_detail; }
+
+protected:
+    std::string m_detail;
+
+private:
+    std::string m_name;
+};
+
+// Inserts, erases and clears, keeping older versions around: all of them
+// have to stay intact, and the diff of any two has to lead from one to the
+// other. Once every version is gone, so must be their nodes.
+class PersistentPoolCheck : public Check
+{
+public:
+    PersistentPoolCheck() : Check("persistentPool") {}
+
+    bool run(unsigned long long seed, std::string& error)
+    {
+        unsigned int baseNodes = PersistentPool::nodeCount();
+
+        if (!runVersions(seed, error))
+            return false;
+
+        if (PersistentPool::nodeCount() != baseNodes) {
+            error = "nodes leaked, or released twice";
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+    bool runVersions(unsigned long long seed, std::string& error)
+    {
+        std::vector<PersistentPool> versions;
+        std::vector<PoolModel> models;
+
+        PersistentPool pool;
+        PoolModel model;
+
+        for (unsigned int step = 0; step < PERSISTENT_STEPS; step++) {
+            unsigned int action = random32(seed) % 100;
+
+            if (!action) {
+                pool.clear();
+                model.clear();
+            } else if (action < 60) {
+                PoolAllocation allocation = randomAllocation(seed, PERSISTENT_SLOTS);
+
+                // Replaces whatever was at that offset
+                pool.insert(allocation);
+                model[allocation.offset] = allocation;
+            } else {
+                unsigned int offset = (random32(seed) % PERSISTENT_SLOTS) * SLOT_SIZE;
+
+                if (pool.erase(offset) != (model.erase(offset) == 1)) {
+                    error = "erase result differs";
+                    return false;
+                }
+            }
+
+            if (!samePool(pool, model, error))
+                return false;
+
+            if (!(step % PERSISTENT_VERSION_PERIOD)) {
+                versions.push_back(pool);
+                models.push_back(model);
+
+                // Versions come and go in any order
+                if (random32(seed) & 1) {
+                    unsigned int i = random32(seed) % versions.size();
+
+                    versions.erase(versions.begin() + i);
+                    models.erase(models.begin() + i);
+                }
+            }
+        }
+
+        for (unsigned int i = 0; i < versions.size(); i++) {
+            if (!samePool(versions[i], models[i], error))
+                return false;
+
+            unsigned int j = random32(seed) % versions.size();
+
+            std::vector<PoolAllocation> removed, added;
+            PoolModel patched = models[i];
+
+            PersistentPool::diff(versions[i], versions[j], removed, added);
+
+            for (unsigned int k = 0; k < removed.size(); k++) {
+                PoolModel::iterator it = patched.find(removed[k].offset);
+
+                if ((it == patched.end()) || !sameAllocation(it->second, removed[k])) {
+                    error = "diff removes an allocation that isn't there";
+                    return false;
+                }
+
+                patched.erase(it);
+            }
+
+            for (unsigned int k = 0; k < added.size(); k++) {
+                if (patched.count(added[k].offset)) {
+                    error = "diff adds over an allocation";
+                    return false;
+                }
+
+                patched[added[k].offset] = added[k];
+            }
+
+            if (!samePool(versions[j], patched, error)) {
+                error = "diff doesn't lead to the other version: " + error;
+                return false;
+            }
+        }
+
+        return true;
+    }
+};
+
+// Applies what PoolHistory::diff() reports to a model
+class ModelListener : public PacketListener
+{
+public:
+    explicit ModelListener(HistoryModel& model) : releasedAfterAllocation(false), m_model(model), m_allocated(false) {}
+
+    void poolReset(const DFBTracingBufferData* data) { m_model[data->poolId].clear(); }
+
+    void bufferAllocation(const DFBTracingBufferData* data)
+    {
+        PoolAllocation allocation;
+
+        allocation.offset = data->offset;
+        allocation.size = data->size;
+        allocation.width = data->width;
+        allocation.height = data->height;
+        allocation.format = data->format;
+
+        m_model[data->poolId][data->offset] = allocation;
+        m_allocated = true;
+    }
+
+    void bufferRelease(const DFBTracingBufferData* data)
+    {
+        m_model[data->poolId].erase(data->offset);
+
+        releasedAfterAllocation = releasedAfterAllocation || m_allocated;
+    }
+
+    bool releasedAfterAllocation;
+
+private:
+    HistoryModel& m_model;
+    bool m_allocated;
+};
+
+// Plays random events over a few pools with frequent checkpoints and a
+// memory budget small enough to thin them, then seeks all over the place:
+// restoring a checkpoint then replaying up to the target, and the diff
+// from the state shown before, both have to give the reference state.
+class PoolHistoryCheck : public Check
+{
+public:
+    PoolHistoryCheck() : Check("poolHistory") {}
+
+    bool run(unsigned long long seed, std::string& error)
+    {
+        unsigned int baseNodes = PersistentPool::nodeCount();
+
+        {
+            PoolHistory history;
+
+            if (!runHistory(history, seed, error))
+                return false;
+
+            history.clear();
+        }
+
+        if (PersistentPool::nodeCount() != baseNodes) {
+            error = "nodes leaked, or released twice";
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+    struct Event {
+        int type; // 0 reset, 1 allocation, 2 release
+        DFBTracingBufferData data;
+    };
+
+    static void apply(PacketListener* listener, const Event& event)
+    {
+        switch (event.type) {
+        case 0: listener->poolReset(&event.data); break;
+        case 1: listener->bufferAllocation(&event.data); break;
+        default: listener->bufferRelease(&event.data); break;
+        }
+    }
+
+    static bool sameVersion(const PoolHistory::Version& version, const HistoryModel& model, std::string& error)
+    {
+        HistoryModel::const_iterator it;
+
+        // A pool the model knows may be empty or missing from the version
+        for (it = model.begin(); it != model.end(); ++it) {
+            PoolHistory::Version::const_iterator pool = version.find(it->first);
+
+            if (pool == version.end()) {
+                if (!it->second.empty()) {
+                    error = "pool missing";
+                    return false;
+                }
+
+                continue;
+            }
+
+            if (!samePool(pool->second, it->second, error))
+                return false;
+        }
+
+        PoolHistory::Version::const_iterator pool;
+
+        for (pool = version.begin(); pool != version.end(); ++pool) {
+            if (!model.count(pool->first) && pool->second.count()) {
+                error = "unexpected pool";
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool runHistory(PoolHistory& history, unsigned long long seed, std::string& error)
+    {
+        std::vector<Event> events(HISTORY_PACKETS);
+        std::vector<HistoryModel> states(HISTORY_PACKETS + 1); // right before each packet
+
+        ModelListener reference(states[0]);
+        HistoryModel model;
+        ModelListener modelListener(model);
+
+        history.setCheckpointing(HISTORY_INTERVAL, HISTORY_MEMORY);
+
+        for (unsigned int p = 0; p < HISTORY_PACKETS; p++) {
+            Event& event = events[p];
+            unsigned int action = random32(seed) % 1000;
+
+            memset(&event.data, 0, sizeof(event.data));
+
+            event.data.poolId = 1 + (random32(seed) % HISTORY_POOLS);
+            event.data.poolSize = HISTORY_SLOTS * SLOT_SIZE;
+            snprintf(event.data.name, sizeof(event.data.name), "pool %u", event.data.poolId);
+
+            if (!action)
+                event.type = 0;
+            else {
+                PoolAllocation allocation = randomAllocation(seed, HISTORY_SLOTS);
+
+                event.type = (action < 550) ? 1 : 2;
+
+                event.data.offset = allocation.offset;
+                event.data.size = allocation.size;
+                event.data.width = allocation.width;
+                event.data.height = allocation.height;
+                event.data.format = allocation.format;
+            }
+
+            history.advance(p);
+
+            if (!sameVersion(history.current(), model, error))
+                return false;
+
+            apply(&history, event);
+            apply(&modelListener, event);
+
+            states[p + 1] = model;
+        }
+
+        // Thinning doubles the interval whenever the nodes go over budget
+        if (history.checkpointInterval() == HISTORY_INTERVAL) {
+            error = "checkpoints never got thinned, lower HISTORY_MEMORY";
+            return false;
+        }
+
+        PoolHistory::Version shown = history.current();
+        unsigned int shownIndex = HISTORY_PACKETS;
+
+        for (unsigned int s = 0; s < HISTORY_SEEKS; s++) {
+            unsigned int target = random32(seed) % HISTORY_PACKETS;
+            unsigned int checkpointIndex;
+
+            if (!history.restore(target, checkpointIndex) || (checkpointIndex > target)) {
+                error = "no checkpoint before the target";
+                return false;
+            }
+
+            if (!sameVersion(history.current(), states[checkpointIndex], error)) {
+                error = "restored checkpoint differs: " + error;
+                return false;
+            }
+
+            for (unsigned int p = checkpointIndex; p < target; p++)
+                apply(&history, events[p]);
+
+            if (!sameVersion(history.current(), states[target], error)) {
+                error = "replayed state differs: " + error;
+                return false;
+            }
+
+            HistoryModel patched = states[shownIndex];
+            ModelListener patcher(patched);
+
+            history.diff(shown, &patcher);
+
+            if (patcher.releasedAfterAllocation) {
+                error = "diff releases after allocating";
+                return false;
+            }
+
+            if (!sameVersion(history.current(), patched, error)) {
+                error = "diff from the state shown differs: " + error;
+                return false;
+            }
+
+            shown = history.current();
+            shownIndex = target;
+        }
+
+        return true;
+    }
+};
+
+// Random spans that don't overlap, as in a pool in sync, against a map of
+// the bytes covered. Slices whose
+// boundaries fall on leaves have to be exact. Elsewhere a partly covered
+// leaf is assumed evenly covered, which is off by at most a quarter of a
+// leaf at each boundary of a slice: that bound is what gets checked.
+class OccupancyPyramidCheck : public Check
+{
+public:
+    OccupancyPyramidCheck() : Check("occupancyPyramid") {}
+
+    bool run(unsigned long long seed, std::string& error)
+    {
+        OccupancyPyramid pyramid(OCCUPANCY_POOL_SIZE);
+        std::vector<unsigned char> bytes(OCCUPANCY_POOL_SIZE, 0);
+        std::vector<std::pair<unsigned int, unsigned int> > spans;
+
+        double worst = 0;
+        char buf[64];
+
+        for (unsigned int step = 0; step < OCCUPANCY_STEPS; step++) {
+            if (spans.empty() || (random32(seed) % 100) < 55) {
+                unsigned int offset = random32(seed) % OCCUPANCY_POOL_SIZE;
+                unsigned int size = 1 + random32(seed) % OCCUPANCY_MAX_SIZE;
+
+                if (covered(bytes, offset, (double)offset + size) > 0)
+                    continue;
+
+                // Some spans reach past the end of the pool
+                pyramid.add(offset, size);
+                mark(bytes, offset, size, 1);
+
+                spans.push_back(std::make_pair(offset, size));
+            } else {
+                unsigned int i = random32(seed) % spans.size();
+
+                pyramid.remove(spans[i].first, spans[i].second);
+                mark(bytes, spans[i].first, spans[i].second, 0);
+
+                spans[i] = spans.back();
+                spans.pop_back();
+            }
+
+            if (step % (OCCUPANCY_STEPS / OCCUPANCY_QUERIES))
+                continue;
+
+            // Aligned on leaves, at any level of detail
+            unsigned int leaves = OCCUPANCY_POOL_SIZE / OccupancyPyramid::leafSize();
+            unsigned int first = random32(seed) % leaves;
+            unsigned int perSlice = 1 + random32(seed) % 64;
+            unsigned int count = (leaves - first) / perSlice;
+
+            if (count > 512)
+                count = 1 + random32(seed) % 512;
+
+            if (count && !compare(pyramid, bytes, (double)first * OccupancyPyramid::leafSize(),
+                                  (double)(first + count * perSlice) * OccupancyPyramid::leafSize(), count, 0, worst, error))
+                return false;
+
+            // Anywhere, with at least a leaf per slice as the views use it
+            double bytesPerSlice = OccupancyPyramid::leafSize() * (1.0 + (random32(seed) % 4096) / 64.0);
+            double start = random32(seed) % OCCUPANCY_POOL_SIZE + (random32(seed) % 1000) / 1000.0;
+
+            count = 1 + random32(seed) % 512;
+
+            if (!compare(pyramid, bytes, start, start + count * bytesPerSlice, count,
+                         2 * (OccupancyPyramid::leafSize() / 4.0) / bytesPerSlice, worst, error))
+                return false;
+        }
+
+        sprintf(buf, "worst unaligned error %.4f", worst);
+        m_detail = buf;
+
+        return true;
+    }
+
+private:
+    static void mark(std::vector<unsigned char>& bytes, unsigned int offset, unsigned int size, int value)
+    {
+        unsigned long long end = (unsigned long long)offset + size;
+
+        if (end > bytes.size())
+            end = bytes.size();
+
+        for (unsigned long long i = offset; i < end; i++)
+            bytes[i] = value;
+    }
+
+    static double covered(const std::vector<unsigned char>& bytes, double first, double last)
+    {
+        double sum = 0;
+
+        long long a = (long long)floor(first), b = (long long)ceil(last);
+
+        for (long long i = (a > 0) ? a : 0; (i < b) && (i < (long long)bytes.size()); i++) {
+            if (!bytes[i])
+                continue;
+
+            double lo = (i < first) ? first : i, hi = ((i + 1) > last) ? last : (i + 1);
+
+            if (hi > lo)
+                sum += hi - lo;
+        }
+
+        return sum;
+    }
+
+    static bool compare(const OccupancyPyramid& pyramid, const std::vector<unsigned char>& bytes,
+                        double first, double last, unsigned int count, double tolerance,
+                        double& worst, std::string& error)
+    {
+        std::vector<float> coverage;
+        double step = (last - first) / count;
+
+        pyramid.query(first, last, count, coverage);
+
+        for (unsigned int i = 0; i < count; i++) {
+            double a = first + i * step, b = first + (i + 1) * step;
+            double lo = (a > 0) ? a : 0, hi = (b < bytes.size()) ? b : bytes.size();
+            double expected = (hi > lo) ? (covered(bytes, a, b) / (hi - lo)) : 0;
+            double difference = fabs(coverage[i] - expected);
+
+            // Coverage comes back as float
+            if (difference > (tolerance + 1e-5)) {
+                char buf[128];
+
+                sprintf(buf, "slice [%.1f, %.1f) is %.5f covered, not %.5f", a, b, coverage[i], expected);
+                error = buf;
+                return false;
+            }
+
+            if (tolerance && (difference > worst))
+                worst = difference;
+        }
+
+        return true;
+    }
+};
+
+static void usage(const char* program)
+{
+    fprintf(stderr, "usage: %s [-s seed] [-f filter]\n", program);
+    fprintf(stderr, "  -s  random seed (default 1)\n");
+    fprintf(stderr, "  -f  only run the checks whose name contains filter\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char* filter = NULL;
+    unsigned long long seed = 1;
+    int c;
+
+    while ((c = getopt(argc, argv, "s:f:h")) != -1) {
+        switch (c) {
+        case 's': seed = strtoull(optarg, NULL, 0); break;
+        case 'f': filter = optarg; break;
+        default:
+            usage(argv[0]);
+            return (c == 'h') ? 0 : 1;
+        }
+    }
+
+    std::vector<Check *> checks;
+
+    checks.push_back(new PersistentPoolCheck());
+    checks.push_back(new PoolHistoryCheck());
+    checks.push_back(new OccupancyPyramidCheck());
+
+    bool failed = false;
+
+    for (unsigned int i = 0; i < checks.size(); i++) {
+        if (!filter || strstr(checks[i]->name().c_str(), filter)) {
+            std::string error;
+
+            if (checks[i]->run(seed, error))
+                printf("%s: ok%s%s\n", checks[i]->name().c_str(), checks[i]->detail().empty() ? "" : ", ",
+                       checks[i]->detail().c_str());
+            else {
+                printf("%s: FAILED, %s (seed %llu)\n", checks[i]->name().c_str(), error.c_str(), seed);
+                failed = true;
+            }
+        }
+
+        delete checks[i];
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,96 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <assert.h>
+
+#include "eventqueue.h"
+
+EventQueue::EventQueue(unsigned int capacity)
+{
+    unsigned int size = 1;
+
+    // Round up to a power of two so that indexes wrap with a mask
+    while (size < capacity)
+        size <<= 1;
+
+    m_events = new AllocationEvent[size];
+    m_mask = size - 1;
+
+    m_head = m_tail = 0;
+}
+
+EventQueue::~EventQueue()
+{
+    delete[] m_events;
+}
+
+bool EventQueue::push(const AllocationEvent& event)
+{
+    unsigned int head = m_head;
+    unsigned int tail = __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE);
+
+    if ((head - tail) > m_mask)
+        return false;
+
+    m_events[head & m_mask] = event;
+
+    __atomic_store_n(&m_head, head + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+bool EventQueue::push(const AllocationEvent* events, unsigned int count)
+{
+    unsigned int head = m_head;
+    unsigned int tail = __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE);
+
+    if (count > ((m_mask + 1) - (head - tail)))
+        return false;
+
+    for (unsigned int i = 0; i < count; i++)
+        m_events[(head + i) & m_mask] = events[i];
+
+    // Published at once, the consumer sees all of them or none
+    __atomic_store_n(&m_head, head + count, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+bool EventQueue::pop(AllocationEvent& event)
+{
+    unsigned int tail = m_tail;
+    unsigned int head = __atomic_load_n(&m_head, __ATOMIC_ACQUIRE);
+
+    if (head == tail)
+        return false;
+
+    event = m_events[tail & m_mask];
+
+    __atomic_store_n(&m_tail, tail + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+unsigned int EventQueue::size() const
+{
+    return __atomic_load_n(&m_head, __ATOMIC_ACQUIRE) - __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE);
+}
+
+void EventQueue::clear()
+{
+    // Only safe while the producer is stopped
+    m_tail = m_head;
+}
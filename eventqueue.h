@@ -0,0 +1,65 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef EVENTQUEUE_H
+#define EVENTQUEUE_H
+
+#include <core/remote_tracing.h>
+
+typedef enum {
+    EVENT_POOL_RESET,
+    EVENT_BUFFER_ALLOCATION,
+    EVENT_BUFFER_RELEASE,
+    EVENT_POOL_STALE,
+    EVENT_POOL_SYNCED,
+    EVENT_SOURCE_ADDED
+} AllocationEventType;
+
+struct AllocationEvent {
+    AllocationEventType type;
+    unsigned int source; // sender the event comes from, 0 for a trace
+    unsigned long long timestamp; // when pushed in ns, 0 when not timed
+    DFBTracingBufferData data;
+};
+
+// Bounded single-producer/single-consumer ring. The receiver thread pushes,
+// the main thread drains; neither side allocates nor takes a lock.
+class EventQueue
+{
+public:
+    explicit EventQueue(unsigned int capacity);
+    ~EventQueue();
+
+    bool push(const AllocationEvent& event);
+    bool push(const AllocationEvent* events, unsigned int count);
+    bool pop(AllocationEvent& event);
+
+    unsigned int size() const;
+    unsigned int capacity() const { return m_mask + 1; }
+
+    void clear();
+
+private:
+    AllocationEvent *m_events;
+    unsigned int m_mask;
+
+    // Keep the producer and consumer indexes on separate cache lines
+    unsigned int m_head;
+    char m_pad[64 - sizeof(unsigned int)];
+    unsigned int m_tail;
+};
+
+#endif // EVENTQUEUE_H
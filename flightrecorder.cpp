@@ -0,0 +1,591 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <QFile>
+
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+
+#include <algorithm>
+
+#include "flightrecorder.h"
+#include "tracetimestamps.h"
+
+// Dumps wait that long after a trigger so they also hold its aftermath
+#define POST_TRIGGER_DELAY 2000000000ull // in ns
+
+// At most one automatic dump in that period
+#define MIN_DUMP_INTERVAL 10000000000ull // in ns
+
+#define LOSS_WINDOW 1000000000ull // in ns
+
+// Past that, the disk can't keep up and new dumps are refused
+#define MAX_QUEUED_DUMPS 2
+
+// Granularity of the window, and of what a dump takes a reference on
+#define CHUNK_PACKETS 256
+
+// A pool has to go that far below the usage threshold to fire again
+#define USAGE_HYSTERESIS 5.0f // in %
+
+static unsigned long long monotonicNs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void FlightRecorder::LossTracker::lostPackets(unsigned int lastValidNseq, unsigned int expectedNseq)
+{
+    if (lastValidNseq > expectedNseq)
+        lost += lastValidNseq - expectedNseq;
+}
+
+FlightRecorder::FlightRecorder(QObject *parent) :
+    QObject(parent), m_tailDecoder(&m_tail), m_headDecoder(&m_head), m_writer(this)
+{
+    m_capacity = m_first = m_count = 0;
+    m_window = 0;
+
+    m_usageThreshold = 0;
+    m_largestFreeThreshold = 0;
+    m_lossThreshold = 0;
+
+    m_usageArmed = m_largestFreeArmed = true;
+    m_lossWindowStart = m_lossWindowBase = 0;
+
+    m_pending = false;
+    m_pendingTrigger = TRIGGER_MANUAL;
+    m_pendingDeadline = 0;
+    m_lastDump = 0;
+
+    m_writing = true;
+    m_writer.start(QThread::LowPriority);
+}
+
+FlightRecorder::~FlightRecorder()
+{
+    stop();
+
+    // The queued dumps are written before the thread goes away
+    m_dumpMutex.lock();
+    m_writing = false;
+    m_dumpReady.wakeOne();
+    m_dumpMutex.unlock();
+
+    m_writer.wait();
+
+    while (!m_freeDumps.isEmpty())
+        delete m_freeDumps.dequeue();
+
+    for (unsigned int i = 0; i < m_freeChunks.size(); i++)
+        deleteChunk(m_freeChunks[i]);
+}
+
+bool FlightRecorder::start(unsigned int megabytes, unsigned int seconds)
+{
+    QMutexLocker locker(&m_mutex);
+
+    unsigned int capacity = ((unsigned long long)megabytes * 1024 * 1024) / sizeof(DFBTracingPacket);
+
+    if (!capacity)
+        return false;
+
+    clearWindow();
+
+    m_capacity = capacity;
+    m_window = seconds * 1000000000ull;
+
+    m_tail.clear();
+    m_tailDecoder.reset();
+    m_head.clear();
+    m_headDecoder.reset();
+
+    m_usageArmed = m_largestFreeArmed = true;
+    m_pending = false;
+
+    return true;
+}
+
+void FlightRecorder::stop()
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_capacity = 0;
+
+    // The chunks of the dumps still queued go once they are written
+    clearWindow();
+
+    for (unsigned int i = 0; i < m_freeChunks.size(); i++)
+        deleteChunk(m_freeChunks[i]);
+
+    m_freeChunks.clear();
+
+    m_pending = false;
+}
+
+void FlightRecorder::setTriggers(float usage, unsigned int largestFree, unsigned int lostPackets)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_usageThreshold = usage;
+    m_largestFreeThreshold = largestFree;
+    m_lossThreshold = lostPackets;
+
+    m_usageArmed = m_largestFreeArmed = true;
+}
+
+FlightRecorder::Chunk* FlightRecorder::takeChunk()
+{
+    Chunk *chunk;
+
+    if (!m_freeChunks.empty()) {
+        chunk = m_freeChunks.back();
+        m_freeChunks.pop_back();
+    } else {
+        chunk = new Chunk;
+        chunk->packets = new char[CHUNK_PACKETS * sizeof(DFBTracingPacket)];
+        chunk->times = new unsigned long long[CHUNK_PACKETS];
+    }
+
+    chunk->refs = 1;
+
+    return chunk;
+}
+
+void FlightRecorder::releaseChunk(Chunk *chunk)
+{
+    if (--chunk->refs)
+        return;
+
+    // Enough to keep the window going, what the dumps held on to goes away
+    if (m_freeChunks.size() <= (m_capacity / CHUNK_PACKETS))
+        m_freeChunks.push_back(chunk);
+    else
+        deleteChunk(chunk);
+}
+
+void FlightRecorder::deleteChunk(Chunk *chunk)
+{
+    delete [] chunk->packets;
+    delete [] chunk->times;
+    delete chunk;
+}
+
+void FlightRecorder::clearWindow()
+{
+    while (!m_chunks.empty()) {
+        releaseChunk(m_chunks.front());
+        m_chunks.pop_front();
+    }
+
+    m_first = m_count = 0;
+}
+
+void FlightRecorder::evict()
+{
+    Chunk *chunk = m_chunks.front();
+
+    m_tailDecoder.receivePacket(chunk->packets + (size_t)m_first * sizeof(DFBTracingPacket), sizeof(DFBTracingPacket));
+
+    m_first++;
+    m_count--;
+
+    if (m_first == CHUNK_PACKETS) {
+        m_chunks.pop_front();
+        releaseChunk(chunk);
+
+        m_first = 0;
+    }
+}
+
+void FlightRecorder::write(const char* buf, int size)
+{
+    // Same fixed-size records as the traces
+    const int recordSize = sizeof(DFBTracingPacket);
+
+    QMutexLocker locker(&m_mutex);
+
+    if (!m_capacity || (size > recordSize))
+        return;
+
+    unsigned long long now = monotonicNs();
+
+    if (m_count == m_capacity)
+        evict();
+
+    // Chunks are only written once, a dump may still be reading the others
+    unsigned int slot = m_first + m_count;
+
+    if (slot == (m_chunks.size() * CHUNK_PACKETS))
+        m_chunks.push_back(takeChunk());
+
+    Chunk *chunk = m_chunks[slot / CHUNK_PACKETS];
+    char *record = chunk->packets + (size_t)(slot % CHUNK_PACKETS) * recordSize;
+
+    memcpy(record, buf, size);
+    memset(record + size, 0, recordSize - size);
+    chunk->times[slot % CHUNK_PACKETS] = now;
+    m_count++;
+
+    while (m_window && (m_count > 1) && ((now - m_chunks.front()->times[m_first]) > m_window))
+        evict();
+
+    m_headDecoder.receivePacket(record, recordSize);
+
+    checkTriggers(now);
+
+    if (m_pending && (now >= m_pendingDeadline)) {
+        m_pending = false;
+        queueDump(m_pendingTrigger);
+    }
+}
+
+void FlightRecorder::poll()
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_pending && (monotonicNs() >= m_pendingDeadline)) {
+        m_pending = false;
+        queueDump(m_pendingTrigger);
+    }
+}
+
+void FlightRecorder::checkTriggers(unsigned long long now)
+{
+    const std::map<unsigned int, PoolState *>& pools = m_head.pools();
+    std::map<unsigned int, PoolState *>::const_iterator it;
+
+    if (m_usageThreshold > 0) {
+        bool above = false, clear = true;
+
+        for (it = pools.begin(); it != pools.end(); ++it) {
+            float usage = it->second->usageRatio();
+
+            above = above || (usage >= m_usageThreshold);
+            clear = clear && (usage < (m_usageThreshold - USAGE_HYSTERESIS));
+        }
+
+        if (above && m_usageArmed) {
+            m_usageArmed = false;
+            fire(TRIGGER_USAGE, now);
+        } else if (clear)
+            m_usageArmed = true;
+    }
+
+    if (m_largestFreeThreshold) {
+        bool below = false;
+
+        // Pools that never could hold such an allocation don't count
+        for (it = pools.begin(); it != pools.end(); ++it)
+            below = below || ((it->second->poolSize() > m_largestFreeThreshold)
+                              && (it->second->largestFreeBlock() < m_largestFreeThreshold));
+
+        if (below && m_largestFreeArmed) {
+            m_largestFreeArmed = false;
+            fire(TRIGGER_LARGEST_FREE, now);
+        } else if (!below)
+            m_largestFreeArmed = true;
+    }
+
+    if (m_lossThreshold) {
+        if ((now - m_lossWindowStart) >= LOSS_WINDOW) {
+            m_lossWindowStart = now;
+            m_lossWindowBase = m_head.lost;
+        }
+
+        if ((m_head.lost - m_lossWindowBase) >= m_lossThreshold) {
+            m_lossWindowBase = m_head.lost;
+            fire(TRIGGER_LOSS, now);
+        }
+    }
+}
+
+void FlightRecorder::fire(Trigger trigger, unsigned long long now)
+{
+    if (m_pending || (m_lastDump && ((now - m_lastDump) < MIN_DUMP_INTERVAL)))
+        return;
+
+    m_pending = true;
+    m_pendingTrigger = trigger;
+    m_pendingDeadline = now + POST_TRIGGER_DELAY;
+}
+
+bool FlightRecorder::dump(Trigger trigger)
+{
+    QMutexLocker locker(&m_mutex);
+
+    return queueDump(trigger);
+}
+
+void FlightRecorder::writeSnapshot(std::vector<char>& out, unsigned int& nSeq) const
+{
+    const std::map<unsigned int, PoolState *>& pools = m_tail.pools();
+    std::map<unsigned int, PoolState *>::const_iterator it;
+
+    for (it = pools.begin(); it != pools.end(); ++it) {
+        const PoolState *state = it->second;
+        DFBTracingPacket packet;
+        DFBTracingBufferData data;
+
+        const unsigned int capacity = sizeof(packet.Payload.pool.stats) / sizeof(packet.Payload.pool.stats[0]);
+
+        // An empty pool shows up again with its next allocation
+        if (!state->count())
+            continue;
+
+        memset(&data, 0, sizeof(data));
+
+        data.poolId = state->poolId();
+        data.poolSize = state->poolSize();
+        strncpy(data.name, state->name(), sizeof(data.name) - 1);
+
+        // A snapshot resets the pool, it can only open the sequence of the
+        // allocations that don't fit in it
+        unsigned int count = (state->count() < capacity) ? state->count() : capacity;
+
+        memset(&packet, 0, sizeof(packet));
+
+        packet.header.nSeq = nSeq++;
+        packet.header.type = DTE_POOL_FULL_SNAPSHOT;
+        packet.header.size = offsetof(DFBTracingPoolData, stats) + count * sizeof(DFBTracingBufferData);
+
+        packet.Payload.pool.count = count;
+
+        for (unsigned int i = 0; i < state->count(); i++) {
+            const PoolAllocation& allocation = state->at(i);
+
+            data.offset = allocation.offset;
+            data.size = allocation.size;
+            data.width = allocation.width;
+            data.height = allocation.height;
+            data.format = allocation.format;
+
+            if (i < count) {
+                packet.Payload.pool.stats[i] = data;
+
+                if (i == (count - 1))
+                    out.insert(out.end(), reinterpret_cast<const char*>(&packet), reinterpret_cast<const char*>(&packet + 1));
+
+                continue;
+            }
+
+            memset(&packet, 0, sizeof(packet));
+
+            packet.header.nSeq = nSeq++;
+            packet.header.type = DTE_POOL_BUFFER_ALLOCATION;
+            packet.header.size = sizeof(packet.Payload);
+
+            packet.Payload.buffer = data;
+
+            out.insert(out.end(), reinterpret_cast<const char*>(&packet), reinterpret_cast<const char*>(&packet + 1));
+        }
+    }
+}
+
+bool FlightRecorder::queueDump(Trigger trigger)
+{
+    if (!m_count)
+        return false;
+
+    m_dumpMutex.lock();
+    bool full = (m_dumps.size() >= MAX_QUEUED_DUMPS);
+    m_dumpMutex.unlock();
+
+    if (full)
+        return false;
+
+    // Reused, the buffers of a dump already written are faulted in
+    m_dumpMutex.lock();
+    Dump *dump = m_freeDumps.isEmpty() ? new Dump : m_freeDumps.dequeue();
+    m_dumpMutex.unlock();
+
+    dump->trigger = trigger;
+    dump->snapshot.clear();
+
+    // Numbered so that the window follows it without a gap
+    unsigned int nSeq = 0;
+    writeSnapshot(dump->snapshot, nSeq);
+
+    // The window itself isn't copied, its chunks stay around until written
+    dump->chunks.assign(m_chunks.begin(), m_chunks.end());
+
+    for (unsigned int i = 0; i < dump->chunks.size(); i++)
+        dump->chunks[i]->refs++;
+
+    dump->first = m_first;
+    dump->count = m_count;
+
+    m_lastDump = monotonicNs();
+
+    m_dumpMutex.lock();
+    m_dumps.enqueue(dump);
+    m_dumpReady.wakeOne();
+    m_dumpMutex.unlock();
+
+    return true;
+}
+
+void FlightRecorder::writeDumps()
+{
+    m_dumpMutex.lock();
+
+    for (;;) {
+        if (m_dumps.isEmpty()) {
+            if (!m_writing)
+                break;
+
+            m_dumpReady.wait(&m_dumpMutex);
+            continue;
+        }
+
+        Dump *dump = m_dumps.dequeue();
+
+        m_dumpMutex.unlock();
+
+        QString name;
+
+        if (writeDump(dump, name))
+            emit dumped(name, triggerName(dump->trigger));
+        else
+            emit dumpFailed(triggerName(dump->trigger));
+
+        m_mutex.lock();
+
+        for (unsigned int i = 0; i < dump->chunks.size(); i++)
+            releaseChunk(dump->chunks[i]);
+
+        m_mutex.unlock();
+
+        dump->chunks.clear();
+
+        m_dumpMutex.lock();
+
+        m_freeDumps.enqueue(dump);
+    }
+
+    m_dumpMutex.unlock();
+}
+
+bool FlightRecorder::writeDump(Dump *dump, QString& name)
+{
+    const unsigned int recordSize = sizeof(DFBTracingPacket);
+
+    // Named here, the names of the dumps written before are taken by now
+    name = traceName(dump->trigger);
+
+    QByteArray fileName = name.toAscii();
+
+    FILE *out = fopen(fileName.data(), "wb");
+
+    if (!out)
+        return false;
+
+    unsigned int snapshotPackets = dump->snapshot.size() / recordSize;
+
+    bool ok = !snapshotPackets || (fwrite(&dump->snapshot[0], recordSize, snapshotPackets, out) == snapshotPackets);
+
+    TraceTimestampWriter timestamps;
+    bool timed = timestamps.open(fileName.data());
+
+    // The snapshot takes the arrival time of the first packet
+    if (timed && snapshotPackets) {
+        std::vector<unsigned long long> times(snapshotPackets, dump->chunks[0]->times[dump->first]);
+
+        timestamps.write(&times[0], times.size());
+    }
+
+    // Playback expects a sequence starting at 0, the window's own gaps are
+    // kept. The chunks are shared with the window, renumber a copy.
+    const DFBTracingPacket *first = reinterpret_cast<const DFBTracingPacket*>(dump->chunks[0]->packets) + dump->first;
+    unsigned int base = first->header.nSeq;
+
+    std::vector<DFBTracingPacket> packets;
+    unsigned int offset = dump->first;
+    unsigned int left = dump->count;
+
+    for (unsigned int i = 0; ok && left; i++) {
+        const Chunk *chunk = dump->chunks[i];
+        unsigned int count = std::min(CHUNK_PACKETS - offset, left);
+
+        const DFBTracingPacket *chunkPackets = reinterpret_cast<const DFBTracingPacket*>(chunk->packets) + offset;
+        packets.assign(chunkPackets, chunkPackets + count);
+
+        for (unsigned int j = 0; j < count; j++)
+            packets[j].header.nSeq = packets[j].header.nSeq - base + snapshotPackets;
+
+        ok = (fwrite(&packets[0], recordSize, count, out) == count);
+
+        if (timed)
+            timestamps.write(chunk->times + offset, count);
+
+        offset = 0;
+        left -= count;
+    }
+
+    if (fclose(out))
+        ok = false;
+
+    timestamps.close();
+
+    return ok;
+}
+
+const char* FlightRecorder::triggerName(Trigger trigger)
+{
+    switch (trigger) {
+    case TRIGGER_MANUAL:
+        return "manual";
+    case TRIGGER_USAGE:
+        return "usage";
+    case TRIGGER_LARGEST_FREE:
+        return "largest-free";
+    case TRIGGER_LOSS:
+        return "loss";
+    }
+
+    return "unknown";
+}
+
+QString FlightRecorder::traceName(Trigger trigger)
+{
+    struct tm date;
+    char buf[96];
+
+    time_t t = time(NULL);
+    localtime_r(&t, &date);
+
+    sprintf(buf, "flighttrace-%04d%02d%02d%02d%02d%02d-%s", date.tm_year + 1900,
+                                                          date.tm_mon + 1,
+                                                          date.tm_mday,
+                                                          date.tm_hour,
+                                                          date.tm_min,
+                                                          date.tm_sec,
+                                                          triggerName(trigger));
+
+    // Manual dumps can come more than once per second
+    QString name = buf;
+
+    for (int i = 1; QFile::exists(name); i++)
+        name = QString("%1-%2").arg(buf).arg(i);
+
+    return name;
+}
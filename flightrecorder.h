@@ -0,0 +1,180 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef FLIGHTRECORDER_H
+#define FLIGHTRECORDER_H
+
+#include <QObject>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QString>
+
+#include <vector>
+#include <deque>
+
+#include <core/remote_tracing.h>
+
+#include "packetdecoder.h"
+
+// Keeps the last packets in a fixed amount of memory, for 24/7 monitoring
+// where recording everything to disk is too expensive, and dumps them to
+// a "flighttrace-*" file when a trigger fires. The packets falling off the
+// ring are decoded into the pool states at the start of the window, so a
+// dump opens with a snapshot of every pool and plays on its own. The
+// packets are kept in chunks that a dump only takes references on, and
+// are put on disk by a thread of their own, so the receiver neither copies
+// the window nor waits for the disk.
+class FlightRecorder : public QObject
+{
+    Q_OBJECT
+public:
+    typedef enum {
+        TRIGGER_MANUAL,
+        TRIGGER_USAGE, // a pool went above the usage threshold
+        TRIGGER_LARGEST_FREE, // a pool can't fit an allocation of that size anymore
+        TRIGGER_LOSS // a burst of lost packets
+    } Trigger;
+
+    explicit FlightRecorder(QObject *parent = 0);
+    ~FlightRecorder();
+
+    // Keeps at most megabytes of packets, and only those of the last
+    // seconds when not 0
+    bool start(unsigned int megabytes, unsigned int seconds);
+    void stop();
+
+    bool isRunning() const { return m_capacity != 0; }
+
+    // In % of the pool, in bytes and in lost packets per second, 0 disables
+    void setTriggers(float usage, unsigned int largestFree, unsigned int lostPackets);
+
+    // From the receiver thread, with the packets the decoder accepted
+    void write(const char* buf, int size);
+
+    // Fires the pending dumps when no packets come in, once in a while
+    void poll();
+
+    // Right away, from any thread. Only tells whether the dump could be
+    // queued, dumped() or dumpFailed() follow once it is written.
+    bool dump(Trigger trigger = TRIGGER_MANUAL);
+
+    static const char* triggerName(Trigger trigger);
+
+signals:
+    void dumped(QString traceName, QString trigger);
+    void dumpFailed(QString trigger);
+
+private:
+    struct Chunk {
+        char *packets;
+        unsigned long long *times; // arrival of each packet, in ns
+        unsigned int refs; // the window and the dumps holding it, with m_mutex held
+    };
+
+    // The snapshot and the window as they were when the dump was queued
+    struct Dump {
+        Trigger trigger;
+        std::vector<char> snapshot; // pool states at the start of the window
+        std::vector<Chunk *> chunks;
+        unsigned int first; // in the first chunk
+        unsigned int count; // in packets
+    };
+
+    class DumpWriter : public QThread {
+    public:
+        explicit DumpWriter(FlightRecorder *recorder) : m_recorder(recorder) {}
+
+    protected:
+        void run() { m_recorder->writeDumps(); }
+
+    private:
+        FlightRecorder *m_recorder;
+    };
+
+    class LossTracker : public PoolStateTracker {
+    public:
+        LossTracker() : lost(0) {}
+
+        void lostPackets(unsigned int lastValidNseq, unsigned int expectedNseq);
+
+        unsigned long long lost;
+    };
+
+    // With m_mutex held
+    Chunk* takeChunk();
+    void releaseChunk(Chunk *chunk);
+    void clearWindow();
+
+    static void deleteChunk(Chunk *chunk);
+
+    void evict();
+    void checkTriggers(unsigned long long now);
+    void fire(Trigger trigger, unsigned long long now);
+
+    // With m_mutex held
+    bool queueDump(Trigger trigger);
+    void writeSnapshot(std::vector<char>& out, unsigned int& nSeq) const;
+
+    // From the writer thread
+    void writeDumps();
+    bool writeDump(Dump *dump, QString& name);
+
+    static QString traceName(Trigger trigger);
+
+    QMutex m_mutex;
+
+    std::deque<Chunk *> m_chunks;
+    std::vector<Chunk *> m_freeChunks;
+    unsigned int m_capacity; // in packets
+    unsigned int m_first; // in the first chunk
+    unsigned int m_count;
+
+    unsigned long long m_window; // in ns, 0 for no time limit
+
+    // Pool states right before the oldest packet, and right after the newest
+    PoolStateTracker m_tail;
+    PacketDecoder m_tailDecoder;
+    LossTracker m_head;
+    PacketDecoder m_headDecoder;
+
+    float m_usageThreshold;
+    unsigned int m_largestFreeThreshold;
+    unsigned int m_lossThreshold;
+
+    // Triggers only fire again once their condition went away
+    bool m_usageArmed;
+    bool m_largestFreeArmed;
+
+    unsigned long long m_lossWindowStart;
+    unsigned long long m_lossWindowBase;
+
+    bool m_pending;
+    Trigger m_pendingTrigger;
+    unsigned long long m_pendingDeadline;
+    unsigned long long m_lastDump;
+
+    QMutex m_dumpMutex;
+    QWaitCondition m_dumpReady;
+    QQueue<Dump *> m_dumps;
+    QQueue<Dump *> m_freeDumps;
+    bool m_writing; // the writer thread keeps going
+    DumpWriter m_writer;
+};
+
+#endif // FLIGHTRECORDER_H
@@ -0,0 +1,104 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <QPainter>
+#include <QPolygonF>
+
+#include "fragmentationplot.h"
+#include "scenecontroller.h"
+
+#define PLOT_REFRESH_PERIOD 250 // in ms
+
+FragmentationPlot::FragmentationPlot(QWidget *parent) :
+    QWidget(parent)
+{
+    m_scene = 0;
+    m_length = 0;
+
+    m_refreshTimer.setInterval(PLOT_REFRESH_PERIOD);
+    connect(&m_refreshTimer, SIGNAL(timeout()), this, SLOT(update()));
+}
+
+void FragmentationPlot::setScene(SceneController* scene)
+{
+    m_scene = scene;
+
+    if (m_scene)
+        m_refreshTimer.start();
+    else
+        m_refreshTimer.stop();
+
+    update();
+}
+
+void FragmentationPlot::setLength(double length)
+{
+    m_length = length;
+
+    update();
+}
+
+void FragmentationPlot::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+
+    QPainter painter(this);
+
+    painter.fillRect(rect(), QColor(0, 0, 0));
+
+    painter.setPen(QColor(96, 96, 96));
+    painter.drawRect(rect().adjusted(0, 0, -1, -1));
+
+    if (!m_scene)
+        return;
+
+    const QVector<FragmentationSample>& history = m_scene->fragmentationHistory();
+
+    if (history.isEmpty())
+        return;
+
+    double length = (m_length > history.last().position) ? m_length : history.last().position;
+
+    if (length <= 0)
+        length = 1;
+
+    // Both series are percentages, drawn over the same 0-100 scale
+    QPolygonF fragmentation, largestFree;
+    double w = width() - 1, h = height() - 1;
+
+    for (int i = 0; i < history.size(); i++) {
+        double x = (history[i].position / length) * w;
+
+        fragmentation.append(QPointF(x, h - (history[i].fragmentation / 100.0) * h));
+        largestFree.append(QPointF(x, h - (history[i].largestFree / 100.0) * h));
+    }
+
+    painter.setPen(QColor(0, 192, 0));
+    painter.drawPolyline(largestFree);
+
+    painter.setPen(QColor(255, 64, 64));
+    painter.drawPolyline(fragmentation);
+
+    QString legend;
+
+    legend.sprintf("Fragmentation: %.1f%%", history.last().fragmentation);
+    painter.setPen(QColor(255, 64, 64));
+    painter.drawText(rect().adjusted(4, 2, -4, -2), Qt::AlignLeft | Qt::AlignTop, legend);
+
+    legend.sprintf("Largest free block: %.1f%% of the pool", history.last().largestFree);
+    painter.setPen(QColor(0, 192, 0));
+    painter.drawText(rect().adjusted(4, 2, -4, -2), Qt::AlignRight | Qt::AlignTop, legend);
+}
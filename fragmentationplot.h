@@ -0,0 +1,49 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef FRAGMENTATIONPLOT_H
+#define FRAGMENTATIONPLOT_H
+
+#include <QWidget>
+#include <QTimer>
+
+class SceneController;
+
+// Plots the fragmentation and the largest free block of a pool over the
+// timeline, from the samples its scene controller keeps.
+class FragmentationPlot : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit FragmentationPlot(QWidget *parent = 0);
+
+    // 0 plots nothing, the scene must outlive the plot or be unset first
+    void setScene(SceneController* scene);
+
+    // Length of the timeline, 0 follows the samples
+    void setLength(double length);
+
+protected:
+    void paintEvent(QPaintEvent *event);
+
+private:
+    SceneController *m_scene;
+    double m_length;
+
+    QTimer m_refreshTimer;
+};
+
+#endif // FRAGMENTATIONPLOT_H
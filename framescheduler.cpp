@@ -0,0 +1,91 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <QVector>
+
+#include "framescheduler.h"
+#include "scenecontroller.h"
+
+#define DEFAULT_FRAME_BUDGET 16 // in ms, ~60 Hz
+
+FrameScheduler::FrameScheduler(QObject *parent) : QObject(parent)
+{
+    m_timer.setInterval(DEFAULT_FRAME_BUDGET);
+    m_peakMergedEvents = 0;
+
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(tick()));
+}
+
+void FrameScheduler::setFrameBudget(int ms)
+{
+    m_timer.setInterval((ms > 0) ? ms : DEFAULT_FRAME_BUDGET);
+}
+
+void FrameScheduler::start()
+{
+    m_peakMergedEvents = 0;
+    m_timer.start();
+}
+
+void FrameScheduler::stop()
+{
+    m_timer.stop();
+
+    // The scenes are about to go away, forget about them
+    m_dirtyScenes.clear();
+}
+
+void FrameScheduler::invalidate(SceneController *scene, const QRectF& rect)
+{
+    DirtyScene& dirty = m_dirtyScenes[scene];
+
+    dirty.region += rect.toAlignedRect();
+    dirty.events++;
+}
+
+void FrameScheduler::invalidate(SceneController *scene)
+{
+    invalidate(scene, scene->sceneRect());
+}
+
+void FrameScheduler::tick()
+{
+    unsigned int mergedEvents = 0;
+
+    // Let the producers apply whatever they have pending for this frame
+    emit frameStarted();
+
+    if (m_dirtyScenes.isEmpty())
+        return;
+
+    QHash<SceneController *, DirtyScene>::iterator it;
+
+    for (it = m_dirtyScenes.begin(); it != m_dirtyScenes.end(); ++it) {
+        QVector<QRect> rects = it.value().region.rects();
+
+        for (int i = 0; i < rects.size(); i++)
+            it.key()->update(rects[i]);
+
+        mergedEvents += it.value().events;
+    }
+
+    m_dirtyScenes.clear();
+
+    if (m_peakMergedEvents < mergedEvents)
+        m_peakMergedEvents = mergedEvents;
+
+    emit frameStatistics(mergedEvents, m_peakMergedEvents);
+}
@@ -0,0 +1,65 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QHash>
+#include <QRegion>
+
+class SceneController;
+
+// Collects the regions dirtied by allocation events and repaints them once
+// per display frame, instead of updating the whole scene for every event.
+class FrameScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FrameScheduler(QObject *parent = 0);
+
+    void setFrameBudget(int ms);
+    int frameBudget() const { return m_timer.interval(); }
+
+    void start();
+    void stop();
+
+    void invalidate(SceneController *scene, const QRectF& rect);
+    void invalidate(SceneController *scene);
+
+signals:
+    void frameStarted();
+    void frameStatistics(unsigned int mergedEvents, unsigned int peakMergedEvents);
+
+private slots:
+    void tick();
+
+private:
+    struct DirtyScene {
+        DirtyScene() : events(0) {}
+
+        QRegion region;
+        unsigned int events;
+    };
+
+    QTimer m_timer;
+    QHash<SceneController *, DirtyScene> m_dirtyScenes;
+
+    unsigned int m_peakMergedEvents;
+};
+
+#endif // FRAMESCHEDULER_H
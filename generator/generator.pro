@@ -0,0 +1,23 @@
+#-------------------------------------------------
+#
+# Synthetic DirectFB tracing stream generator, drives
+# the viewer without a DirectFB target.
+#
+#-------------------------------------------------
+
+CONFIG   += console
+CONFIG   -= qt app_bundle
+
+TARGET = dfbperf-generate
+TEMPLATE = app
+
+SOURCES += main.cpp \
+    ../tracetimestamps.cpp
+
+HEADERS += \
+    ../tracetimestamps.h
+
+INCLUDEPATH += ..
+INCLUDEPATH += /home/ilyes/DirectFB-git/src
+INCLUDEPATH += /home/ilyes/DirectFB-git/include
+INCLUDEPATH += /home/ilyes/DirectFB-git/lib
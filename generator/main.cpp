@@ -0,0 +1,796 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// dfbperf-generate: emits synthetic DirectFB tracing streams, so that the
+// viewer can be stress-tested without a DirectFB target. Surfaces are
+// placed by a model of the pool allocator, packets go to a UDP port or
+// to a trace file, with optional induced loss and reordering. The same
+// seed always produces the same stream.
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <directfb.h>
+
+#include <core/remote_tracing.h>
+
+#include "tracetimestamps.h"
+
+#define MIN_BLOCK_ORDER 12 // 4 KB
+#define SEND_BATCH 32
+
+static unsigned long long monotonicUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000);
+}
+
+// Deterministic across platforms, unlike rand()
+static unsigned int random32(unsigned long long& state)
+{
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+
+    return (unsigned int)(state >> 33);
+}
+
+static bool chance(unsigned long long& state, unsigned int percent)
+{
+    return percent && ((random32(state) % 100) < percent);
+}
+
+class AllocatorModel
+{
+public:
+    virtual ~AllocatorModel() {}
+
+    // Size actually taken from the pool for a request of size bytes
+    virtual unsigned int roundSize(unsigned int size) const { return size; }
+
+    virtual bool allocate(unsigned int size, unsigned int& offset) = 0;
+    virtual void release(unsigned int offset, unsigned int size) = 0;
+};
+
+// First fit over a free list, released ranges are coalesced
+class ChurnModel : public AllocatorModel
+{
+public:
+    ChurnModel(unsigned int poolSize)
+    {
+        m_free[0] = poolSize;
+    }
+
+    unsigned int roundSize(unsigned int size) const
+    {
+        return (size + 4095) & ~4095;
+    }
+
+    bool allocate(unsigned int size, unsigned int& offset)
+    {
+        std::map<unsigned int, unsigned int>::iterator it;
+
+        for (it = m_free.begin(); it != m_free.end(); ++it) {
+            if (it->second < size)
+                continue;
+
+            offset = it->first;
+
+            if (it->second > size)
+                m_free[offset + size] = it->second - size;
+
+            m_free.erase(it);
+            return true;
+        }
+
+        return false;
+    }
+
+    void release(unsigned int offset, unsigned int size)
+    {
+        std::map<unsigned int, unsigned int>::iterator it = m_free.insert(std::make_pair(offset, size)).first;
+        std::map<unsigned int, unsigned int>::iterator next = it;
+
+        if ((++next != m_free.end()) && ((it->first + it->second) == next->first)) {
+            it->second += next->second;
+            m_free.erase(next);
+        }
+
+        if (it != m_free.begin()) {
+            std::map<unsigned int, unsigned int>::iterator prev = it;
+
+            if (((--prev)->first + prev->second) == it->first) {
+                prev->second += it->second;
+                m_free.erase(it);
+            }
+        }
+    }
+
+private:
+    std::map<unsigned int, unsigned int> m_free; // offset -> size
+};
+
+// Binary buddy allocator over the largest power of two fitting the pool
+class BuddyModel : public AllocatorModel
+{
+public:
+    BuddyModel(unsigned int poolSize)
+    {
+        m_maxOrder = MIN_BLOCK_ORDER;
+
+        while ((m_maxOrder < 31) && ((1U << (m_maxOrder + 1)) <= poolSize))
+            m_maxOrder++;
+
+        m_free.resize(m_maxOrder + 1);
+        m_free[m_maxOrder].insert(0);
+    }
+
+    unsigned int roundSize(unsigned int size) const
+    {
+        return 1U << order(size);
+    }
+
+    bool allocate(unsigned int size, unsigned int& offset)
+    {
+        unsigned int wanted = order(size), o = wanted;
+
+        while ((o <= m_maxOrder) && m_free[o].empty())
+            o++;
+
+        if (o > m_maxOrder)
+            return false;
+
+        offset = *m_free[o].begin();
+        m_free[o].erase(m_free[o].begin());
+
+        // Split down, keeping the lower half and freeing the upper one
+        while (o > wanted) {
+            o--;
+            m_free[o].insert(offset + (1U << o));
+        }
+
+        return true;
+    }
+
+    void release(unsigned int offset, unsigned int size)
+    {
+        unsigned int o = order(size);
+
+        while (o < m_maxOrder) {
+            unsigned int buddy = offset ^ (1U << o);
+
+            if (!m_free[o].erase(buddy))
+                break;
+
+            offset &= ~(1U << o);
+            o++;
+        }
+
+        m_free[o].insert(offset);
+    }
+
+private:
+    unsigned int order(unsigned int size) const
+    {
+        unsigned int o = MIN_BLOCK_ORDER;
+
+        while ((1U << o) < size)
+            o++;
+
+        return o;
+    }
+
+    unsigned int m_maxOrder;
+    std::vector<std::set<unsigned int> > m_free;
+};
+
+// The pool is split in equal regions, each one carved in slots of a
+// single size class
+class SlabModel : public AllocatorModel
+{
+public:
+    SlabModel(unsigned int poolSize)
+    {
+        static const unsigned int classes[] = { 16 << 10, 64 << 10, 256 << 10, 1 << 20, 4 << 20, 8 << 20 };
+        unsigned int count = 0;
+
+        for (unsigned int i = 0; i < sizeof(classes) / sizeof(classes[0]); i++) {
+            if (classes[i] <= (poolSize / 8))
+                count++;
+        }
+
+        unsigned int region = count ? (poolSize / count) : 0;
+
+        for (unsigned int i = 0; i < count; i++) {
+            Slab slab;
+
+            slab.size = classes[i];
+
+            for (unsigned int slot = (region / classes[i]); slot > 0; slot--)
+                slab.free.push_back((i * region) + ((slot - 1) * classes[i]));
+
+            m_slabs.push_back(slab);
+        }
+    }
+
+    unsigned int roundSize(unsigned int size) const
+    {
+        for (unsigned int i = 0; i < m_slabs.size(); i++) {
+            if (m_slabs[i].size >= size)
+                return m_slabs[i].size;
+        }
+
+        return 0;
+    }
+
+    bool allocate(unsigned int size, unsigned int& offset)
+    {
+        for (unsigned int i = 0; i < m_slabs.size(); i++) {
+            if ((m_slabs[i].size != size) || m_slabs[i].free.empty())
+                continue;
+
+            offset = m_slabs[i].free.back();
+            m_slabs[i].free.pop_back();
+            return true;
+        }
+
+        return false;
+    }
+
+    void release(unsigned int offset, unsigned int size)
+    {
+        for (unsigned int i = 0; i < m_slabs.size(); i++) {
+            if (m_slabs[i].size == size)
+                m_slabs[i].free.push_back(offset);
+        }
+    }
+
+private:
+    struct Slab {
+        unsigned int size;
+        std::vector<unsigned int> free;
+    };
+
+    std::vector<Slab> m_slabs;
+};
+
+struct Surface {
+    unsigned int offset;
+    unsigned int size;
+    int width;
+    int height;
+    DFBSurfacePixelFormat format;
+};
+
+struct Pool {
+    unsigned int id;
+    unsigned int size;
+    unsigned int allocated;
+    AllocatorModel *model;
+    std::vector<Surface> surfaces;
+};
+
+struct Format {
+    const char* name;
+    DFBSurfacePixelFormat format;
+};
+
+static const Format formats[] = {
+    { "ARGB", DSPF_ARGB },
+    { "RGB32", DSPF_RGB32 },
+    { "RGB16", DSPF_RGB16 },
+    { "YUY2", DSPF_YUY2 },
+    { "NV12", DSPF_NV12 },
+    { "A8", DSPF_A8 },
+    { "LUT8", DSPF_LUT8 }
+};
+
+static const int dimensions[][2] = {
+    { 32, 32 }, { 64, 64 }, { 128, 128 }, { 256, 256 }, { 320, 240 },
+    { 640, 480 }, { 720, 576 }, { 1280, 720 }, { 1920, 1080 }
+};
+
+class Output
+{
+public:
+    Output()
+    {
+        m_socket = -1;
+        m_trace = NULL;
+        m_count = 0;
+
+        sent = 0;
+    }
+
+    ~Output()
+    {
+        flush();
+
+        if (m_socket >= 0)
+            close(m_socket);
+
+        if (m_trace)
+            fclose(m_trace);
+    }
+
+    bool openUdp(const char* target)
+    {
+        std::string host(target);
+        std::string::size_type colon = host.rfind(':');
+        struct sockaddr_in addrIn;
+
+        if (colon == std::string::npos)
+            return false;
+
+        memset(&addrIn, 0, sizeof(addrIn));
+
+        addrIn.sin_family = AF_INET;
+        addrIn.sin_port = htons(atoi(host.c_str() + colon + 1));
+
+        host.resize(colon);
+
+        struct hostent *entry = gethostbyname(host.c_str());
+
+        if (!entry)
+            return false;
+
+        memcpy(&addrIn.sin_addr, entry->h_addr_list[0], sizeof(addrIn.sin_addr));
+
+        m_socket = socket(AF_INET, SOCK_DGRAM, 0);
+
+        if (m_socket < 0)
+            return false;
+
+        return connect(m_socket, (const sockaddr*)&addrIn, sizeof(addrIn)) == 0;
+    }
+
+    bool openTrace(const char* name)
+    {
+        m_trace = fopen(name, "wb");
+
+        if (!m_trace)
+            return false;
+
+        // Lets the viewer play the trace back with its real timing
+        return m_timestamps.open(name);
+    }
+
+    void write(const DFBTracingPacket& packet)
+    {
+        m_times[m_count] = monotonicUs() * 1000;
+        m_packets[m_count++] = packet;
+
+        if (m_count == SEND_BATCH)
+            flush();
+    }
+
+    void flush()
+    {
+        if (!m_count)
+            return;
+
+        if (m_trace) {
+            // Traces are made of fixed-size records, padded past header.size
+            sent += fwrite(m_packets, sizeof(DFBTracingPacket), m_count, m_trace);
+
+            m_timestamps.write(m_times, m_count);
+        } else if (m_socket >= 0) {
+            struct mmsghdr msgs[SEND_BATCH];
+            struct iovec iovs[SEND_BATCH];
+
+            memset(msgs, 0, sizeof(msgs));
+
+            for (unsigned int i = 0; i < m_count; i++) {
+                iovs[i].iov_base = &m_packets[i];
+                iovs[i].iov_len = sizeof(DFBTracingPacketHeader) + m_packets[i].header.size;
+
+                msgs[i].msg_hdr.msg_iov = &iovs[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+
+            int n = sendmmsg(m_socket, msgs, m_count, 0);
+
+            if (n > 0)
+                sent += n;
+        }
+
+        m_count = 0;
+    }
+
+    unsigned long long sent;
+
+private:
+    int m_socket;
+    FILE *m_trace;
+    TraceTimestampWriter m_timestamps;
+
+    DFBTracingPacket m_packets[SEND_BATCH];
+    unsigned long long m_times[SEND_BATCH]; // in ns
+    unsigned int m_count;
+};
+
+class Generator
+{
+public:
+    Generator(Output* output, unsigned long long seed)
+    {
+        m_output = output;
+        m_random = seed;
+
+        m_nSeq = 0;
+        m_hasHeld = false;
+
+        lossPercent = reorderPercent = 0;
+
+        lost = reordered = snapshots = skippedSnapshots = 0;
+    }
+
+    void allocate(Pool& pool, const std::vector<DFBSurfacePixelFormat>& formats)
+    {
+        Surface surface;
+
+        // Pick a surface shape, the model decides how much it really takes
+        unsigned int d = random32(m_random) % (sizeof(dimensions) / sizeof(dimensions[0]));
+
+        surface.width = dimensions[d][0];
+        surface.height = dimensions[d][1];
+        surface.format = formats[random32(m_random) % formats.size()];
+
+        unsigned long long bytes = ((unsigned long long)surface.width * surface.height * DFB_BITS_PER_PIXEL(surface.format)) / 8;
+
+        surface.size = pool.model->roundSize(bytes);
+
+        if (!surface.size || (surface.size > pool.size) || !pool.model->allocate(surface.size, surface.offset)) {
+            // Out of space: churn instead
+            release(pool);
+            return;
+        }
+
+        pool.surfaces.push_back(surface);
+        pool.allocated += surface.size;
+
+        DFBTracingPacket packet;
+
+        memset(&packet, 0, sizeof(packet));
+
+        packet.header.type = DTE_POOL_BUFFER_ALLOCATION;
+        packet.header.size = sizeof(packet.Payload);
+
+        fill(&packet.Payload.buffer, pool, surface);
+
+        emitPacket(packet);
+    }
+
+    void release(Pool& pool)
+    {
+        if (pool.surfaces.empty())
+            return;
+
+        unsigned int i = random32(m_random) % pool.surfaces.size();
+        Surface surface = pool.surfaces[i];
+
+        pool.surfaces[i] = pool.surfaces.back();
+        pool.surfaces.pop_back();
+
+        pool.model->release(surface.offset, surface.size);
+        pool.allocated -= surface.size;
+
+        DFBTracingPacket packet;
+
+        memset(&packet, 0, sizeof(packet));
+
+        packet.header.type = DTE_POOL_BUFFER_RELEASE;
+        packet.header.size = sizeof(packet.Payload);
+
+        fill(&packet.Payload.buffer, pool, surface);
+
+        emitPacket(packet);
+    }
+
+    // Live surfaces a single snapshot packet can describe
+    static unsigned int snapshotCapacity()
+    {
+        return sizeof(((DFBTracingPoolData*)0)->stats) / sizeof(DFBTracingBufferData);
+    }
+
+    void snapshot(Pool& pool)
+    {
+        DFBTracingPacket packet;
+
+        // The viewer resets the pool on each snapshot packet, so a pool
+        // state that doesn't fit in one can't be sent
+        if (pool.surfaces.empty() || (pool.surfaces.size() > snapshotCapacity())) {
+            skippedSnapshots++;
+            return;
+        }
+
+        memset(&packet, 0, sizeof(packet));
+
+        packet.header.type = DTE_POOL_FULL_SNAPSHOT;
+        packet.header.size = offsetof(DFBTracingPoolData, stats) + pool.surfaces.size() * sizeof(DFBTracingBufferData);
+
+        packet.Payload.pool.count = pool.surfaces.size();
+
+        for (unsigned int i = 0; i < pool.surfaces.size(); i++)
+            fill(&packet.Payload.pool.stats[i], pool, pool.surfaces[i]);
+
+        emitPacket(packet);
+        snapshots++;
+    }
+
+    void finish()
+    {
+        if (m_hasHeld) {
+            m_output->write(m_held);
+            m_hasHeld = false;
+        }
+
+        m_output->flush();
+    }
+
+    unsigned int random() { return random32(m_random); }
+
+    unsigned int packets() const { return m_nSeq; }
+
+    unsigned int lossPercent, reorderPercent;
+
+    unsigned long long lost, reordered, snapshots, skippedSnapshots;
+
+private:
+    void fill(DFBTracingBufferData* data, const Pool& pool, const Surface& surface)
+    {
+        data->poolId = pool.id;
+        data->poolSize = pool.size;
+        data->offset = surface.offset;
+        data->size = surface.size;
+        data->width = surface.width;
+        data->height = surface.height;
+        data->format = surface.format;
+
+        snprintf(data->name, sizeof(data->name), "synthetic pool %u", pool.id);
+    }
+
+    void emitPacket(DFBTracingPacket& packet)
+    {
+        packet.header.nSeq = m_nSeq++;
+
+        // Numbered but never sent, the viewer sees a gap
+        if (chance(m_random, lossPercent)) {
+            lost++;
+            return;
+        }
+
+        if (m_hasHeld) {
+            // The held packet goes out right after its successor
+            m_output->write(packet);
+            m_output->write(m_held);
+
+            m_hasHeld = false;
+            reordered++;
+        } else if (chance(m_random, reorderPercent)) {
+            m_held = packet;
+            m_hasHeld = true;
+        } else
+            m_output->write(packet);
+    }
+
+    Output *m_output;
+    unsigned long long m_random;
+
+    unsigned int m_nSeq;
+
+    DFBTracingPacket m_held;
+    bool m_hasHeld;
+};
+
+static void usage(const char* program)
+{
+    fprintf(stderr, "usage: %s [options] -u host:port | -o trace\n", program);
+    fprintf(stderr, "  -m model     allocator model: churn, buddy or slab (default churn)\n");
+    fprintf(stderr, "  -p pools     number of pools (default 1)\n");
+    fprintf(stderr, "  -s size      pool size in MB (default 64)\n");
+    fprintf(stderr, "  -f formats   pixel formats, e.g. ARGB,RGB16,YUY2,NV12 (default ARGB,RGB16)\n");
+    fprintf(stderr, "  -r rate      events per second, 0 for as fast as possible (default 10000)\n");
+    fprintf(stderr, "  -n events    number of events (default 1000000)\n");
+    fprintf(stderr, "  -S interval  snapshot every pool each interval events (default 0, never),\n");
+    fprintf(stderr, "               best effort: pools then keep at most %u live surfaces so that\n", Generator::snapshotCapacity());
+    fprintf(stderr, "               a snapshot fits in one packet, empty pools are skipped\n");
+    fprintf(stderr, "  -L percent   induced packet loss (default 0)\n");
+    fprintf(stderr, "  -R percent   induced reordering, UDP only (default 0)\n");
+    fprintf(stderr, "  -x seed      random seed (default 1)\n");
+}
+
+static AllocatorModel* createModel(const char* name, unsigned int poolSize)
+{
+    if (!strcmp(name, "churn"))
+        return new ChurnModel(poolSize);
+
+    if (!strcmp(name, "buddy"))
+        return new BuddyModel(poolSize);
+
+    if (!strcmp(name, "slab"))
+        return new SlabModel(poolSize);
+
+    return NULL;
+}
+
+static bool parseFormats(const char* list, std::vector<DFBSurfacePixelFormat>& result)
+{
+    std::string names(list);
+    std::string::size_type start = 0;
+
+    while (start <= names.size()) {
+        std::string::size_type end = names.find(',', start);
+        std::string name = names.substr(start, (end == std::string::npos) ? std::string::npos : (end - start));
+        unsigned int i;
+
+        for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+            if (name == formats[i].name) {
+                result.push_back(formats[i].format);
+                break;
+            }
+        }
+
+        if (i == sizeof(formats) / sizeof(formats[0]))
+            return false;
+
+        if (end == std::string::npos)
+            break;
+
+        start = end + 1;
+    }
+
+    return !result.empty();
+}
+
+int main(int argc, char *argv[])
+{
+    const char* modelName = "churn";
+    const char* formatList = "ARGB,RGB16";
+    const char* udpTarget = NULL;
+    const char* traceName = NULL;
+
+    unsigned int poolCount = 1, poolSize = 64;
+    unsigned int rate = 10000, events = 1000000, snapshotInterval = 0;
+    unsigned int lossPercent = 0, reorderPercent = 0;
+    unsigned long long seed = 1;
+    int c;
+
+    while ((c = getopt(argc, argv, "m:p:s:f:r:n:S:L:R:x:u:o:h")) != -1) {
+        switch (c) {
+        case 'm': modelName = optarg; break;
+        case 'p': poolCount = strtoul(optarg, NULL, 0); break;
+        case 's': poolSize = strtoul(optarg, NULL, 0); break;
+        case 'f': formatList = optarg; break;
+        case 'r': rate = strtoul(optarg, NULL, 0); break;
+        case 'n': events = strtoul(optarg, NULL, 0); break;
+        case 'S': snapshotInterval = strtoul(optarg, NULL, 0); break;
+        case 'L': lossPercent = strtoul(optarg, NULL, 0); break;
+        case 'R': reorderPercent = strtoul(optarg, NULL, 0); break;
+        case 'x': seed = strtoull(optarg, NULL, 0); break;
+        case 'u': udpTarget = optarg; break;
+        case 'o': traceName = optarg; break;
+        default:
+            usage(argv[0]);
+            return (c == 'h') ? 0 : 1;
+        }
+    }
+
+    if ((!udpTarget == !traceName) || !poolCount || !poolSize || (poolSize > 4095)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Nothing puts a trace back in order, every swap would read as two lost packets
+    if (reorderPercent && traceName) {
+        fprintf(stderr, "%s: -R only applies to -u, traces are played in file order\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<DFBSurfacePixelFormat> pixelFormats;
+
+    if (!parseFormats(formatList, pixelFormats)) {
+        fprintf(stderr, "%s: unknown pixel format in %s\n", argv[0], formatList);
+        return 1;
+    }
+
+    Output output;
+
+    if (udpTarget ? !output.openUdp(udpTarget) : !output.openTrace(traceName)) {
+        fprintf(stderr, "%s: can't open %s\n", argv[0], udpTarget ? udpTarget : traceName);
+        return 1;
+    }
+
+    std::vector<Pool> pools(poolCount);
+
+    for (unsigned int i = 0; i < poolCount; i++) {
+        pools[i].id = i + 1;
+        pools[i].size = poolSize << 20;
+        pools[i].allocated = 0;
+        pools[i].model = createModel(modelName, pools[i].size);
+
+        if (!pools[i].model) {
+            fprintf(stderr, "%s: unknown allocator model %s\n", argv[0], modelName);
+            return 1;
+        }
+    }
+
+    Generator generator(&output, seed);
+
+    generator.lossPercent = lossPercent;
+    generator.reorderPercent = reorderPercent;
+
+    unsigned long long start = monotonicUs();
+
+    for (unsigned int e = 0; e < events; e++) {
+        Pool& pool = pools[generator.random() % poolCount];
+
+        // Hover around 70% usage, the allocator model shapes the fragmentation
+        unsigned int usage = (unsigned int)(((unsigned long long)pool.allocated * 100) / pool.size);
+        unsigned int allocatePercent = pool.surfaces.empty() ? 100 : ((usage < 70) ? 60 : 35);
+
+        // Snapshots have to fit in one packet, churn within what it holds
+        if (snapshotInterval && (pool.surfaces.size() >= Generator::snapshotCapacity()))
+            allocatePercent = 0;
+
+        if ((generator.random() % 100) < allocatePercent)
+            generator.allocate(pool, pixelFormats);
+        else
+            generator.release(pool);
+
+        if (snapshotInterval && !((e + 1) % snapshotInterval)) {
+            for (unsigned int i = 0; i < poolCount; i++)
+                generator.snapshot(pools[i]);
+        }
+
+        if (rate && !((e + 1) % 64)) {
+            unsigned long long due = start + ((e + 1) * 1000000ULL) / rate;
+            unsigned long long now = monotonicUs();
+
+            if (due > now)
+                usleep(due - now);
+        }
+    }
+
+    generator.finish();
+
+    double elapsed = (monotonicUs() - start) / 1000000.0;
+
+    printf("%u packets, %llu sent, %llu lost, %llu reordered, %llu snapshots (%llu skipped)\n",
+           generator.packets(), output.sent, generator.lost, generator.reordered,
+           generator.snapshots, generator.skippedSnapshots);
+    printf("%.2f s, %.0f packets per second\n", elapsed, elapsed ? (generator.packets() / elapsed) : 0.0);
+
+    for (unsigned int i = 0; i < poolCount; i++)
+        delete pools[i].model;
+
+    return 0;
+}
@@ -25,6 +25,7 @@
 #include <assert.h>
 
 #include "allocationrendercontroller.h"
+#include "simulationscenecontroller.h"
 #include "rendertarget.h"
 
 #define UNUSED_PARAM(a) (a) = (a)
@@ -39,7 +40,11 @@ MainWindow::MainWindow(QWidget *parent) :
 
     m_vboxLayout = new QVBoxLayout();
 
+    m_fragmentationPlot = new FragmentationPlot();
+    m_fragmentationPlot->setFixedHeight(80);
+
     m_vboxLayout->addWidget(ui->tabWidget);
+    m_vboxLayout->addWidget(m_fragmentationPlot);
     m_vboxLayout->addWidget(ui->label);
 
     ui->centralwidget->setLayout(m_vboxLayout);
@@ -68,6 +73,47 @@ MainWindow::MainWindow(QWidget *parent) :
     m_saveToFileAction->setCheckable(true);
     connect(m_saveToFileAction, SIGNAL(triggered()), this, SLOT(saveToFile()));
 
+    action = m_traceMenu->addAction("Trace &rotation...");
+    connect(action, SIGNAL(triggered()), this, SLOT(setTraceRotation()));
+
+    action = m_traceMenu->addAction("Reorder &window...");
+    connect(action, SIGNAL(triggered()), this, SLOT(setReorderWindow()));
+
+    action = m_traceMenu->addAction("Seek &history...");
+    connect(action, SIGNAL(triggered()), this, SLOT(setSeekHistory()));
+
+    action = m_traceMenu->addAction("&Index a trace...");
+    connect(action, SIGNAL(triggered()), this, SLOT(indexTrace()));
+
+    action = m_traceMenu->addAction("F&light recorder...");
+    connect(action, SIGNAL(triggered()), this, SLOT(setFlightRecorder()));
+
+    action = m_traceMenu->addAction("Dump the flight re&corder");
+    connect(action, SIGNAL(triggered()), this, SLOT(dumpFlightRecorder()));
+
+    action = m_traceMenu->addAction("&Frame budget...");
+    connect(action, SIGNAL(triggered()), this, SLOT(setFrameBudget()));
+
+    m_occupancyMapAction = m_traceMenu->addAction("&Occupancy map rendering");
+    m_occupancyMapAction->setCheckable(true);
+    connect(m_occupancyMapAction, SIGNAL(triggered()), this, SLOT(setRenderMode()));
+
+    m_simulationAction = m_traceMenu->addAction("Allocator &what-if rendering");
+    m_simulationAction->setCheckable(true);
+    connect(m_simulationAction, SIGNAL(triggered()), this, SLOT(setRenderMode()));
+
+    action = m_traceMenu->addAction("Dump allocator &simulation...");
+    connect(action, SIGNAL(triggered()), this, SLOT(dumpSimulation()));
+
+    m_traceMenu->addSeparator();
+
+    m_pipelineStatisticsAction = m_traceMenu->addAction("&Pipeline statistics");
+    m_pipelineStatisticsAction->setCheckable(true);
+    connect(m_pipelineStatisticsAction, SIGNAL(triggered()), this, SLOT(showPipelineStatistics()));
+
+    action = m_traceMenu->addAction("&Dump pipeline statistics...");
+    connect(action, SIGNAL(triggered()), this, SLOT(dumpPipelineStatistics()));
+
     action = m_helpMenu->addAction("&?");
     connect(action, SIGNAL(triggered()), this, SLOT(about()));
 
@@ -76,8 +122,22 @@ MainWindow::MainWindow(QWidget *parent) :
     m_playbackTraceAction->setEnabled(true);
 
     m_renderController = 0;
+    m_frameBudget = 16;
+
+    m_rotationSize = 0;
+    m_rotationInterval = 0;
+
+    m_reorderPackets = 64;
+    m_reorderTime = 20;
 
-    qRegisterMetaType<DFBTracingPacket>("DFBTracingPacket");
+    m_checkpointInterval = DEFAULT_CHECKPOINT_INTERVAL;
+    m_historyMemory = DEFAULT_HISTORY_MEMORY;
+
+    m_flightSize = 0;
+    m_flightDuration = 60;
+    m_flightUsage = 90;
+    m_flightLargestFree = 0;
+    m_flightLostPackets = 100;
 }
 
 MainWindow::~MainWindow()
@@ -97,7 +157,8 @@ void MainWindow::connectToServer()
     QInputDialog *input = new QInputDialog(this);
 
     QString result = input->getText(this, "Local port",
-                                          "Please enter the local UDP port",
+                                          "Please enter the local UDP port(s), e.g. 127.0.0.1:5000,5001,\n"
+                                          "or shm:<name> for a shared memory ring on this host",
                                           QLineEdit::Normal,
                                           "127.0.0.1:5000", &ok);
 
@@ -106,8 +167,21 @@ void MainWindow::connectToServer()
     if (!ok || result.isEmpty())
         return;
 
+    // The traced process writes straight into our memory
+    if (result.startsWith("shm:")) {
+        m_renderController = new AllocationRenderController(QString(), 0, false);
+        m_renderController->setTransport(AllocationRenderController::TRANSPORT_SHM, result.section(':', 1));
+        m_renderController->setFrameBudget(m_frameBudget);
+
+        setupLiveController();
+        return;
+    }
+
     serverIpAddr = result.section(':', 0, 0);
-    serverPort = result.section(':', 1, 1).toInt(&ok);
+
+    QStringList ports = result.section(':', 1, 1).split(",", QString::SkipEmptyParts);
+
+    serverPort = ports.isEmpty() ? 0 : ports.takeFirst().toInt(&ok);
 
     if (!ok)
         serverPort = 5555;
@@ -116,11 +190,29 @@ void MainWindow::connectToServer()
     if (list.length() != 4)
         return;
 
-    m_renderController = new AllocationRenderController(serverIpAddr, serverPort, m_saveToFileAction->isChecked());
+    m_renderController = new AllocationRenderController(serverIpAddr, serverPort, false);
+    m_renderController->setFrameBudget(m_frameBudget);
+
+    for (int i = 0; i < ports.size(); i++)
+        m_renderController->addListenPort(ports[i].toInt());
+
+    setupLiveController();
+}
+
+void MainWindow::setupLiveController()
+{
+    setRenderMode();
 
     connect(m_renderController, SIGNAL(newSurfacePool(SceneController*, char*)), this, SLOT(newRenderTarget(SceneController*, char*)));
     connect(m_renderController, SIGNAL(missingInformation(unsigned int)), this, SLOT(missingInformation(unsigned int)));
     connect(m_renderController, SIGNAL(lostPackets(unsigned int, unsigned int)), this, SLOT(lostPackets(unsigned int, unsigned int)));
+    connect(m_renderController, SIGNAL(receiveStatistics(unsigned int, unsigned int, unsigned int, unsigned int, unsigned int)),
+            this, SLOT(receiveStatistics(unsigned int, unsigned int, unsigned int, unsigned int, unsigned int)));
+    connect(m_renderController, SIGNAL(senderStatistics(QString)), this, SLOT(senderStatistics(QString)));
+    connect(m_renderController, SIGNAL(droppedEvents(unsigned int)), this, SLOT(droppedEvents(unsigned int)));
+    connect(m_renderController, SIGNAL(recorderStatistics(unsigned int, unsigned int, unsigned int)), this, SLOT(recorderStatistics(unsigned int, unsigned int, unsigned int)));
+    connect(m_renderController, SIGNAL(recorderRotationFailed(QString)), this, SLOT(recorderRotationFailed(QString)));
+    connect(m_renderController, SIGNAL(frameStatistics(unsigned int, unsigned int)), this, SLOT(frameStatistics(unsigned int, unsigned int)));
     connect(m_renderController, SIGNAL(finished()), this, SLOT(finished()));
 
     connect(ui->tabWidget, SIGNAL(currentChanged(int)), this, SLOT(tabChanged(int)));
@@ -130,7 +222,27 @@ void MainWindow::connectToServer()
     m_playbackTraceAction->setEnabled(false);
 
     m_lostPackets = 0;
+    m_droppedEvents = 0;
     m_connectedSender = 0;
+    m_receiveStatus.clear();
+    m_senderStatus.clear();
+
+    m_recorderStatus.clear();
+    m_rotationStatus.clear();
+    m_flightStatus.clear();
+
+    connect(m_renderController, SIGNAL(flightRecorderDumped(QString, QString)), this, SLOT(flightRecorderDumped(QString, QString)));
+    connect(m_renderController, SIGNAL(flightRecorderDumpFailed(QString)), this, SLOT(flightRecorderDumpFailed(QString)));
+
+    m_renderController->setFlightRecorder(m_flightSize, m_flightDuration, m_flightUsage,
+                                          m_flightLargestFree * 1024, m_flightLostPackets);
+
+    // Configure the recorder before it starts
+    m_renderController->setTraceRotation(m_rotationSize, m_rotationInterval);
+    m_renderController->saveTraceToFile(m_saveToFileAction->isChecked());
+
+    m_renderController->setReorderWindow(m_reorderPackets, m_reorderTime);
+    m_renderController->pipelineStats()->setEnabled(m_pipelineStatisticsAction->isChecked());
 
     ui->label->setText("Initializing...");
     m_renderController->connect();
@@ -146,11 +258,15 @@ void MainWindow::playbackTrace()
     if (!traceName.length())
         return;
 
-    m_renderController = new AllocationRenderController(traceName, 240);
+    m_renderController = new AllocationRenderController(traceName, 1.0);
+    m_renderController->setFrameBudget(m_frameBudget);
+    m_renderController->setHistoryCheckpointing(m_checkpointInterval, m_historyMemory);
+    setRenderMode();
 
-    connect(m_renderController, SIGNAL(newRenderTarget(SceneController*, char*)), this, SLOT(newRenderTarget(SceneController*, char*)));
+    connect(m_renderController, SIGNAL(newSurfacePool(SceneController*, char*)), this, SLOT(newRenderTarget(SceneController*, char*)));
     connect(m_renderController, SIGNAL(missingInformation(unsigned int)), this, SLOT(missingInformation(unsigned int)));
     connect(m_renderController, SIGNAL(lostPackets(unsigned int, unsigned int)), this, SLOT(lostPackets(unsigned int, unsigned int)));
+    connect(m_renderController, SIGNAL(frameStatistics(unsigned int, unsigned int)), this, SLOT(frameStatistics(unsigned int, unsigned int)));
     connect(m_renderController, SIGNAL(finished()), this, SLOT(finished()));
 
     connect(ui->tabWidget, SIGNAL(currentChanged(int)), this, SLOT(tabChanged(int)));
@@ -162,10 +278,27 @@ void MainWindow::playbackTrace()
     m_lostPackets = 0;
     m_connectedSender = 0;
 
+    m_renderController->pipelineStats()->setEnabled(m_pipelineStatisticsAction->isChecked());
+
     ui->label->setText("Initializing...");
     m_renderController->renderTrace();
 }
 
+void MainWindow::indexTrace()
+{
+    QString traceName = QFileDialog::getOpenFileName(this, "Select a trace to index:");
+
+    if (!traceName.length())
+        return;
+
+    ui->label->setText("Indexing...");
+
+    if (TraceIndexWriter::build(traceName.toStdString().c_str()))
+        ui->label->setText("Trace indexed.");
+    else
+        ui->label->setText("Failed to index the trace.");
+}
+
 void MainWindow::newRenderTarget(SceneController* scene, char* name)
 {
     char buf[256];
@@ -179,7 +312,10 @@ void MainWindow::newRenderTarget(SceneController* scene, char* name)
 
     renderTarget->setFixedSize(ui->tabWidget->size().width(), ui->tabWidget->size().height());
     renderTarget->setAlignment(Qt::AlignTop);
-    renderTarget->setViewportUpdateMode(QGraphicsView::FullViewportUpdate);
+    renderTarget->setViewportUpdateMode(QGraphicsView::SmartViewportUpdate);
+
+    renderTarget->setPipelineStats(m_renderController->pipelineStats());
+    renderTarget->setOverlayVisible(m_pipelineStatisticsAction->isChecked());
 
     if (m_connectedSender) {
         ret = disconnect(m_connectedSender, SIGNAL(statusChanged()), this, SLOT(statusChanged()));
@@ -191,6 +327,9 @@ void MainWindow::newRenderTarget(SceneController* scene, char* name)
 
     m_connectedSender = scene;
 
+    m_fragmentationPlot->setLength(m_renderController->timelineLength());
+    m_fragmentationPlot->setScene(scene);
+
     int idx = ui->tabWidget->addTab(renderTarget, name);
     ui->tabWidget->setCurrentIndex(idx);
 
@@ -202,6 +341,9 @@ void MainWindow::stop()
 {
     if (m_renderController)
     {
+        // The scenes go away with the controller
+        m_fragmentationPlot->setScene(0);
+
         m_renderController->disconnect();
 
         int count = ui->tabWidget->count();
@@ -232,6 +374,49 @@ void MainWindow::lostPackets(unsigned int lastValidNseq, unsigned int expectedNs
     updateStatus();
 }
 
+void MainWindow::receiveStatistics(unsigned int packets, unsigned int syscalls, unsigned int kernelDrops,
+                                   unsigned int reordered, unsigned int late)
+{
+    m_receiveStatus.sprintf("Packets per syscall: %.1f, Lost packets: %d, Reordered: %d, Late: %d, Kernel drops: %d, Dropped events: %d\n",
+                            syscalls ? (packets / (float)syscalls) : 0.0f, m_lostPackets, reordered, late, kernelDrops, m_droppedEvents);
+
+    updateStatus();
+}
+
+void MainWindow::senderStatistics(QString summary)
+{
+    m_senderStatus = summary;
+
+    updateStatus();
+}
+
+void MainWindow::droppedEvents(unsigned int count)
+{
+    m_droppedEvents = count;
+}
+
+void MainWindow::frameStatistics(unsigned int mergedEvents, unsigned int peakMergedEvents)
+{
+    m_frameStatus.sprintf("Events per repaint: %d (peak: %d)\n", mergedEvents, peakMergedEvents);
+
+    updateStatus();
+}
+
+void MainWindow::recorderStatistics(unsigned int bytesPerSecond, unsigned int queueDepth, unsigned int droppedPackets)
+{
+    m_recorderStatus.sprintf("Recording: %.2f MB/s, Queued blocks: %d, Dropped packets: %d\n",
+                             bytesPerSecond / (1024.0f * 1024.0f), queueDepth, droppedPackets);
+
+    updateStatus();
+}
+
+void MainWindow::recorderRotationFailed(QString traceName)
+{
+    m_rotationStatus = QString("Failed to open %1, still recording to the previous trace\n").arg(traceName);
+
+    updateStatus();
+}
+
 void MainWindow::statusChanged()
 {
     updateStatus();
@@ -244,6 +429,17 @@ void MainWindow::updateStatus()
     if (m_connectedSender)
         m_connectedSender->getStatus(status);
 
+    status += m_receiveStatus;
+    status += m_senderStatus;
+    status += m_frameStatus;
+
+    if (m_saveToFileAction->isChecked()) {
+        status += m_recorderStatus;
+        status += m_rotationStatus;
+    }
+
+    status += m_flightStatus;
+
     ui->label->setText(status);
 }
 
@@ -268,6 +464,8 @@ void MainWindow::tabChanged(int i)
 
         m_connectedSender = static_cast<SceneController*>(target->scene());
 
+        m_fragmentationPlot->setScene(m_connectedSender);
+
         updateStatus();
     }
 }
@@ -294,6 +492,247 @@ void MainWindow::saveToFile()
         m_renderController->saveTraceToFile(m_saveToFileAction->isChecked());
 }
 
+void MainWindow::setFrameBudget()
+{
+    bool ok;
+
+    int value = QInputDialog::getInt(this, "Frame budget",
+                                           "Please enter the repaint period (in ms)",
+                                           m_frameBudget, 1, 1000, 1, &ok);
+
+    if (!ok)
+        return;
+
+    m_frameBudget = value;
+
+    if (m_renderController)
+        m_renderController->setFrameBudget(m_frameBudget);
+}
+
+void MainWindow::setRenderMode()
+{
+    AllocationRenderController::RenderMode mode = AllocationRenderController::RENDER_ITEMS;
+
+    // The occupancy map and the simulation exclude each other
+    if ((sender() == m_occupancyMapAction) && m_occupancyMapAction->isChecked())
+        m_simulationAction->setChecked(false);
+    else if ((sender() == m_simulationAction) && m_simulationAction->isChecked())
+        m_occupancyMapAction->setChecked(false);
+
+    if (m_occupancyMapAction->isChecked())
+        mode = AllocationRenderController::RENDER_OCCUPANCY;
+    else if (m_simulationAction->isChecked())
+        mode = AllocationRenderController::RENDER_SIMULATION;
+
+    if (m_renderController)
+        m_renderController->setRenderMode(mode);
+}
+
+void MainWindow::showPipelineStatistics()
+{
+    bool show = m_pipelineStatisticsAction->isChecked();
+
+    // Only timed while shown, the clock reads aren't free
+    if (m_renderController)
+        m_renderController->pipelineStats()->setEnabled(show);
+
+    for (int i = 0; i < ui->tabWidget->count(); i++)
+        static_cast<RenderTarget*>(ui->tabWidget->widget(i))->setOverlayVisible(show);
+}
+
+void MainWindow::dumpPipelineStatistics()
+{
+    if (!m_renderController) {
+        ui->label->setText("Nothing to dump, not connected.");
+        return;
+    }
+
+    QString fileName = QFileDialog::getSaveFileName(this, "Save the pipeline statistics:", "pipeline.json");
+
+    if (!fileName.length())
+        return;
+
+    if (m_renderController->pipelineStats()->writeJson(fileName.toStdString().c_str()))
+        ui->label->setText("Pipeline statistics saved.");
+    else
+        ui->label->setText("Failed to save the pipeline statistics.");
+}
+
+void MainWindow::dumpSimulation()
+{
+    QList<SimulationSceneController *> scenes;
+    QStringList names;
+
+    for (int i = 0; i < ui->tabWidget->count(); i++) {
+        RenderTarget *target = static_cast<RenderTarget*>(ui->tabWidget->widget(i));
+        SimulationSceneController *scene = qobject_cast<SimulationSceneController*>(target->scene());
+
+        if (scene) {
+            scenes.append(scene);
+            names.append(ui->tabWidget->tabText(i));
+        }
+    }
+
+    if (scenes.isEmpty()) {
+        ui->label->setText("Nothing to dump, no pool is rendered with the allocator simulation.");
+        return;
+    }
+
+    QString fileName = QFileDialog::getSaveFileName(this, "Save the allocator simulation:", "simulation.json");
+
+    if (!fileName.length())
+        return;
+
+    FILE *out = fopen(fileName.toStdString().c_str(), "w");
+
+    if (!out) {
+        ui->label->setText("Failed to save the allocator simulation.");
+        return;
+    }
+
+    fprintf(out, "{\n  \"pools\": [");
+
+    for (int i = 0; i < scenes.size(); i++) {
+        QString name = names[i];
+
+        name.replace("\\", "\\\\").replace("\"", "\\\"");
+
+        fprintf(out, "%s\n    {\n", i ? "," : "");
+        fprintf(out, "      \"name\": \"%s\",\n", name.toStdString().c_str());
+        fprintf(out, "      \"poolSize\": %u,\n", scenes[i]->state()->poolSize());
+        fprintf(out, "      \"simulation\": ");
+        scenes[i]->simulator().writeJson(out, 6);
+        fprintf(out, "\n    }");
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+    fclose(out);
+
+    ui->label->setText("Allocator simulation saved.");
+}
+
+void MainWindow::setTraceRotation()
+{
+    bool ok;
+    char buf[64];
+
+    sprintf(buf, "%d:%d", m_rotationSize, m_rotationInterval);
+
+    QString result = QInputDialog::getText(this, "Trace rotation",
+                                                 "Rotate the trace every <size in MB>:<duration in s> (0 disables)",
+                                                 QLineEdit::Normal,
+                                                 buf, &ok);
+
+    if (!ok || result.isEmpty())
+        return;
+
+    m_rotationSize = result.section(':', 0, 0).toUInt();
+    m_rotationInterval = result.section(':', 1, 1).toUInt();
+
+    if (m_renderController)
+        m_renderController->setTraceRotation(m_rotationSize, m_rotationInterval);
+}
+
+void MainWindow::setSeekHistory()
+{
+    bool ok;
+    char buf[64];
+
+    sprintf(buf, "%d:%d", m_checkpointInterval, m_historyMemory);
+
+    QString result = QInputDialog::getText(this, "Seek history",
+                                                 "Checkpoint a played trace every <interval in packets>:<memory in MB>",
+                                                 QLineEdit::Normal,
+                                                 buf, &ok);
+
+    if (!ok || result.isEmpty())
+        return;
+
+    unsigned int interval = result.section(':', 0, 0).toUInt();
+    unsigned int memory = result.section(':', 1, 1).toUInt();
+
+    // Both bound the cost of a seek, neither can be turned off
+    if (!interval || !memory)
+        return;
+
+    m_checkpointInterval = interval;
+    m_historyMemory = memory;
+}
+
+void MainWindow::setFlightRecorder()
+{
+    bool ok;
+    char buf[96];
+
+    sprintf(buf, "%d:%d:%g:%d:%d", m_flightSize, m_flightDuration, m_flightUsage, m_flightLargestFree, m_flightLostPackets);
+
+    QString result = QInputDialog::getText(this, "Flight recorder",
+                                                 "Keep the last <size in MB>:<duration in s> of packets in memory (0 MB disables),\n"
+                                                 "dump them when a pool goes above <usage in %>, when its largest free block\n"
+                                                 "drops below <size in KB> or on <lost packets per s> (0 disables a trigger)",
+                                                 QLineEdit::Normal,
+                                                 buf, &ok);
+
+    if (!ok || result.isEmpty())
+        return;
+
+    m_flightSize = result.section(':', 0, 0).toUInt();
+    m_flightDuration = result.section(':', 1, 1).toUInt();
+    m_flightUsage = result.section(':', 2, 2).toFloat();
+    m_flightLargestFree = result.section(':', 3, 3).toUInt();
+    m_flightLostPackets = result.section(':', 4, 4).toUInt();
+
+    if (m_renderController)
+        m_renderController->setFlightRecorder(m_flightSize, m_flightDuration, m_flightUsage,
+                                              m_flightLargestFree * 1024, m_flightLostPackets);
+}
+
+void MainWindow::dumpFlightRecorder()
+{
+    if (!m_renderController || !m_flightSize) {
+        ui->label->setText("Nothing to dump, the flight recorder isn't running.");
+        return;
+    }
+
+    // Written in the background, flightRecorderDumped() tells when it's done
+    if (!m_renderController->dumpFlightRecorder())
+        ui->label->setText("Can't dump the flight recorder: nothing recorded yet, or dumps still being written.");
+}
+
+void MainWindow::flightRecorderDumped(QString traceName, QString trigger)
+{
+    m_flightStatus = QString("Flight recorder dumped to %1 (%2)\n").arg(traceName).arg(trigger);
+
+    updateStatus();
+}
+
+void MainWindow::flightRecorderDumpFailed(QString trigger)
+{
+    m_flightStatus = QString("Flight recorder failed to write a dump (%1)\n").arg(trigger);
+
+    updateStatus();
+}
+
+void MainWindow::setReorderWindow()
+{
+    bool ok;
+    char buf[64];
+
+    sprintf(buf, "%d:%d", m_reorderPackets, m_reorderTime);
+
+    QString result = QInputDialog::getText(this, "Reorder window",
+                                                 "Wait for out of order packets up to <packets>:<duration in ms> (0 disables),\n"
+                                                 "applies to the next connection",
+                                                 QLineEdit::Normal,
+                                                 buf, &ok);
+
+    if (!ok || result.isEmpty())
+        return;
+
+    m_reorderPackets = result.section(':', 0, 0).toUInt();
+    m_reorderTime = result.section(':', 1, 1).toUInt();
+}
+
 void MainWindow::closeEvent(QCloseEvent *event)
 {
     UNUSED_PARAM(event);
@@ -29,6 +29,7 @@ class MainWindow;
 
 #include "scenecontroller.h"
 #include "allocationrendercontroller.h"
+#include "fragmentationplot.h"
 
 class MainWindow : public QMainWindow
 {
@@ -47,10 +48,30 @@ private slots:
     void about();
     void saveToFile();
     void playbackTrace();
+    void indexTrace();
+    void setTraceRotation();
+    void setReorderWindow();
+    void setSeekHistory();
+    void setFrameBudget();
+    void setRenderMode();
+    void showPipelineStatistics();
+    void dumpPipelineStatistics();
+    void dumpSimulation();
+    void setFlightRecorder();
+    void dumpFlightRecorder();
+    void flightRecorderDumped(QString traceName, QString trigger);
+    void flightRecorderDumpFailed(QString trigger);
 
     void newRenderTarget(SceneController *scene, char* name);
     void lostPackets(unsigned int lastValidNseq, unsigned int expectedNseq);
     void missingInformation(unsigned int nseq);
+    void receiveStatistics(unsigned int packets, unsigned int syscalls, unsigned int kernelDrops,
+                           unsigned int reordered, unsigned int late);
+    void senderStatistics(QString summary);
+    void droppedEvents(unsigned int count);
+    void recorderStatistics(unsigned int bytesPerSecond, unsigned int queueDepth, unsigned int droppedPackets);
+    void recorderRotationFailed(QString traceName);
+    void frameStatistics(unsigned int mergedEvents, unsigned int peakMergedEvents);
     void finished();
     void statusChanged();
 
@@ -60,10 +81,14 @@ private:
     Ui::MainWindow *ui;
 
     void updateStatus();
+    void setupLiveController();
 
     QAction *m_connectAction;
     QAction *m_stopAction;
     QAction *m_saveToFileAction;
+    QAction *m_occupancyMapAction;
+    QAction *m_simulationAction;
+    QAction *m_pipelineStatisticsAction;
     QAction *m_playbackTraceAction;
 
     QMenu *m_fileMenu;
@@ -74,13 +99,37 @@ private:
     int serverPort;
 
     QString m_status;
+    QString m_receiveStatus;
+    QString m_senderStatus;
+    QString m_frameStatus;
+    QString m_recorderStatus;
+    QString m_rotationStatus;
+    QString m_flightStatus;
 
     unsigned int m_lostPackets;
+    unsigned int m_droppedEvents;
+    int m_frameBudget;
+
+    unsigned int m_rotationSize; // in MB
+    unsigned int m_rotationInterval; // in seconds
+
+    unsigned int m_reorderPackets;
+    unsigned int m_reorderTime; // in ms
+
+    unsigned int m_checkpointInterval; // in packets
+    unsigned int m_historyMemory; // in MB
+
+    unsigned int m_flightSize; // in MB, 0 disables
+    unsigned int m_flightDuration; // in seconds
+    float m_flightUsage; // in %
+    unsigned int m_flightLargestFree; // in KB
+    unsigned int m_flightLostPackets; // per second
 
     AllocationRenderController *m_renderController;
     SceneController *m_connectedSender;
 
     QVBoxLayout *m_vboxLayout;
+    FragmentationPlot *m_fragmentationPlot;
 };
 
 #endif // MAINWINDOW2_H
@@ -0,0 +1,166 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <math.h>
+#include <string.h>
+
+#include "occupancypyramid.h"
+
+OccupancyPyramid::OccupancyPyramid(unsigned int poolSize)
+{
+    m_poolSize = poolSize;
+
+    // Up to a level of a single cell
+    unsigned long long cells = ((unsigned long long)poolSize + leafSize() - 1) >> OCCUPANCY_LEAF_SHIFT;
+
+    do {
+        if (!cells)
+            cells = 1;
+
+        m_levels.push_back(std::vector<Cell>(cells));
+
+        cells = (cells + (1 << OCCUPANCY_FANOUT_SHIFT) - 1) >> OCCUPANCY_FANOUT_SHIFT;
+    } while (m_levels.back().size() > 1);
+
+    clear();
+}
+
+void OccupancyPyramid::clear()
+{
+    for (unsigned int i = 0; i < m_levels.size(); i++)
+        memset(&m_levels[i][0], 0, m_levels[i].size() * sizeof(Cell));
+}
+
+void OccupancyPyramid::add(unsigned int offset, unsigned int size)
+{
+    update(offset, size, 1);
+}
+
+void OccupancyPyramid::remove(unsigned int offset, unsigned int size)
+{
+    update(offset, size, -1);
+}
+
+void OccupancyPyramid::update(unsigned int offset, unsigned int size, int sign)
+{
+    unsigned long long start = offset, end = (unsigned long long)offset + size;
+
+    if (end > m_poolSize)
+        end = m_poolSize;
+
+    if (start >= end)
+        return;
+
+    update(m_levels.size() - 1, 0, start, end, sign);
+}
+
+long long OccupancyPyramid::update(unsigned int level, unsigned int index, unsigned long long start, unsigned long long end, int sign)
+{
+    Cell& cell = m_levels[level][index];
+
+    unsigned long long cellStart = (unsigned long long)index << levelShift(level);
+    unsigned long long cellEnd = cellStart + (1ull << levelShift(level));
+
+    if (start < cellStart)
+        start = cellStart;
+
+    if (end > cellEnd)
+        end = cellEnd;
+
+    long long delta;
+
+    if ((start == cellStart) && (end == cellEnd)) {
+        cell.full += sign;
+        delta = sign * (long long)(end - start);
+    } else if (!level) {
+        delta = sign * (long long)(end - start);
+    } else {
+        unsigned int first = start >> levelShift(level - 1);
+        unsigned int last = (end - 1) >> levelShift(level - 1);
+
+        delta = 0;
+
+        for (unsigned int i = first; (i <= last) && (i < m_levels[level - 1].size()); i++)
+            delta += update(level - 1, i, start, end, sign);
+    }
+
+    cell.covered += delta;
+
+    return delta;
+}
+
+double OccupancyPyramid::prefix(double offset) const
+{
+    unsigned int level = m_levels.size() - 1, index = 0;
+    double sum = 0;
+
+    if (offset > m_poolSize)
+        offset = m_poolSize;
+
+    if (offset <= 0)
+        return 0;
+
+    for (;;) {
+        const Cell& cell = m_levels[level][index];
+        double cellStart = (double)((unsigned long long)index << levelShift(level));
+
+        // Everything from there on is covered
+        if (cell.full)
+            return sum + (offset - cellStart);
+
+        if (!level) {
+            double covered = (cell.covered < leafSize()) ? cell.covered : leafSize();
+
+            return sum + covered * ((offset - cellStart) / leafSize());
+        }
+
+        unsigned int childSize = 1 << levelShift(level - 1);
+        unsigned int child = (unsigned int)(offset / childSize);
+
+        // Overlapping allocations, e.g. after a missed release, count once
+        for (unsigned int i = index << OCCUPANCY_FANOUT_SHIFT; i < child; i++)
+            sum += (m_levels[level - 1][i].covered < childSize) ? m_levels[level - 1][i].covered : childSize;
+
+        if (child >= m_levels[level - 1].size())
+            return sum;
+
+        level--;
+        index = child;
+    }
+}
+
+void OccupancyPyramid::query(double first, double last, unsigned int count, std::vector<float>& coverage) const
+{
+    double step = count ? ((last - first) / count) : 0;
+
+    coverage.resize(count);
+
+    // Neighbouring slices share their boundary
+    double a = first, covered = prefix(a);
+
+    for (unsigned int i = 0; i < count; i++) {
+        double b = first + (i + 1) * step;
+        double next = prefix(b);
+
+        double lo = (a > 0) ? a : 0, hi = (b < m_poolSize) ? b : m_poolSize;
+        float c = (hi > lo) ? (float)((next - covered) / (hi - lo)) : 0.0f;
+
+        coverage[i] = (c < 0.0f) ? 0.0f : ((c > 1.0f) ? 1.0f : c);
+
+        a = b;
+        covered = next;
+    }
+}
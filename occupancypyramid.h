@@ -0,0 +1,68 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef OCCUPANCYPYRAMID_H
+#define OCCUPANCYPYRAMID_H
+
+#include <vector>
+
+// Cells of the finest level cover that many bytes, each level above
+// merges that many cells of the one below
+#define OCCUPANCY_LEAF_SHIFT 8 // 256 bytes
+#define OCCUPANCY_FANOUT_SHIFT 4 // 16 cells
+
+// Bytes of a pool covered by its allocations, at every level of detail.
+// A span only marks the cells it covers whole at the coarsest level they
+// fit in, and the bytes covered up to an offset are summed on the way down
+// to its leaf: updates and queries both touch a bounded number of cells,
+// whatever the sizes involved. Has no dependency on Qt.
+class OccupancyPyramid
+{
+public:
+    explicit OccupancyPyramid(unsigned int poolSize);
+
+    void add(unsigned int offset, unsigned int size);
+    void remove(unsigned int offset, unsigned int size);
+    void clear();
+
+    // Fills coverage with count equal slices of [first, last), in bytes,
+    // from 0 to 1. Exact when the slice boundaries fall on leaves. A leaf
+    // cut by a boundary counts as evenly covered, which is off by at most
+    // a quarter of a leaf per boundary.
+    void query(double first, double last, unsigned int count, std::vector<float>& coverage) const;
+
+    static unsigned int leafSize() { return 1 << OCCUPANCY_LEAF_SHIFT; }
+
+private:
+    struct Cell {
+        unsigned int covered; // by the spans marked at or below this cell, in bytes
+        unsigned int full; // spans covering it whole, marked here
+    };
+
+    static unsigned int levelShift(unsigned int level) { return OCCUPANCY_LEAF_SHIFT + level * OCCUPANCY_FANOUT_SHIFT; }
+
+    void update(unsigned int offset, unsigned int size, int sign);
+    long long update(unsigned int level, unsigned int index, unsigned long long start, unsigned long long end, int sign);
+
+    // Bytes covered in [0, offset)
+    double prefix(double offset) const;
+
+    unsigned int m_poolSize;
+
+    std::vector<std::vector<Cell> > m_levels; // the leaves first
+};
+
+#endif // OCCUPANCYPYRAMID_H
@@ -0,0 +1,206 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <QPainter>
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#include "occupancyscenecontroller.h"
+
+// Barely covered pixels still stand out from the free space
+#define MIN_COVERAGE_SHADE 0.25f
+
+static QRgb shade(QRgb color, float coverage)
+{
+    float k = MIN_COVERAGE_SHADE + (1.0f - MIN_COVERAGE_SHADE) * coverage;
+
+    return qRgb((int)(qRed(color) * k), (int)(qGreen(color) * k), (int)(qBlue(color) * k));
+}
+
+OccupancySceneController::OccupancySceneController(QObject *parent, PoolState *state) : SceneController(parent, state),
+                                                                                        m_pyramid(state->poolSize())
+{
+    m_poolSize = state->poolSize();
+
+    for (unsigned int i = 0; i < m_state->count(); i++)
+        m_pyramid.add(m_state->at(i).offset, m_state->at(i).size);
+}
+
+void OccupancySceneController::setSceneRect(const QRectF &rect)
+{
+    setSceneRect(rect.x(), rect.y(), rect.width(), rect.height());
+}
+
+void OccupancySceneController::setSceneRect(qreal x, qreal y, qreal w, qreal h)
+{
+    QGraphicsScene::setSceneRect(x, y, w, h);
+
+    m_renderAspectRatio = (w * h) / m_poolSize;
+
+    m_occupancy = QImage((int)w, (int)h, QImage::Format_RGB32);
+    redraw();
+}
+
+float OccupancySceneController::aspectRatio()
+{
+    return m_renderAspectRatio;
+}
+
+void OccupancySceneController::redraw()
+{
+    m_occupancy.fill(qRgb(0, 0, 0));
+
+    for (unsigned int i = 0; i < m_state->count(); i++) {
+        const PoolAllocation& allocation = m_state->at(i);
+        fillSpan(m_occupancy, 0, m_occupancy.height(), allocation.offset, allocation.size, formatColor(allocation.format));
+    }
+}
+
+void OccupancySceneController::allocationAdded(const PoolAllocation& allocation)
+{
+    fillSpan(m_occupancy, 0, m_occupancy.height(), allocation.offset, allocation.size, formatColor(allocation.format));
+    m_pyramid.add(allocation.offset, allocation.size);
+
+    emit statusChanged();
+}
+
+void OccupancySceneController::allocationRemoved(const PoolAllocation& allocation)
+{
+    clearSpan(m_occupancy, 0, m_occupancy.height(), m_state, allocation.offset, allocation.size);
+    m_pyramid.remove(allocation.offset, allocation.size);
+
+    emit statusChanged();
+}
+
+void OccupancySceneController::poolReset()
+{
+    m_occupancy.fill(qRgb(0, 0, 0));
+    m_pyramid.clear();
+
+    emit statusChanged();
+}
+
+void OccupancySceneController::drawBackground(QPainter *painter, const QRectF &rect)
+{
+    // Fitting the view, the bitmap already holds a pixel per pixel
+    if (painter->worldTransform().m11() > 1.0) {
+        drawZoomed(painter, rect);
+        return;
+    }
+
+    QRect r = rect.toAlignedRect() & m_occupancy.rect();
+
+    painter->drawImage(r.topLeft(), m_occupancy, r);
+}
+
+void OccupancySceneController::drawZoomed(QPainter *painter, const QRectF &rect)
+{
+    QTransform transform = painter->worldTransform();
+    QTransform inverse = transform.inverted();
+
+    QRect device = transform.mapRect(rect & sceneRect()).toAlignedRect();
+
+    if (device.isEmpty() || (m_renderAspectRatio <= 0))
+        return;
+
+    double zoom = transform.m11();
+    double bytesPerPixel = 1.0 / (m_renderAspectRatio * zoom);
+    double rowBytes = width() / m_renderAspectRatio;
+
+    // Bytes of the left edge from the start of its row
+    double left = inverse.map(QPointF(device.left(), 0)).x() / m_renderAspectRatio;
+
+    QImage image(device.size(), QImage::Format_RGB32);
+    int cachedRow = -1;
+
+    for (int y = 0; y < image.height(); y++) {
+        QRgb *line = reinterpret_cast<QRgb*>(image.scanLine(y));
+        int row = (int)floor(inverse.map(QPointF(0, device.top() + y + 0.5)).y());
+
+        // Scene rows span several device lines
+        if ((row == cachedRow) && y) {
+            memcpy(line, image.scanLine(y - 1), image.width() * sizeof(QRgb));
+            continue;
+        }
+
+        cachedRow = row;
+
+        if ((row < 0) || (row >= (int)height())) {
+            std::fill(line, line + image.width(), qRgb(0, 0, 0));
+            continue;
+        }
+
+        renderRow(line, image.width(), row * rowBytes + left, bytesPerPixel);
+    }
+
+    painter->save();
+    painter->resetTransform();
+    painter->drawImage(device.topLeft(), image);
+    painter->restore();
+}
+
+void OccupancySceneController::renderRow(QRgb *line, int count, double first, double bytesPerPixel)
+{
+    double last = first + count * bytesPerPixel;
+
+    std::fill(line, line + count, qRgb(0, 0, 0));
+
+    if (bytesPerPixel >= OccupancyPyramid::leafSize()) {
+        m_pyramid.query(first, last, count, m_coverage);
+
+        for (int x = 0; x < count; x++) {
+            if (m_coverage[x] <= 0.0f)
+                continue;
+
+            // Colored after the first allocation in the pixel
+            unsigned int i = m_state->lowerBound((unsigned int)(first + x * bytesPerPixel));
+
+            if (i < m_state->count())
+                line[x] = shade(formatColor(m_state->at(i).format), m_coverage[x]);
+        }
+
+        return;
+    }
+
+    // Few enough bytes in view to draw every allocation
+    for (unsigned int i = m_state->lowerBound((first > 0) ? (unsigned int)first : 0);
+         (i < m_state->count()) && (m_state->at(i).offset < last); i++) {
+        const PoolAllocation& allocation = m_state->at(i);
+
+        int start = (int)floor((allocation.offset - first) / bytesPerPixel);
+        int end = (int)ceil(((double)allocation.offset + allocation.size - first) / bytesPerPixel);
+
+        start = std::max(start, 0);
+        end = std::min(std::max(end, start + 1), count);
+
+        std::fill(line + start, line + end, formatColor(allocation.format));
+    }
+}
+
+void OccupancySceneController::getStatus(QString& status)
+{
+    status.sprintf("Currently allocated: %d (ratio: %.2f%%), Live allocations: %d\n"
+                   "Peak usage: %d, Lowest usage: %d\n",
+                   m_state->allocated(), m_state->usageRatio(), m_state->count(),
+                   m_state->peakUsage(), m_state->lowestUsage());
+
+    appendFragmentationStatus(status);
+
+    if (m_state->isStale())
+        status += "Out of sync, waiting for a pool snapshot\n";
+}
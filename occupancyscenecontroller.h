@@ -0,0 +1,68 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef OCCUPANCYSCENECONTROLLER_H
+#define OCCUPANCYSCENECONTROLLER_H
+
+#include <QGraphicsScene>
+#include <QImage>
+
+#include "scenecontroller.h"
+#include "occupancypyramid.h"
+
+// Renders a pool as a single occupancy bitmap, in the same linear
+// offset-to-pixel layout as AllocationSceneController. Events only touch
+// the pixels of their span, so the repaint cost doesn't depend on the
+// number of live allocations.
+//
+// Zoomed in, the exposed pixels are drawn from an occupancy pyramid, the
+// brighter the more of their bytes are covered, until a pixel holds less
+// than a leaf and the allocations are drawn byte exact.
+class OccupancySceneController : public SceneController
+{
+    Q_OBJECT
+public:
+    explicit OccupancySceneController(QObject *parent, PoolState* state);
+
+    void setSceneRect(const QRectF &rect);
+    void setSceneRect(qreal x, qreal y, qreal w, qreal h);
+
+    float aspectRatio();
+
+    void allocationAdded(const PoolAllocation& allocation);
+    void allocationRemoved(const PoolAllocation& allocation);
+    void poolReset();
+
+    void getStatus(QString& status);
+
+protected:
+    void drawBackground(QPainter *painter, const QRectF &rect);
+
+private:
+    void redraw();
+
+    void drawZoomed(QPainter *painter, const QRectF &rect);
+    void renderRow(QRgb *line, int count, double first, double bytesPerPixel);
+
+    unsigned int m_poolSize;
+
+    QImage m_occupancy;
+
+    OccupancyPyramid m_pyramid;
+    std::vector<float> m_coverage;
+};
+
+#endif // OCCUPANCYSCENECONTROLLER_H
@@ -0,0 +1,470 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+#include "packetdecoder.h"
+
+#define MAX_PENDING_EVENTS 4096 // per stale pool
+
+// Sequence numbers wrap around
+static inline bool nseqAfter(unsigned int a, unsigned int b)
+{
+    return (int)(a - b) > 0;
+}
+
+static unsigned long long monotonicMs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (ts.tv_sec * 1000ULL) + (ts.tv_nsec / 1000000);
+}
+
+bool PacketListener::poolSnapshot(const DFBTracingBufferData* stats, unsigned int count)
+{
+    poolReset(&stats[0]);
+
+    for (unsigned int i = 0; i < count; i++)
+        bufferAllocation(&stats[i]);
+
+    return true;
+}
+
+PacketDecoder::PacketDecoder(PacketListener* listener)
+{
+    m_listener = listener;
+    m_stats = 0;
+
+    m_heldMask = 0;
+    m_heldCount = 0;
+
+    m_reorderPackets = 0;
+    m_reorderTime = 0;
+
+    reset();
+}
+
+void PacketDecoder::reset()
+{
+    m_currentNseq = m_expectedNseq = 0;
+
+    clearHeld();
+    clearPending();
+    m_knownPools.clear();
+
+    m_status = STATUS_IDLE;
+}
+
+void PacketDecoder::resynchronize(unsigned int nSeq)
+{
+    m_currentNseq = nSeq - 1;
+    m_expectedNseq = nSeq;
+
+    // The caller restored a consistent state, e.g. a trace keyframe
+    clearHeld();
+    clearPending();
+
+    if (m_status == STATUS_SYNCING)
+        m_status = STATUS_RECEIVING;
+}
+
+void PacketDecoder::setReorderWindow(unsigned int packets, unsigned int ms)
+{
+    unsigned int size = 1;
+
+    while (size < packets)
+        size <<= 1;
+
+    m_reorderPackets = packets;
+    m_reorderTime = ms;
+
+    // Indexed by nSeq, the window never spans more than the ring
+    m_held.resize(packets ? size : 0);
+    m_heldMask = size - 1;
+
+    clearHeld();
+}
+
+void PacketDecoder::clearHeld()
+{
+    for (unsigned int i = 0; i < m_held.size(); i++)
+        m_held[i].used = false;
+
+    m_heldCount = 0;
+}
+
+void PacketDecoder::holdPacket(const char* buf, int size)
+{
+    const DFBTracingPacket *packet = reinterpret_cast<const DFBTracingPacket*>(buf);
+    HeldPacket& held = m_held[packet->header.nSeq & m_heldMask];
+
+    if (held.used) {
+        m_listener->latePacket(packet->header.nSeq);
+        return;
+    }
+
+    held.used = true;
+    held.nSeq = packet->header.nSeq;
+    held.size = size;
+    held.arrival = m_reorderTime ? monotonicMs() : 0;
+
+    memcpy(held.buf, buf, size);
+
+    m_heldCount++;
+}
+
+void PacketDecoder::releaseHeld()
+{
+    while (m_heldCount) {
+        HeldPacket& held = m_held[m_expectedNseq & m_heldMask];
+
+        if (!held.used || (held.nSeq != m_expectedNseq))
+            break;
+
+        held.used = false;
+        m_heldCount--;
+
+        acceptPacket(held.buf, held.size);
+    }
+}
+
+void PacketDecoder::skipToHeld()
+{
+    // The missing packets are really lost: resume from the first held one,
+    // acceptPacket() reports the gap
+    for (unsigned int i = 1; i <= m_reorderPackets; i++) {
+        HeldPacket& held = m_held[(m_expectedNseq + i) & m_heldMask];
+
+        if (held.used && (held.nSeq == (m_expectedNseq + i))) {
+            held.used = false;
+            m_heldCount--;
+
+            acceptPacket(held.buf, held.size);
+            break;
+        }
+    }
+
+    releaseHeld();
+}
+
+void PacketDecoder::expire()
+{
+    if (!m_heldCount || !m_reorderTime)
+        return;
+
+    unsigned long long now = monotonicMs();
+
+    while (m_heldCount) {
+        bool expired = false;
+
+        for (unsigned int i = 0; (i < m_held.size()) && !expired; i++)
+            expired = m_held[i].used && ((m_held[i].arrival + m_reorderTime) <= now);
+
+        if (!expired)
+            break;
+
+        skipToHeld();
+    }
+}
+
+void PacketDecoder::clearPending()
+{
+    std::map<unsigned int, PendingPool>::iterator it;
+
+    for (it = m_stalePools.begin(); it != m_stalePools.end(); ++it)
+        m_listener->poolStale(it->first, false);
+
+    m_stalePools.clear();
+}
+
+void PacketDecoder::markStale()
+{
+    std::set<unsigned int>::iterator it;
+
+    for (it = m_knownPools.begin(); it != m_knownPools.end(); ++it) {
+        if (m_stalePools.count(*it))
+            continue;
+
+        m_stalePools[*it].overflowed = false;
+        m_listener->poolStale(*it, true);
+    }
+
+    if (!m_stalePools.empty())
+        m_status = STATUS_SYNCING;
+}
+
+void PacketDecoder::flushPending(unsigned int poolId, unsigned int afterNseq, bool all)
+{
+    PendingPool& pending = m_stalePools[poolId];
+
+    for (unsigned int i = 0; i < pending.events.size(); i++) {
+        const PendingEvent& event = pending.events[i];
+
+        // Already accounted for by the snapshot
+        if (!all && !nseqAfter(event.nSeq, afterNseq))
+            continue;
+
+        if (event.type == DTE_POOL_BUFFER_ALLOCATION)
+            m_listener->bufferAllocation(&event.data);
+        else
+            m_listener->bufferRelease(&event.data);
+    }
+
+    pending.events.clear();
+}
+
+void PacketDecoder::processSnapshotEvent(const char* buf, int size)
+{
+    const DFBTracingPacket *packet = reinterpret_cast<const DFBTracingPacket*>(buf);
+
+    if (packet->Payload.pool.count)
+    {
+        const DFBTracingPoolData* pool = &packet->Payload.pool;
+
+        // WARN: assumes all stats belong to the same poolId
+        unsigned int poolId = pool->stats[0].poolId;
+
+        size -= sizeof(DFBTracingPacketHeader);
+        size -= offsetof(DFBTracingPoolData, stats);
+
+        if (size <= 0) {
+            m_listener->badPacket(packet->header.nSeq);
+            return;
+        }
+
+        unsigned int count = size / sizeof(DFBTracingBufferData);
+
+        if (count > pool->count)
+            count = pool->count;
+
+        size -= count * sizeof(DFBTracingBufferData);
+
+        if (size)
+            m_listener->badPacket(packet->header.nSeq);
+
+        m_knownPools.insert(poolId);
+
+        // The pool stays stale until a snapshot makes it through whole
+        if (!m_listener->poolSnapshot(pool->stats, count))
+            return;
+
+        if (m_stalePools.count(poolId)) {
+            flushPending(poolId, packet->header.nSeq, false);
+
+            m_stalePools.erase(poolId);
+            m_listener->poolStale(poolId, false);
+
+            if (m_stalePools.empty())
+                m_status = STATUS_RECEIVING;
+        }
+    }
+}
+
+void PacketDecoder::processBufferEvent(const char* buf)
+{
+    const DFBTracingPacket *packet = reinterpret_cast<const DFBTracingPacket*>(buf);
+
+    unsigned int poolId = packet->Payload.buffer.poolId;
+
+    m_knownPools.insert(poolId);
+
+    std::map<unsigned int, PendingPool>::iterator it = m_stalePools.find(poolId);
+
+    if ((it != m_stalePools.end()) && !it->second.overflowed) {
+        PendingPool& pending = it->second;
+
+        if (pending.events.size() < MAX_PENDING_EVENTS) {
+            PendingEvent event;
+
+            event.nSeq = packet->header.nSeq;
+            event.type = packet->header.type;
+            event.data = packet->Payload.buffer;
+
+            pending.events.push_back(event);
+            return;
+        }
+
+        // No snapshot in sight: fall back to applying events as they come,
+        // the pool remains flagged stale until a snapshot shows up
+        flushPending(poolId, 0, true);
+        pending.overflowed = true;
+    }
+
+    switch (packet->header.type) {
+    case DTE_POOL_BUFFER_ALLOCATION:
+        m_listener->bufferAllocation(&packet->Payload.buffer);
+        break;
+    case DTE_POOL_BUFFER_RELEASE:
+        m_listener->bufferRelease(&packet->Payload.buffer);
+        break;
+    default:
+        break;
+    }
+}
+
+void PacketDecoder::processPacket(const char* buf, int size)
+{
+    const DFBTracingPacket *packet = reinterpret_cast<const DFBTracingPacket*>(buf);
+    StageTimer timer(m_stats, STAGE_PROCESS);
+
+    m_currentNseq = packet->header.nSeq;
+    m_expectedNseq = m_currentNseq + 1;
+
+    m_listener->packetAccepted(buf, size);
+
+    // Snapshots are authoritative in any state, stale pools are held back
+    // per pool by processBufferEvent()
+    switch (packet->header.type) {
+    case DTE_POOL_FULL_SNAPSHOT:
+        processSnapshotEvent(buf, size);
+        break;
+    case DTE_POOL_BUFFER_ALLOCATION:
+    case DTE_POOL_BUFFER_RELEASE:
+        processBufferEvent(buf);
+        break;
+    default:
+        break;
+    }
+}
+
+void PacketDecoder::receivePacket(const char* buf, int size)
+{
+    const DFBTracingPacket *packet = reinterpret_cast<const DFBTracingPacket*>(buf);
+    StageTimer timer(m_stats, STAGE_DECODE);
+
+    // The first packet sets the sequence, anything received before can't be held
+    if (!m_reorderPackets || (m_status == STATUS_IDLE)) {
+        acceptPacket(buf, size);
+        return;
+    }
+
+    int distance = (int)(packet->header.nSeq - m_expectedNseq);
+
+    if (distance < 0) {
+        // Already given up on, or a duplicate
+        m_listener->latePacket(packet->header.nSeq);
+    } else if (distance == 0) {
+        if (m_heldCount)
+            m_listener->reorderedPacket(packet->header.nSeq);
+
+        acceptPacket(buf, size);
+        releaseHeld();
+    } else {
+        // Too far ahead to keep waiting for the oldest missing packets
+        while (m_heldCount && ((unsigned int)distance >= m_reorderPackets)) {
+            skipToHeld();
+            distance = (int)(packet->header.nSeq - m_expectedNseq);
+        }
+
+        if ((distance > 0) && ((unsigned int)distance < m_reorderPackets) && ((unsigned int)size <= sizeof(m_held[0].buf)))
+            holdPacket(buf, size);
+        else if (distance >= 0) {
+            acceptPacket(buf, size);
+            releaseHeld();
+        } else
+            m_listener->latePacket(packet->header.nSeq);
+    }
+
+    expire();
+}
+
+void PacketDecoder::acceptPacket(const char* buf, int size)
+{
+    // Inspect the header for the sequence number
+    const DFBTracingPacket *packet = reinterpret_cast<const DFBTracingPacket*>(buf);
+
+    if (packet->header.nSeq != m_expectedNseq) {
+        m_currentNseq = packet->header.nSeq;
+
+        m_listener->lostPackets(m_currentNseq, m_expectedNseq);
+        m_expectedNseq = m_currentNseq + 1;
+
+        // Whatever was lost may have touched any pool we know of
+        markStale();
+    }
+
+    if (m_status == STATUS_IDLE)
+        m_status = STATUS_RECEIVING;
+
+    unsigned int packetSize = sizeof(DFBTracingPacketHeader) + packet->header.size;
+
+    // Trace records are padded to sizeof(DFBTracingPacket), only a
+    // truncated packet is missing information
+    if ((unsigned int)size < packetSize)
+        m_listener->missingInformation(packet->header.nSeq);
+    else
+        processPacket(buf, packetSize);
+}
+
+PoolStateTracker::PoolStateTracker()
+{
+}
+
+PoolStateTracker::~PoolStateTracker()
+{
+    clear();
+}
+
+void PoolStateTracker::clear()
+{
+    std::map<unsigned int, PoolState *>::iterator it;
+
+    for (it = m_pools.begin(); it != m_pools.end(); ++it)
+        delete it->second;
+
+    m_pools.clear();
+}
+
+PoolState* PoolStateTracker::pool(unsigned int poolId) const
+{
+    std::map<unsigned int, PoolState *>::const_iterator it = m_pools.find(poolId);
+
+    return (it != m_pools.end()) ? it->second : 0;
+}
+
+void PoolStateTracker::poolReset(const DFBTracingBufferData* data)
+{
+    PoolState *state = pool(data->poolId);
+
+    if (state)
+        state->reset();
+}
+
+void PoolStateTracker::bufferAllocation(const DFBTracingBufferData* data)
+{
+    PoolState *state = pool(data->poolId);
+
+    if (!state) {
+        state = new PoolState(data);
+        m_pools.insert(std::make_pair(data->poolId, state));
+
+        poolCreated(state);
+    }
+
+    state->allocate(data);
+}
+
+void PoolStateTracker::bufferRelease(const DFBTracingBufferData* data)
+{
+    PoolState *state = pool(data->poolId);
+
+    if (state)
+        state->release(data->offset);
+}
@@ -0,0 +1,168 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef PACKETDECODER_H
+#define PACKETDECODER_H
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include <core/remote_tracing.h>
+
+#include "poolstate.h"
+#include "pipelinestats.h"
+
+class PacketListener
+{
+public:
+    virtual ~PacketListener() {}
+
+    virtual void packetAccepted(const char* buf, int size) { (void)buf; (void)size; }
+    virtual void lostPackets(unsigned int lastValidNseq, unsigned int expectedNseq) { (void)lastValidNseq; (void)expectedNseq; }
+    virtual void badPacket(unsigned int nseq) { (void)nseq; }
+    virtual void reorderedPacket(unsigned int nseq) { (void)nseq; }
+    virtual void latePacket(unsigned int nseq) { (void)nseq; }
+    virtual void missingInformation(unsigned int nseq) { (void)nseq; }
+
+    virtual void poolReset(const DFBTracingBufferData* data) = 0;
+    virtual void bufferAllocation(const DFBTracingBufferData* data) = 0;
+    virtual void bufferRelease(const DFBTracingBufferData* data) = 0;
+
+    // A pool whose state can't be trusted anymore after a loss, or rebuilt
+    virtual void poolStale(unsigned int poolId, bool stale) { (void)poolId; (void)stale; }
+
+    // Replace a pool content with a snapshot, returns false if it couldn't
+    // be applied as a whole. Defaults to a reset followed by allocations.
+    virtual bool poolSnapshot(const DFBTracingBufferData* stats, unsigned int count);
+};
+
+// Validates DFBTracingPacket streams (sequence numbers, sizes) and turns
+// them into pool events. Has no dependency on Qt, so that the viewer, the
+// trace indexer and the headless tools all decode packets the same way.
+//
+// Packets arriving ahead of the expected sequence number can be held in a
+// small reorder window, so that a packet arriving a bit late still gets
+// applied in order instead of being counted as lost.
+//
+// After a sequence gap every known pool is stale: its buffer events are
+// held back until the next DTE_POOL_FULL_SNAPSHOT of that pool rebuilds
+// it, then the held events newer than the snapshot are replayed.
+class PacketDecoder
+{
+public:
+    explicit PacketDecoder(PacketListener* listener);
+
+    void reset();
+
+    void receivePacket(const char* buf, int size);
+
+    // Continue from nSeq, e.g. after seeking to a keyframe
+    void resynchronize(unsigned int nSeq);
+
+    // Hold up to packets early packets for at most ms milliseconds while
+    // waiting for a missing one, 0 packets disables reordering
+    void setReorderWindow(unsigned int packets, unsigned int ms);
+
+    // Give up on the packets held for longer than the reorder window
+    void expire();
+
+    // Time receivePacket() and processPacket() into stats, may be 0
+    void setStatistics(PipelineStats* stats) { m_stats = stats; }
+
+private:
+    typedef enum {
+        STATUS_IDLE,
+        STATUS_RECEIVING,
+        STATUS_SYNCING
+    } DecoderStatus;
+
+    void acceptPacket(const char* buf, int size);
+    void processPacket(const char* buf, int size);
+
+    void holdPacket(const char* buf, int size);
+    void releaseHeld();
+    void skipToHeld();
+    void clearHeld();
+
+    void processSnapshotEvent(const char* buf, int size);
+    void processBufferEvent(const char* buf);
+
+    void markStale();
+    void flushPending(unsigned int poolId, unsigned int afterNseq, bool all);
+    void clearPending();
+
+    struct PendingEvent {
+        unsigned int nSeq;
+        unsigned int type;
+        DFBTracingBufferData data;
+    };
+
+    struct PendingPool {
+        std::vector<PendingEvent> events;
+        bool overflowed;
+    };
+
+    struct HeldPacket {
+        bool used;
+        unsigned int nSeq;
+        int size;
+        unsigned long long arrival; // in ms
+        char buf[2048];
+    };
+
+    PacketListener *m_listener;
+    PipelineStats *m_stats;
+
+    std::vector<HeldPacket> m_held;
+    unsigned int m_heldMask;
+    unsigned int m_heldCount;
+
+    unsigned int m_reorderPackets;
+    unsigned int m_reorderTime;
+
+    std::set<unsigned int> m_knownPools;
+    std::map<unsigned int, PendingPool> m_stalePools;
+
+    unsigned int m_currentNseq, m_expectedNseq;
+
+    DecoderStatus m_status;
+};
+
+// Listener keeping one PoolState per pool up to date
+class PoolStateTracker : public PacketListener
+{
+public:
+    PoolStateTracker();
+    ~PoolStateTracker();
+
+    void clear();
+
+    PoolState* pool(unsigned int poolId) const;
+    const std::map<unsigned int, PoolState *>& pools() const { return m_pools; }
+
+    void poolReset(const DFBTracingBufferData* data);
+    void bufferAllocation(const DFBTracingBufferData* data);
+    void bufferRelease(const DFBTracingBufferData* data);
+
+protected:
+    virtual void poolCreated(PoolState* state) { (void)state; }
+
+private:
+    std::map<unsigned int, PoolState *> m_pools;
+};
+
+#endif // PACKETDECODER_H
@@ -0,0 +1,358 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <string.h>
+
+#include "persistentpool.h"
+
+struct PersistentPool::Node {
+    PoolAllocation allocation;
+    unsigned int priority;
+    unsigned int refs;
+
+    Node *left;
+    Node *right;
+};
+
+// Not atomic, see nodeCount()
+static unsigned int liveNodes = 0;
+
+static bool sameAllocation(const PoolAllocation& a, const PoolAllocation& b)
+{
+    return (a.offset == b.offset) && (a.size == b.size) && (a.width == b.width)
+            && (a.height == b.height) && (a.format == b.format);
+}
+
+PersistentPool::PersistentPool()
+{
+    m_root = 0;
+    m_count = 0;
+
+    memset(&m_info, 0, sizeof(m_info));
+}
+
+PersistentPool::PersistentPool(const DFBTracingBufferData* info)
+{
+    m_root = 0;
+    m_count = 0;
+
+    m_info = *info;
+}
+
+PersistentPool::PersistentPool(const PersistentPool& other)
+{
+    m_root = retain(other.m_root);
+    m_count = other.m_count;
+
+    m_info = other.m_info;
+}
+
+PersistentPool::~PersistentPool()
+{
+    release(m_root);
+}
+
+PersistentPool& PersistentPool::operator=(const PersistentPool& other)
+{
+    Node *root = retain(other.m_root);
+
+    release(m_root);
+
+    m_root = root;
+    m_count = other.m_count;
+
+    m_info = other.m_info;
+
+    return *this;
+}
+
+unsigned int PersistentPool::nodeCount()
+{
+    return liveNodes;
+}
+
+unsigned int PersistentPool::nodeSize()
+{
+    return sizeof(Node);
+}
+
+unsigned int PersistentPool::priority(unsigned int offset)
+{
+    // Any good mix of the bits would do, as long as it doesn't change
+    offset ^= offset >> 16;
+    offset *= 0x7feb352d;
+    offset ^= offset >> 15;
+    offset *= 0x846ca68b;
+    offset ^= offset >> 16;
+
+    return offset;
+}
+
+bool PersistentPool::above(unsigned int priority, unsigned int offset, const Node* node)
+{
+    // Ties are broken by offset so that the shape stays unique
+    if (priority != node->priority)
+        return priority > node->priority;
+
+    return offset < node->allocation.offset;
+}
+
+PersistentPool::Node* PersistentPool::retain(Node* node)
+{
+    if (node)
+        node->refs++;
+
+    return node;
+}
+
+void PersistentPool::release(Node* node)
+{
+    while (node && !--node->refs) {
+        Node *right = node->right;
+
+        release(node->left);
+
+        delete node;
+        liveNodes--;
+
+        node = right;
+    }
+}
+
+// Takes over the references to left and right
+PersistentPool::Node* PersistentPool::make(const PoolAllocation& allocation, unsigned int priority, Node* left, Node* right)
+{
+    Node *node = new Node;
+
+    node->allocation = allocation;
+    node->priority = priority;
+    node->refs = 1;
+    node->left = left;
+    node->right = right;
+
+    liveNodes++;
+
+    return node;
+}
+
+// The functions below borrow their arguments and return a new reference
+
+PersistentPool::Node* PersistentPool::insert(Node* node, const PoolAllocation& allocation, unsigned int priority)
+{
+    Node *left, *right;
+
+    if (!node)
+        return make(allocation, priority, 0, 0);
+
+    if (above(priority, allocation.offset, node)) {
+        split(node, allocation.offset, left, right);
+
+        return make(allocation, priority, left, right);
+    }
+
+    if (allocation.offset < node->allocation.offset)
+        return make(node->allocation, node->priority, insert(node->left, allocation, priority), retain(node->right));
+
+    if (allocation.offset > node->allocation.offset)
+        return make(node->allocation, node->priority, retain(node->left), insert(node->right, allocation, priority));
+
+    return make(allocation, node->priority, retain(node->left), retain(node->right));
+}
+
+PersistentPool::Node* PersistentPool::erase(Node* node, unsigned int offset, bool& erased)
+{
+    if (!node)
+        return 0;
+
+    if (offset == node->allocation.offset) {
+        erased = true;
+
+        return merge(node->left, node->right);
+    }
+
+    Node *child = (offset < node->allocation.offset) ? node->left : node->right;
+    Node *updated = erase(child, offset, erased);
+
+    // Nothing to copy when the offset wasn't there
+    if (!erased) {
+        release(updated);
+
+        return retain(node);
+    }
+
+    if (offset < node->allocation.offset)
+        return make(node->allocation, node->priority, updated, retain(node->right));
+
+    return make(node->allocation, node->priority, retain(node->left), updated);
+}
+
+PersistentPool::Node* PersistentPool::merge(Node* left, Node* right)
+{
+    if (!left)
+        return retain(right);
+
+    if (!right)
+        return retain(left);
+
+    if (above(left->priority, left->allocation.offset, right))
+        return make(left->allocation, left->priority, retain(left->left), merge(left->right, right));
+
+    return make(right->allocation, right->priority, merge(left, right->left), retain(right->right));
+}
+
+// Offsets below to left, above to right, offset itself is left out
+void PersistentPool::split(Node* node, unsigned int offset, Node*& left, Node*& right)
+{
+    Node *child;
+
+    if (!node) {
+        left = right = 0;
+        return;
+    }
+
+    if (node->allocation.offset < offset) {
+        split(node->right, offset, child, right);
+        left = make(node->allocation, node->priority, retain(node->left), child);
+    } else if (node->allocation.offset > offset) {
+        split(node->left, offset, left, child);
+        right = make(node->allocation, node->priority, child, retain(node->right));
+    } else {
+        left = retain(node->left);
+        right = retain(node->right);
+    }
+}
+
+void PersistentPool::insert(const PoolAllocation& allocation)
+{
+    Node *root;
+
+    if (!lookup(allocation.offset))
+        m_count++;
+
+    root = insert(m_root, allocation, priority(allocation.offset));
+
+    release(m_root);
+    m_root = root;
+}
+
+bool PersistentPool::erase(unsigned int offset)
+{
+    bool erased = false;
+    Node *root = erase(m_root, offset, erased);
+
+    release(m_root);
+    m_root = root;
+
+    if (erased)
+        m_count--;
+
+    return erased;
+}
+
+void PersistentPool::clear()
+{
+    release(m_root);
+
+    m_root = 0;
+    m_count = 0;
+}
+
+const PoolAllocation* PersistentPool::lookup(unsigned int offset) const
+{
+    const Node *node = m_root;
+
+    while (node && (node->allocation.offset != offset))
+        node = (offset < node->allocation.offset) ? node->left : node->right;
+
+    return node ? &node->allocation : 0;
+}
+
+void PersistentPool::collect(const Node* node, std::vector<PoolAllocation>& allocations)
+{
+    while (node) {
+        collect(node->left, allocations);
+        allocations.push_back(node->allocation);
+
+        node = node->right;
+    }
+}
+
+void PersistentPool::allocations(std::vector<PoolAllocation>& allocations) const
+{
+    allocations.reserve(allocations.size() + m_count);
+
+    collect(m_root, allocations);
+}
+
+void PersistentPool::diff(Node* from, Node* to, std::vector<PoolAllocation>& removed, std::vector<PoolAllocation>& added)
+{
+    Node *left, *right;
+
+    // Shared between the versions, the whole subtree is the same
+    if (from == to)
+        return;
+
+    if (!from) {
+        collect(to, added);
+        return;
+    }
+
+    if (!to) {
+        collect(from, removed);
+        return;
+    }
+
+    if (from->allocation.offset == to->allocation.offset) {
+        if (!sameAllocation(from->allocation, to->allocation)) {
+            removed.push_back(from->allocation);
+            added.push_back(to->allocation);
+        }
+
+        diff(from->left, to->left, removed, added);
+        diff(from->right, to->right, removed, added);
+
+        return;
+    }
+
+    // The roots differ, cut to around from's root: only the path gets copied,
+    // the subtrees on its sides are still shared
+    const Node *match = to;
+
+    while (match && (match->allocation.offset != from->allocation.offset))
+        match = (from->allocation.offset < match->allocation.offset) ? match->left : match->right;
+
+    if (!match)
+        removed.push_back(from->allocation);
+    else if (!sameAllocation(from->allocation, match->allocation)) {
+        removed.push_back(from->allocation);
+        added.push_back(match->allocation);
+    }
+
+    split(to, from->allocation.offset, left, right);
+
+    diff(from->left, left, removed, added);
+    diff(from->right, right, removed, added);
+
+    release(left);
+    release(right);
+}
+
+void PersistentPool::diff(const PersistentPool& from, const PersistentPool& to,
+                          std::vector<PoolAllocation>& removed, std::vector<PoolAllocation>& added)
+{
+    diff(from.m_root, to.m_root, removed, added);
+}
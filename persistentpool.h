@@ -0,0 +1,94 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef PERSISTENTPOOL_H
+#define PERSISTENTPOOL_H
+
+#include <vector>
+
+#include <directfb.h>
+
+#include <core/remote_tracing.h>
+
+#include "poolstate.h"
+
+// The allocations of a pool as an immutable treap keyed by offset. A change
+// copies the O(log n) nodes on its path and shares everything else with the
+// previous version, so keeping a version around costs only what changed
+// since. Priorities derive from the offsets: a given set of allocations
+// always has the same shape, which keeps the diff of close versions cheap.
+// Not thread safe, all the versions of all the pools are meant to stay on
+// one thread.
+class PersistentPool
+{
+public:
+    PersistentPool();
+    explicit PersistentPool(const DFBTracingBufferData* info);
+    PersistentPool(const PersistentPool& other);
+    ~PersistentPool();
+
+    PersistentPool& operator=(const PersistentPool& other);
+
+    const DFBTracingBufferData& info() const { return m_info; }
+
+    unsigned int count() const { return m_count; }
+
+    void insert(const PoolAllocation& allocation);
+    bool erase(unsigned int offset);
+    void clear();
+
+    const PoolAllocation* lookup(unsigned int offset) const;
+
+    // In offset order
+    void allocations(std::vector<PoolAllocation>& allocations) const;
+
+    // What to remove from, then add to from to get to, only walking the
+    // subtrees the two versions don't share
+    static void diff(const PersistentPool& from, const PersistentPool& to,
+                     std::vector<PoolAllocation>& removed, std::vector<PoolAllocation>& added);
+
+    // Live nodes, over all the versions of all the pools. A plain counter
+    // shared by every instance: this is what keeps PersistentPool to a
+    // single thread, even for versions that share no nodes.
+    static unsigned int nodeCount();
+    static unsigned int nodeSize();
+
+private:
+    struct Node;
+
+    static unsigned int priority(unsigned int offset);
+    static bool above(unsigned int priority, unsigned int offset, const Node* node);
+
+    static Node* retain(Node* node);
+    static void release(Node* node);
+    static Node* make(const PoolAllocation& allocation, unsigned int priority, Node* left, Node* right);
+
+    static Node* insert(Node* node, const PoolAllocation& allocation, unsigned int priority);
+    static Node* erase(Node* node, unsigned int offset, bool& erased);
+    static Node* merge(Node* left, Node* right);
+    static void split(Node* node, unsigned int offset, Node*& left, Node*& right);
+
+    static void collect(const Node* node, std::vector<PoolAllocation>& allocations);
+    static void diff(Node* from, Node* to, std::vector<PoolAllocation>& removed, std::vector<PoolAllocation>& added);
+
+    Node *m_root;
+    unsigned int m_count;
+
+    DFBTracingBufferData m_info;
+};
+
+#endif // PERSISTENTPOOL_H
@@ -0,0 +1,226 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "pipelinestats.h"
+
+#define SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+
+// Single writer: plain loads and stores, only kept atomic for the readers
+#define LOAD(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+
+static unsigned int bucketIndex(unsigned long long value)
+{
+    if (value < SUB_BUCKETS)
+        return value;
+
+    unsigned int shift = (63 - __builtin_clzll(value)) - HISTOGRAM_SUB_BITS;
+
+    return ((shift + 1) << HISTOGRAM_SUB_BITS) + ((value >> shift) & (SUB_BUCKETS - 1));
+}
+
+static unsigned long long bucketHighest(unsigned int index)
+{
+    if (index < SUB_BUCKETS)
+        return index;
+
+    unsigned int shift = (index >> HISTOGRAM_SUB_BITS) - 1;
+    unsigned long long sub = index & (SUB_BUCKETS - 1);
+
+    return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+    clear();
+}
+
+void LatencyHistogram::record(unsigned long long ns)
+{
+    unsigned int i = bucketIndex(ns);
+
+    STORE(m_counts[i], m_counts[i] + 1);
+    STORE(m_total, m_total + ns);
+
+    if (ns > m_max)
+        STORE(m_max, ns);
+
+    // Published last, a reader never sees more samples than buckets hold
+    __atomic_store_n(&m_count, m_count + 1, __ATOMIC_RELEASE);
+}
+
+void LatencyHistogram::clear()
+{
+    memset(m_counts, 0, sizeof(m_counts));
+
+    m_count = m_total = m_max = 0;
+}
+
+void LatencyHistogram::snapshot(LatencyHistogram& copy) const
+{
+    copy.m_count = __atomic_load_n(&m_count, __ATOMIC_ACQUIRE);
+    copy.m_total = LOAD(m_total);
+    copy.m_max = LOAD(m_max);
+
+    for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; i++)
+        copy.m_counts[i] = LOAD(m_counts[i]);
+}
+
+unsigned long long LatencyHistogram::percentile(double p) const
+{
+    unsigned long long total = 0, seen = 0;
+
+    for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; i++)
+        total += m_counts[i];
+
+    if (!total)
+        return 0;
+
+    unsigned long long rank = (unsigned long long)((p / 100.0) * total + 0.5);
+
+    if (rank < 1)
+        rank = 1;
+
+    for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += m_counts[i];
+
+        if (seen >= rank) {
+            unsigned long long highest = bucketHighest(i);
+
+            return (highest < m_max) ? highest : m_max;
+        }
+    }
+
+    return m_max;
+}
+
+PipelineStats::PipelineStats()
+{
+    m_enabled = false;
+
+    reset();
+}
+
+void PipelineStats::setEnabled(bool enabled)
+{
+    __atomic_store_n(&m_enabled, enabled, __ATOMIC_RELAXED);
+}
+
+void PipelineStats::reset()
+{
+    for (unsigned int i = 0; i < STAGE_COUNT; i++) {
+        m_stages[i].clear();
+
+        m_lastCounts[i] = 0;
+        m_rates[i] = 0.0;
+    }
+
+    m_lastUpdate = now();
+}
+
+void PipelineStats::updateRates()
+{
+    unsigned long long time = now();
+
+    if ((time - m_lastUpdate) < 1000000000ULL)
+        return;
+
+    for (unsigned int i = 0; i < STAGE_COUNT; i++) {
+        unsigned long long count = m_stages[i].count();
+
+        m_rates[i] = (count - m_lastCounts[i]) * 1000000000.0 / (time - m_lastUpdate);
+        m_lastCounts[i] = count;
+    }
+
+    m_lastUpdate = time;
+}
+
+void PipelineStats::summary(PipelineStage stage, StageSummary& result) const
+{
+    LatencyHistogram histogram;
+
+    m_stages[stage].snapshot(histogram);
+
+    result.count = histogram.count();
+    result.rate = m_rates[stage];
+    result.mean = histogram.mean();
+    result.p50 = histogram.percentile(50.0);
+    result.p90 = histogram.percentile(90.0);
+    result.p99 = histogram.percentile(99.0);
+    result.p999 = histogram.percentile(99.9);
+    result.max = histogram.max();
+}
+
+bool PipelineStats::writeJson(const char* fileName) const
+{
+    FILE *out = fopen(fileName, "w");
+
+    if (!out)
+        return false;
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"enabled\": %s,\n", isEnabled() ? "true" : "false");
+    fprintf(out, "  \"stages\": [");
+
+    for (unsigned int i = 0; i < STAGE_COUNT; i++) {
+        StageSummary stage;
+
+        summary((PipelineStage)i, stage);
+
+        fprintf(out, "%s\n    {\n", i ? "," : "");
+        fprintf(out, "      \"stage\": \"%s\",\n", stageName((PipelineStage)i));
+        fprintf(out, "      \"count\": %llu,\n", stage.count);
+        fprintf(out, "      \"eventsPerSecond\": %.1f,\n", stage.rate);
+        fprintf(out, "      \"meanNs\": %.1f,\n", stage.mean);
+        fprintf(out, "      \"p50Ns\": %llu,\n", stage.p50);
+        fprintf(out, "      \"p90Ns\": %llu,\n", stage.p90);
+        fprintf(out, "      \"p99Ns\": %llu,\n", stage.p99);
+        fprintf(out, "      \"p999Ns\": %llu,\n", stage.p999);
+        fprintf(out, "      \"maxNs\": %llu\n", stage.max);
+        fprintf(out, "    }");
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+
+    return fclose(out) == 0;
+}
+
+const char* PipelineStats::stageName(PipelineStage stage)
+{
+    static const char* names[STAGE_COUNT] = {
+        "kernelReceive",
+        "decode",
+        "process",
+        "queue",
+        "scene",
+        "paint"
+    };
+
+    return (stage < STAGE_COUNT) ? names[stage] : "unknown";
+}
+
+unsigned long long PipelineStats::now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
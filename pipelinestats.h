@@ -0,0 +1,131 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef PIPELINESTATS_H
+#define PIPELINESTATS_H
+
+// 16 sub-buckets per power of two: ~6% resolution over the whole 64 bit range
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+// Where time goes between a datagram arriving and its pixels appearing
+typedef enum {
+    STAGE_KERNEL_RECEIVE, // timestamped by the kernel -> returned by recvmmsg()
+    STAGE_DECODE,         // PacketDecoder::receivePacket(), reordering included
+    STAGE_PROCESS,        // PacketDecoder::processPacket() of an in-order packet
+    STAGE_QUEUE,          // pushed by the receiver -> dequeued by the main thread
+    STAGE_SCENE,          // pool state and scene update for one event
+    STAGE_PAINT,          // repaint of a render target
+    STAGE_COUNT
+} PipelineStage;
+
+// Log-linear latency histogram in ns. Written by a single thread, other
+// threads read it through snapshot().
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(unsigned long long ns);
+    void clear();
+
+    void snapshot(LatencyHistogram& copy) const;
+
+    unsigned long long count() const { return __atomic_load_n(&m_count, __ATOMIC_RELAXED); }
+    unsigned long long max() const { return m_max; }
+    double mean() const { return m_count ? ((double)m_total / m_count) : 0.0; }
+
+    // Highest value of the bucket holding the p-th percentile, 0 <= p <= 100
+    unsigned long long percentile(double p) const;
+
+private:
+    unsigned long long m_counts[HISTOGRAM_BUCKETS];
+    unsigned long long m_count;
+    unsigned long long m_total;
+    unsigned long long m_max;
+};
+
+struct StageSummary {
+    unsigned long long count;
+    double rate; // events per second
+
+    double mean; // in ns
+    unsigned long long p50;
+    unsigned long long p90;
+    unsigned long long p99;
+    unsigned long long p999;
+    unsigned long long max;
+};
+
+class PipelineStats
+{
+public:
+    PipelineStats();
+
+    // Disabled stages don't even read the clock
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return __atomic_load_n(&m_enabled, __ATOMIC_RELAXED); }
+
+    // Only while no stage is being recorded
+    void reset();
+
+    void record(PipelineStage stage, unsigned long long ns) { m_stages[stage].record(ns); }
+
+    // Refreshes the events/s gauges, at most once per second
+    void updateRates();
+
+    void summary(PipelineStage stage, StageSummary& result) const;
+
+    bool writeJson(const char* fileName) const;
+
+    static const char* stageName(PipelineStage stage);
+
+    static unsigned long long now(); // CLOCK_MONOTONIC, in ns
+
+private:
+    LatencyHistogram m_stages[STAGE_COUNT];
+
+    unsigned long long m_lastCounts[STAGE_COUNT];
+    double m_rates[STAGE_COUNT];
+    unsigned long long m_lastUpdate;
+
+    bool m_enabled;
+};
+
+// Records the lifetime of a scope into a stage
+class StageTimer
+{
+public:
+    StageTimer(PipelineStats* stats, PipelineStage stage)
+    {
+        m_stats = (stats && stats->isEnabled()) ? stats : 0;
+        m_stage = stage;
+        m_start = m_stats ? PipelineStats::now() : 0;
+    }
+
+    ~StageTimer()
+    {
+        if (m_stats)
+            m_stats->record(m_stage, PipelineStats::now() - m_start);
+    }
+
+private:
+    PipelineStats *m_stats;
+    PipelineStage m_stage;
+    unsigned long long m_start;
+};
+
+#endif // PIPELINESTATS_H
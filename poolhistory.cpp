@@ -0,0 +1,209 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <vector>
+
+#include "poolhistory.h"
+
+PoolHistory::PoolHistory()
+{
+    setCheckpointing(DEFAULT_CHECKPOINT_INTERVAL, DEFAULT_HISTORY_MEMORY);
+}
+
+void PoolHistory::clear()
+{
+    m_current.clear();
+    m_checkpoints.clear();
+
+    m_interval = m_baseInterval;
+}
+
+void PoolHistory::setCheckpointing(unsigned int interval, unsigned int megabytes)
+{
+    m_baseInterval = m_interval = interval ? interval : 1;
+    m_maxNodes = ((unsigned long long)megabytes * 1024 * 1024) / PersistentPool::nodeSize();
+
+    thin();
+}
+
+void PoolHistory::poolReset(const DFBTracingBufferData* data)
+{
+    Version::iterator it = m_current.find(data->poolId);
+
+    if (it != m_current.end())
+        it->second.clear();
+}
+
+void PoolHistory::bufferAllocation(const DFBTracingBufferData* data)
+{
+    Version::iterator it = m_current.find(data->poolId);
+    PoolAllocation allocation;
+
+    if (it == m_current.end())
+        it = m_current.insert(std::make_pair(data->poolId, PersistentPool(data))).first;
+
+    allocation.offset = data->offset;
+    allocation.size = data->size;
+    allocation.width = data->width;
+    allocation.height = data->height;
+    allocation.format = data->format;
+
+    it->second.insert(allocation);
+}
+
+void PoolHistory::bufferRelease(const DFBTracingBufferData* data)
+{
+    Version::iterator it = m_current.find(data->poolId);
+
+    if (it != m_current.end())
+        it->second.erase(data->offset);
+}
+
+void PoolHistory::advance(unsigned int packetIndex)
+{
+    if (!(packetIndex % m_interval) && !m_checkpoints.count(packetIndex))
+        checkpoint(packetIndex);
+}
+
+void PoolHistory::checkpoint(unsigned int packetIndex)
+{
+    // Only the roots are copied
+    m_checkpoints[packetIndex] = m_current;
+
+    thin();
+}
+
+void PoolHistory::thin()
+{
+    while (m_maxNodes && (PersistentPool::nodeCount() > m_maxNodes) && (m_checkpoints.size() > 1)) {
+        std::map<unsigned int, Version>::iterator it = m_checkpoints.begin();
+
+        m_interval *= 2;
+
+        // The first one always stays, there is nothing to replay from otherwise
+        for (++it; it != m_checkpoints.end(); ) {
+            if (it->first % m_interval)
+                m_checkpoints.erase(it++);
+            else
+                ++it;
+        }
+    }
+}
+
+bool PoolHistory::nearestCheckpoint(unsigned int packetIndex, unsigned int& checkpointIndex) const
+{
+    std::map<unsigned int, Version>::const_iterator it = m_checkpoints.upper_bound(packetIndex);
+
+    if (it == m_checkpoints.begin())
+        return false;
+
+    --it;
+
+    checkpointIndex = it->first;
+
+    return true;
+}
+
+bool PoolHistory::restore(unsigned int packetIndex, unsigned int& checkpointIndex)
+{
+    if (!nearestCheckpoint(packetIndex, checkpointIndex))
+        return false;
+
+    m_current = m_checkpoints[checkpointIndex];
+
+    return true;
+}
+
+void PoolHistory::load(const TraceKeyframe& keyframe)
+{
+    m_current.clear();
+
+    for (unsigned int i = 0; i < keyframe.pools.size(); i++) {
+        const TraceKeyframePool& pool = keyframe.pools[i];
+        PersistentPool& version = m_current[pool.info.poolId];
+
+        version = PersistentPool(&pool.info);
+
+        for (unsigned int j = 0; j < pool.allocations.size(); j++)
+            version.insert(pool.allocations[j]);
+    }
+}
+
+static void fillData(DFBTracingBufferData& data, const PoolAllocation& allocation)
+{
+    data.offset = allocation.offset;
+    data.size = allocation.size;
+    data.width = allocation.width;
+    data.height = allocation.height;
+    data.format = allocation.format;
+}
+
+void PoolHistory::diff(const Version& from, PacketListener* listener) const
+{
+    const PersistentPool empty;
+
+    std::vector<PoolAllocation> removed, added;
+    std::vector<DFBTracingBufferData> releases, allocations;
+
+    Version::const_iterator it;
+
+    // Pools the current version lost, or changed
+    for (it = from.begin(); it != from.end(); ++it) {
+        Version::const_iterator to = m_current.find(it->first);
+        DFBTracingBufferData data = it->second.info();
+
+        removed.clear();
+        added.clear();
+
+        PersistentPool::diff(it->second, (to != m_current.end()) ? to->second : empty, removed, added);
+
+        for (unsigned int i = 0; i < removed.size(); i++) {
+            fillData(data, removed[i]);
+            releases.push_back(data);
+        }
+
+        if (to != m_current.end())
+            data = to->second.info();
+
+        for (unsigned int i = 0; i < added.size(); i++) {
+            fillData(data, added[i]);
+            allocations.push_back(data);
+        }
+    }
+
+    // Pools that weren't there
+    for (it = m_current.begin(); it != m_current.end(); ++it) {
+        if (from.count(it->first))
+            continue;
+
+        DFBTracingBufferData data = it->second.info();
+
+        added.clear();
+        it->second.allocations(added);
+
+        for (unsigned int i = 0; i < added.size(); i++) {
+            fillData(data, added[i]);
+            allocations.push_back(data);
+        }
+    }
+
+    for (unsigned int i = 0; i < releases.size(); i++)
+        listener->bufferRelease(&releases[i]);
+
+    for (unsigned int i = 0; i < allocations.size(); i++)
+        listener->bufferAllocation(&allocations[i]);
+}
@@ -0,0 +1,85 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef POOLHISTORY_H
+#define POOLHISTORY_H
+
+#include <map>
+
+#include <core/remote_tracing.h>
+
+#include "packetdecoder.h"
+#include "persistentpool.h"
+#include "traceindex.h"
+
+#define DEFAULT_CHECKPOINT_INTERVAL 256 // in packets
+#define DEFAULT_HISTORY_MEMORY 256 // in MB
+
+// Every pool of a trace being played, as persistent versions: a checkpoint
+// taken every few packets only costs the nodes changed since the previous
+// one. Reaching any position restores the last checkpoint before it and
+// replays at most an interval worth of packets, after which the diff with
+// the version shown walks only what actually differs, in both directions.
+class PoolHistory : public PacketListener
+{
+public:
+    typedef std::map<unsigned int, PersistentPool> Version;
+
+    PoolHistory();
+
+    void clear();
+
+    // Whenever the versions hold more than megabytes of nodes, every other
+    // checkpoint goes and the interval doubles
+    void setCheckpointing(unsigned int interval, unsigned int megabytes);
+
+    unsigned int checkpointInterval() const { return m_interval; }
+    unsigned int checkpointCount() const { return m_checkpoints.size(); }
+
+    void poolReset(const DFBTracingBufferData* data);
+    void bufferAllocation(const DFBTracingBufferData* data);
+    void bufferRelease(const DFBTracingBufferData* data);
+
+    const Version& current() const { return m_current; }
+
+    // The current version is the state right before packetIndex, keeps it
+    // when a checkpoint is due there
+    void advance(unsigned int packetIndex);
+    void checkpoint(unsigned int packetIndex);
+
+    // Makes the last checkpoint at or before packetIndex current
+    bool restore(unsigned int packetIndex, unsigned int& checkpointIndex);
+    bool nearestCheckpoint(unsigned int packetIndex, unsigned int& checkpointIndex) const;
+
+    void load(const TraceKeyframe& keyframe);
+
+    // Turns from into the current version through listener, all the
+    // releases come before the allocations
+    void diff(const Version& from, PacketListener* listener) const;
+
+private:
+    void thin();
+
+    Version m_current;
+    std::map<unsigned int, Version> m_checkpoints; // by packet index
+
+    unsigned int m_interval;
+    unsigned int m_baseInterval;
+    unsigned int m_maxNodes;
+};
+
+#endif // POOLHISTORY_H
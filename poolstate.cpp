@@ -0,0 +1,240 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <string.h>
+#include <algorithm>
+
+#include "poolstate.h"
+
+PoolState::PoolState(const DFBTracingBufferData* info)
+{
+    m_poolId = info->poolId;
+    m_poolSize = info->poolSize;
+
+    strncpy(m_name, info->name, sizeof(m_name));
+    m_name[sizeof(m_name) - 1] = 0;
+
+    m_allocated = 0;
+    m_peakUsage = 0;
+    m_lowestUsage = 0xffffffff;
+
+    m_stale = false;
+
+    clearFreeBlocks();
+}
+
+unsigned int PoolState::find(unsigned int offset) const
+{
+    unsigned int lo = 0, hi = m_allocations.size();
+
+    while (lo < hi) {
+        unsigned int mid = (lo + hi) / 2;
+
+        if (m_allocations[mid].offset < offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+void PoolState::allocate(const DFBTracingBufferData* data)
+{
+    PoolAllocation allocation;
+
+    allocation.offset = data->offset;
+    allocation.size = data->size;
+    allocation.width = data->width;
+    allocation.height = data->height;
+    allocation.format = data->format;
+
+    unsigned int i = find(allocation.offset);
+
+    // A stale entry at the same offset means we missed its release
+    if ((i < m_allocations.size()) && (m_allocations[i].offset == allocation.offset))
+        release(allocation.offset);
+
+    // The gap the allocation lands in is split in two
+    removeFreeBlock(gapBefore(i));
+
+    m_allocations.insert(m_allocations.begin() + i, allocation);
+    m_allocated += allocation.size;
+
+    addFreeBlock(gapBefore(i));
+    addFreeBlock(gapBefore(i + 1));
+
+    updateUsage();
+
+    for (unsigned int j = 0; j < m_observers.size(); j++)
+        m_observers[j]->allocationAdded(allocation);
+}
+
+bool PoolState::release(unsigned int offset)
+{
+    unsigned int i = find(offset);
+
+    if ((i == m_allocations.size()) || (m_allocations[i].offset != offset))
+        return false;
+
+    PoolAllocation allocation = m_allocations[i];
+
+    // The gaps on both sides merge
+    removeFreeBlock(gapBefore(i));
+    removeFreeBlock(gapBefore(i + 1));
+
+    m_allocations.erase(m_allocations.begin() + i);
+    m_allocated -= allocation.size;
+
+    addFreeBlock(gapBefore(i));
+
+    updateUsage();
+
+    for (unsigned int j = 0; j < m_observers.size(); j++)
+        m_observers[j]->allocationRemoved(allocation);
+
+    return true;
+}
+
+void PoolState::reset()
+{
+    m_allocations.clear();
+    m_allocated = 0;
+
+    clearFreeBlocks();
+
+    for (unsigned int j = 0; j < m_observers.size(); j++)
+        m_observers[j]->poolReset();
+}
+
+void PoolState::setStale(bool stale)
+{
+    if (m_stale == stale)
+        return;
+
+    m_stale = stale;
+
+    for (unsigned int j = 0; j < m_observers.size(); j++)
+        m_observers[j]->poolStaleChanged(stale);
+}
+
+const PoolAllocation* PoolState::lookup(unsigned int offset) const
+{
+    unsigned int i = find(offset);
+
+    if ((i == m_allocations.size()) || (m_allocations[i].offset != offset))
+        return 0;
+
+    return &m_allocations[i];
+}
+
+unsigned int PoolState::lowerBound(unsigned int offset) const
+{
+    unsigned int i = find(offset);
+
+    // The previous allocation may still straddle offset
+    if ((i > 0) && ((m_allocations[i - 1].offset + m_allocations[i - 1].size) > offset))
+        i--;
+
+    return i;
+}
+
+float PoolState::usageRatio() const
+{
+    return m_poolSize ? ((m_allocated / (float)m_poolSize) * 100) : 0.0f;
+}
+
+float PoolState::fragmentation() const
+{
+    return m_totalFree ? ((1.0f - (largestFreeBlock() / (float)m_totalFree)) * 100) : 0.0f;
+}
+
+unsigned int PoolState::gapBefore(unsigned int i) const
+{
+    unsigned long long start = 0, end = m_poolSize;
+
+    if (i > 0)
+        start = (unsigned long long)m_allocations[i - 1].offset + m_allocations[i - 1].size;
+
+    if (i < m_allocations.size())
+        end = m_allocations[i].offset;
+
+    if (end > m_poolSize)
+        end = m_poolSize;
+
+    return (end > start) ? (unsigned int)(end - start) : 0;
+}
+
+static unsigned int freeBlockBucket(unsigned int size)
+{
+    unsigned int bucket = 0;
+
+    while ((size >>= 1) && (bucket < (FREE_BLOCK_HISTOGRAM_BUCKETS - 1)))
+        bucket++;
+
+    return bucket;
+}
+
+void PoolState::addFreeBlock(unsigned int size)
+{
+    if (!size)
+        return;
+
+    m_freeBlocks.insert(size);
+    m_totalFree += size;
+    m_freeHistogram[freeBlockBucket(size)]++;
+}
+
+void PoolState::removeFreeBlock(unsigned int size)
+{
+    if (!size)
+        return;
+
+    std::multiset<unsigned int>::iterator it = m_freeBlocks.find(size);
+
+    if (it == m_freeBlocks.end())
+        return;
+
+    m_freeBlocks.erase(it);
+    m_totalFree -= size;
+    m_freeHistogram[freeBlockBucket(size)]--;
+}
+
+void PoolState::clearFreeBlocks()
+{
+    m_freeBlocks.clear();
+    m_totalFree = 0;
+
+    memset(m_freeHistogram, 0, sizeof(m_freeHistogram));
+
+    addFreeBlock(m_poolSize);
+}
+
+void PoolState::updateUsage()
+{
+    m_peakUsage = (m_peakUsage < m_allocated) ? m_allocated : m_peakUsage;
+    m_lowestUsage = (m_lowestUsage > m_allocated) ? m_allocated : m_lowestUsage;
+}
+
+void PoolState::addObserver(PoolStateObserver* observer)
+{
+    m_observers.push_back(observer);
+}
+
+void PoolState::removeObserver(PoolStateObserver* observer)
+{
+    m_observers.erase(std::remove(m_observers.begin(), m_observers.end(), observer), m_observers.end());
+}
@@ -0,0 +1,129 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef POOLSTATE_H
+#define POOLSTATE_H
+
+#include <set>
+#include <vector>
+
+#include <directfb.h>
+
+#include <core/remote_tracing.h>
+
+// Free blocks are counted per power of two of their size
+#define FREE_BLOCK_HISTOGRAM_BUCKETS 32
+
+struct PoolAllocation {
+    unsigned int offset;
+    unsigned int size;
+    int width;
+    int height;
+    DFBSurfacePixelFormat format;
+};
+
+class PoolStateObserver
+{
+public:
+    virtual ~PoolStateObserver() {}
+
+    virtual void allocationAdded(const PoolAllocation& allocation) = 0;
+    virtual void allocationRemoved(const PoolAllocation& allocation) = 0;
+    virtual void poolReset() = 0;
+    virtual void poolStaleChanged(bool stale) { (void)stale; }
+};
+
+// Live allocations of a single surface pool, kept in a flat array sorted by
+// offset: lookups are O(log n), allocate() and release() shift the tail of
+// the array and are O(n). Has no dependency on Qt so it can be driven
+// headless.
+class PoolState
+{
+public:
+    explicit PoolState(const DFBTracingBufferData* info);
+
+    unsigned int poolId() const { return m_poolId; }
+    unsigned int poolSize() const { return m_poolSize; }
+    const char* name() const { return m_name; }
+
+    void allocate(const DFBTracingBufferData* data);
+    bool release(unsigned int offset);
+    void reset();
+
+    // Set while the pool may have missed events and waits for a snapshot
+    bool isStale() const { return m_stale; }
+    void setStale(bool stale);
+
+    const PoolAllocation* lookup(unsigned int offset) const;
+
+    // Index of the first allocation ending after offset, for range walks
+    unsigned int lowerBound(unsigned int offset) const;
+
+    unsigned int count() const { return m_allocations.size(); }
+    const PoolAllocation& at(unsigned int i) const { return m_allocations[i]; }
+
+    unsigned int allocated() const { return m_allocated; }
+    unsigned int peakUsage() const { return m_peakUsage; }
+    unsigned int lowestUsage() const { return m_lowestUsage; }
+    float usageRatio() const;
+
+    // Free space between the allocations. Keeping it up to date adds
+    // O(log n) to every change, on top of the array shift. Overlapping
+    // allocations, e.g. after a missed release, only leave the gaps
+    // between neighbours.
+    unsigned int freeBlockCount() const { return m_freeBlocks.size(); }
+    unsigned int largestFreeBlock() const { return m_freeBlocks.empty() ? 0 : *m_freeBlocks.rbegin(); }
+    unsigned int totalFree() const { return m_totalFree; }
+
+    // Bucket i counts the free blocks of [2^i, 2^(i + 1)) bytes
+    const unsigned int* freeBlockHistogram() const { return m_freeHistogram; }
+
+    // 0 when the free space is a single block, towards 100 as it scatters
+    float fragmentation() const;
+
+    void addObserver(PoolStateObserver* observer);
+    void removeObserver(PoolStateObserver* observer);
+
+private:
+    unsigned int find(unsigned int offset) const;
+    void updateUsage();
+
+    // Free space in front of the i-th allocation, i == count() for the tail
+    unsigned int gapBefore(unsigned int i) const;
+    void addFreeBlock(unsigned int size);
+    void removeFreeBlock(unsigned int size);
+    void clearFreeBlocks();
+
+    unsigned int m_poolId;
+    unsigned int m_poolSize;
+    char m_name[sizeof(((DFBTracingBufferData*)0)->name)];
+
+    std::vector<PoolAllocation> m_allocations;
+
+    unsigned int m_allocated;
+    unsigned int m_peakUsage;
+    unsigned int m_lowestUsage;
+
+    std::multiset<unsigned int> m_freeBlocks;
+    unsigned int m_totalFree;
+    unsigned int m_freeHistogram[FREE_BLOCK_HISTOGRAM_BUCKETS];
+
+    bool m_stale;
+
+    std::vector<PoolStateObserver *> m_observers;
+};
+
+#endif // POOLSTATE_H
@@ -14,9 +14,197 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <QPainter>
+
+#include <QWheelEvent>
+#include <QMouseEvent>
+
+#include <math.h>
+
+#include <algorithm>
+
 #include "rendertarget.h"
+#include "scenecontroller.h"
+
+#define OVERLAY_REFRESH_PERIOD 500 // in ms
+
+// Device pixels per byte at the deepest zoom
+#define MAX_PIXELS_PER_BYTE 8
+
+// Readable units for a latency in ns
+static QString formatLatency(double ns)
+{
+    QString text;
+
+    if (ns < 1000.0)
+        text.sprintf("%.0f ns", ns);
+    else if (ns < 1000000.0)
+        text.sprintf("%.1f us", ns / 1000.0);
+    else
+        text.sprintf("%.1f ms", ns / 1000000.0);
+
+    return text;
+}
 
 RenderTarget::RenderTarget(QWidget *parent) :
     QGraphicsView(parent)
 {
+    m_pipelineStats = 0;
+    m_overlayVisible = false;
+
+    // The scene only repaints what changed, the overlay needs its own refresh
+    m_overlayTimer.setInterval(OVERLAY_REFRESH_PERIOD);
+    connect(&m_overlayTimer, SIGNAL(timeout()), this, SLOT(refreshOverlay()));
+
+    setTransformationAnchor(QGraphicsView::AnchorUnderMouse);
+    setDragMode(QGraphicsView::ScrollHandDrag);
+}
+
+double RenderTarget::maxZoom()
+{
+    SceneController *scene = qobject_cast<SceneController*>(this->scene());
+
+    // Scene pixels per byte
+    float aspectRatio = scene ? scene->aspectRatio() : 0;
+
+    if (aspectRatio <= 0)
+        return 1.0;
+
+    return std::max(1.0, MAX_PIXELS_PER_BYTE / (double)aspectRatio);
+}
+
+void RenderTarget::wheelEvent(QWheelEvent *event)
+{
+    double zoom = transform().m11();
+    double target = zoom * pow(2.0, event->delta() / 240.0);
+
+    target = std::min(std::max(target, 1.0), maxZoom());
+
+    if (target != zoom)
+        scale(target / zoom, target / zoom);
+
+    event->accept();
+}
+
+void RenderTarget::scrollContentsBy(int dx, int dy)
+{
+    QGraphicsView::scrollContentsBy(dx, dy);
+
+    // The zoom label and the overlay stay put while the scene scrolls
+    viewport()->update();
+}
+
+void RenderTarget::mouseDoubleClickEvent(QMouseEvent *event)
+{
+    Q_UNUSED(event);
+
+    resetTransform();
+}
+
+void RenderTarget::setPipelineStats(PipelineStats* stats)
+{
+    m_pipelineStats = stats;
+}
+
+void RenderTarget::setOverlayVisible(bool visible)
+{
+    m_overlayVisible = visible;
+
+    if (visible)
+        m_overlayTimer.start();
+    else
+        m_overlayTimer.stop();
+
+    refreshOverlay();
+}
+
+void RenderTarget::refreshOverlay()
+{
+    viewport()->update(m_overlayRect.isEmpty() ? viewport()->rect() : m_overlayRect);
+
+    if (!m_overlayVisible)
+        m_overlayRect = QRect();
+}
+
+void RenderTarget::paintEvent(QPaintEvent *event)
+{
+    StageTimer timer(m_pipelineStats, STAGE_PAINT);
+
+    QGraphicsView::paintEvent(event);
+}
+
+void RenderTarget::drawZoom(QPainter *painter)
+{
+    SceneController *scene = qobject_cast<SceneController*>(this->scene());
+    double zoom = transform().m11();
+
+    if ((zoom <= 1.0) || !scene || (scene->aspectRatio() <= 0))
+        return;
+
+    QString text;
+    double bytesPerPixel = 1.0 / (scene->aspectRatio() * zoom);
+
+    if (bytesPerPixel >= 1.0)
+        text.sprintf("x%.1f, %.0f bytes per pixel", zoom, bytesPerPixel);
+    else
+        text.sprintf("x%.1f, %.0f pixels per byte", zoom, 1.0 / bytesPerPixel);
+
+    painter->save();
+    painter->resetTransform();
+
+    QRect bounds = painter->fontMetrics().boundingRect(text);
+
+    bounds.moveBottomLeft(QPoint(8, viewport()->height() - 8));
+
+    painter->fillRect(bounds.adjusted(-4, -4, 4, 4), QColor(0, 0, 0, 192));
+    painter->setPen(QColor(255, 255, 255));
+    painter->drawText(bounds, Qt::AlignLeft | Qt::AlignTop, text);
+
+    painter->restore();
+}
+
+void RenderTarget::drawForeground(QPainter *painter, const QRectF& rect)
+{
+    Q_UNUSED(rect);
+
+    drawZoom(painter);
+
+    if (!m_overlayVisible || !m_pipelineStats)
+        return;
+
+    QString text, line;
+
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        StageSummary stage;
+
+        m_pipelineStats->summary((PipelineStage)i, stage);
+
+        line.sprintf("%-14s %9.0f/s  p50 ", PipelineStats::stageName((PipelineStage)i), stage.rate);
+        line += formatLatency(stage.p50) + "  p99 " + formatLatency(stage.p99) + "  max " + formatLatency(stage.max);
+
+        text += line + "\n";
+    }
+
+    if (!m_pipelineStats->isEnabled())
+        text += "(instrumentation disabled)\n";
+
+    // Drawn in viewport coordinates, whatever the scene transform
+    painter->save();
+    painter->resetTransform();
+
+    QFont font("Monospace", 8);
+    font.setStyleHint(QFont::TypeWriter);
+    painter->setFont(font);
+
+    QRect bounds = painter->fontMetrics().boundingRect(QRect(0, 0, viewport()->width(), viewport()->height()),
+                                                       Qt::AlignLeft | Qt::AlignTop, text.trimmed());
+
+    bounds.moveTopRight(QPoint(viewport()->width() - 8, 8));
+    m_overlayRect = bounds.adjusted(-4, -4, 4, 4);
+
+    painter->fillRect(m_overlayRect, QColor(0, 0, 0, 192));
+    painter->setPen(QColor(0, 255, 0));
+    painter->drawText(bounds, Qt::AlignLeft | Qt::AlignTop, text.trimmed());
+
+    painter->restore();
 }
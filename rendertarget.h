@@ -18,19 +18,47 @@
 #define RENDERTARGET_H
 
 #include <QGraphicsView>
+#include <QTimer>
 
+#include "pipelinestats.h"
+
+// Shows a pool scene, fit to the view at first. The wheel zooms in down to
+// a few pixels per byte, dragging pans and a double click fits it again.
 class RenderTarget : public QGraphicsView
 {
     Q_OBJECT
 public:
     explicit RenderTarget(QWidget *parent = 0);
 
+    // Times the repaints into stats, and draws them on top of the scene
+    // when the overlay is shown
+    void setPipelineStats(PipelineStats* stats);
+    void setOverlayVisible(bool visible);
+
 signals:
 
 public slots:
 
+protected:
+    void paintEvent(QPaintEvent *event);
+    void drawForeground(QPainter *painter, const QRectF& rect);
+
+    void wheelEvent(QWheelEvent *event);
+    void scrollContentsBy(int dx, int dy);
+    void mouseDoubleClickEvent(QMouseEvent *event);
+
+private slots:
+    void refreshOverlay();
+
 private:
+    double maxZoom();
+    void drawZoom(QPainter *painter);
+
+    PipelineStats *m_pipelineStats;
 
+    bool m_overlayVisible;
+    QRect m_overlayRect;
+    QTimer m_overlayTimer;
 };
 
 #endif // RENDERTARGET_H
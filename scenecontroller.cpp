@@ -20,9 +20,175 @@
 #include <stdio.h>
 #include <assert.h>
 
+#include <algorithm>
+
 #include "scenecontroller.h"
 
-SceneController::SceneController(QObject *parent, DFBTracingBufferData *data) : QGraphicsScene(parent)
+#define MAX_FRAGMENTATION_SAMPLES 4096
+
+SceneController::SceneController(QObject *parent, PoolState *state) : QGraphicsScene(parent)
 {
     m_renderAspectRatio = 1.0f;
+
+    m_state = state;
+    m_state->addObserver(this);
+}
+
+SceneController::~SceneController()
+{
+    m_state->removeObserver(this);
+}
+
+void SceneController::poolStaleChanged(bool stale)
+{
+    (void)stale;
+
+    emit statusChanged();
+}
+
+void SceneController::sampleFragmentation(double position)
+{
+    FragmentationSample sample;
+
+    while (!m_fragmentationHistory.isEmpty() && (m_fragmentationHistory.last().position > position))
+        m_fragmentationHistory.pop_back();
+
+    if (!m_fragmentationHistory.isEmpty() && (m_fragmentationHistory.last().position == position))
+        return;
+
+    // Keep the whole timeline at a lower resolution rather than its end only
+    if (m_fragmentationHistory.size() >= MAX_FRAGMENTATION_SAMPLES) {
+        int j = 0;
+
+        for (int i = 0; i < m_fragmentationHistory.size(); i += 2)
+            m_fragmentationHistory[j++] = m_fragmentationHistory[i];
+
+        m_fragmentationHistory.resize(j);
+    }
+
+    sample.position = position;
+    sample.fragmentation = m_state->fragmentation();
+    sample.largestFree = m_state->poolSize() ? ((m_state->largestFreeBlock() * 100.0f) / m_state->poolSize()) : 0.0f;
+
+    m_fragmentationHistory.append(sample);
+}
+
+void SceneController::appendFragmentationStatus(QString& status)
+{
+    QString line;
+
+    line.sprintf("Free: %d in %d blocks, Largest free block: %d, Fragmentation: %.2f%%\n",
+                 m_state->totalFree(), m_state->freeBlockCount(), m_state->largestFreeBlock(), m_state->fragmentation());
+    status += line;
+
+    // Free block sizes, by power of two
+    const unsigned int *histogram = m_state->freeBlockHistogram();
+
+    status += "Free blocks:";
+
+    for (int i = 0; i < FREE_BLOCK_HISTOGRAM_BUCKETS; i++) {
+        if (!histogram[i])
+            continue;
+
+        if (i >= 20)
+            line.sprintf(" %dM: %d", 1 << (i - 20), histogram[i]);
+        else if (i >= 10)
+            line.sprintf(" %dK: %d", 1 << (i - 10), histogram[i]);
+        else
+            line.sprintf(" %d: %d", 1 << i, histogram[i]);
+
+        status += line;
+    }
+
+    status += "\n";
+}
+
+QRectF SceneController::spanRect(unsigned int offset, unsigned int size)
+{
+    int w = (int)width();
+
+    if (w <= 0)
+        return QRectF();
+
+    int start = (int)(offset * aspectRatio());
+    int end = (int)((offset + size) * aspectRatio());
+
+    // Rows covered by [offset, offset + size) in the linear pool layout
+    if ((end / w) > (start / w))
+        return QRectF(0, start / w, w, (end / w) - (start / w) + 1);
+
+    return QRectF(start % w, start / w, (end - start) + 1, 1);
+}
+
+QRgb SceneController::formatColor(DFBSurfacePixelFormat format)
+{
+    int idx = (DFB_PIXELFORMAT_INDEX(format) * 255) / DFB_NUM_PIXELFORMATS;
+
+    return qRgb((idx + 32) % 256, (idx + 64) % 256, (idx + 128) % 256);
+}
+
+bool SceneController::spanPixels(const QImage& image, int rows, unsigned int offset, unsigned int size, int& start, int& end)
+{
+    int w = image.width();
+
+    if (!w || (rows <= 0))
+        return false;
+
+    start = (int)(offset * m_renderAspectRatio);
+    end = (int)(((double)offset + size) * m_renderAspectRatio);
+
+    // Even the smallest allocation covers a pixel
+    end = std::max(end, start + 1);
+    end = std::min(end, w * rows);
+
+    return start < end;
+}
+
+void SceneController::fillPixels(QImage& image, int top, int start, int end, QRgb color)
+{
+    int w = image.width();
+
+    while (start < end) {
+        int y = start / w;
+        int x = start % w;
+        int n = std::min(end - start, w - x);
+
+        QRgb *line = reinterpret_cast<QRgb*>(image.scanLine(top + y));
+        std::fill(line + x, line + x + n, color);
+
+        start += n;
+    }
+}
+
+void SceneController::fillSpan(QImage& image, int top, int rows, unsigned int offset, unsigned int size, QRgb color)
+{
+    int start, end;
+
+    if (spanPixels(image, rows, offset, size, start, end))
+        fillPixels(image, top, start, end, color);
+}
+
+void SceneController::clearSpan(QImage& image, int top, int rows, const PoolState* state, unsigned int offset, unsigned int size)
+{
+    int start, end;
+
+    if (!spanPixels(image, rows, offset, size, start, end) || (m_renderAspectRatio <= 0))
+        return;
+
+    fillPixels(image, top, start, end, qRgb(0, 0, 0));
+
+    // Bytes behind the blanked pixels, in offset order like a full redraw
+    double first = start / m_renderAspectRatio;
+    double last = end / m_renderAspectRatio;
+
+    for (unsigned int i = state->lowerBound((unsigned int)first);
+         (i < state->count()) && (state->at(i).offset < last); i++) {
+        const PoolAllocation& allocation = state->at(i);
+        int from, to;
+
+        if (!spanPixels(image, rows, allocation.offset, allocation.size, from, to))
+            continue;
+
+        fillPixels(image, top, std::max(from, start), std::min(to, end), formatColor(allocation.format));
+    }
 }
@@ -18,32 +18,72 @@
 #define SCENECONTROLLER_H
 
 #include <QGraphicsScene>
+#include <QColor>
+#include <QImage>
+#include <QVector>
+
+#include <directfb.h>
 
 #include <core/remote_tracing.h>
 
-class SceneController : public QGraphicsScene
+#include "poolstate.h"
+
+struct FragmentationSample {
+    double position; // on the timeline: packets for a trace, seconds when live
+    float fragmentation; // in %
+    float largestFree; // largest free block, in % of the pool
+};
+
+class SceneController : public QGraphicsScene, public PoolStateObserver
 {
     Q_OBJECT
 public:
-    explicit SceneController(QObject *parent, DFBTracingBufferData* info);
+    explicit SceneController(QObject *parent, PoolState* state);
+    ~SceneController();
 
     virtual void setSceneRect(const QRectF &rect) = 0;
     virtual void setSceneRect(qreal x, qreal y, qreal w, qreal h) = 0;
 
     virtual float aspectRatio() = 0;
 
-    virtual void addItem(QGraphicsItem *item) = 0;
-    virtual void removeItem(QGraphicsItem *item) = 0;
+    virtual QRectF spanRect(unsigned int offset, unsigned int size);
 
-    virtual QGraphicsItem* lookup(unsigned int offset) = 0;
+    static QRgb formatColor(DFBSurfacePixelFormat format);
+
+    PoolState* state() { return m_state; }
 
     virtual void getStatus(QString& status) = 0;
 
+    void poolStaleChanged(bool stale);
+
+    // Records the free space figures of the pool at a timeline position,
+    // going back in time drops the samples past it
+    virtual void sampleFragmentation(double position);
+    const QVector<FragmentationSample>& fragmentationHistory() const { return m_fragmentationHistory; }
+
 signals:
     void statusChanged();
 
 protected:
+    void appendFragmentationStatus(QString& status);
+
+    // Occupancy bitmaps: the pool is laid out linearly over the rows
+    // [top, top + rows) of the image, m_renderAspectRatio pixels per byte
+    void fillSpan(QImage& image, int top, int rows, unsigned int offset, unsigned int size, QRgb color);
+
+    // Blanks a released span, then repaints the pixels it shares with the
+    // allocations still in state, e.g. row edges or sub-pixel neighbours
+    void clearSpan(QImage& image, int top, int rows, const PoolState* state, unsigned int offset, unsigned int size);
+
     float m_renderAspectRatio;
+
+    PoolState *m_state;
+
+private:
+    bool spanPixels(const QImage& image, int rows, unsigned int offset, unsigned int size, int& start, int& end);
+    void fillPixels(QImage& image, int top, int start, int end, QRgb color);
+
+    QVector<FragmentationSample> m_fragmentationHistory;
 };
 
 #endif // SCENECONTROLLER_H
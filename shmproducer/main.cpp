@@ -0,0 +1,113 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// dfbperf-shmproducer: stands in for a traced DirectFB process on the
+// same host. It replays a recorded trace into the shared memory ring of a
+// viewer connected with "shm:<name>", renumbering packets so that loops
+// form a single sequence.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "tracefile.h"
+#include "shmring.h"
+
+static unsigned long long monotonicUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000);
+}
+
+static void usage(const char* program)
+{
+    fprintf(stderr, "usage: %s [-r packets per second] [-l loops] ring trace\n", program);
+    fprintf(stderr, "The viewer creates the ring, connect it to shm:<ring> first.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int rate = 0; // as fast as possible
+    unsigned int loops = 1;
+    int c;
+
+    while ((c = getopt(argc, argv, "r:l:h")) != -1) {
+        switch (c) {
+        case 'r':
+            rate = strtoul(optarg, NULL, 0);
+            break;
+        case 'l':
+            loops = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return (c == 'h') ? 0 : 1;
+        }
+    }
+
+    if ((argc - optind) != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    ShmRing ring;
+    TraceFile trace;
+
+    if (!ring.attach(argv[optind])) {
+        fprintf(stderr, "%s: can't attach to ring %s\n", argv[0], argv[optind]);
+        return 1;
+    }
+
+    if (!trace.open(argv[optind + 1])) {
+        fprintf(stderr, "%s: can't open %s\n", argv[0], argv[optind + 1]);
+        return 1;
+    }
+
+    DFBTracingPacket packet;
+    unsigned int nSeq = 0, sent = 0;
+    unsigned int count = trace.packetCount();
+
+    unsigned long long start = monotonicUs();
+
+    for (unsigned int loop = 0; !loops || (loop < loops); loop++) {
+        for (unsigned int i = 0; i < count; i++) {
+            memcpy(&packet, trace.packet(i), sizeof(packet));
+
+            packet.header.nSeq = nSeq++;
+
+            // Like the UDP path, a full ring loses the packet and the viewer sees a gap
+            if (ring.push(reinterpret_cast<const char*>(&packet), sizeof(packet)))
+                sent++;
+
+            if (rate && !(nSeq % 64)) {
+                unsigned long long due = start + (nSeq * 1000000ULL) / rate;
+                unsigned long long now = monotonicUs();
+
+                if (due > now)
+                    usleep(due - now);
+            }
+        }
+    }
+
+    printf("%u packets sent, %u dropped by the ring\n", sent, nSeq - sent);
+
+    return 0;
+}
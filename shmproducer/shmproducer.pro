@@ -0,0 +1,27 @@
+#-------------------------------------------------
+#
+# Stand-in producer for the shared memory transport,
+# replays a recorded trace into a viewer's ring.
+#
+#-------------------------------------------------
+
+CONFIG   += console
+CONFIG   -= qt app_bundle
+
+TARGET = dfbperf-shmproducer
+TEMPLATE = app
+
+SOURCES += main.cpp \
+    ../shmring.cpp \
+    ../tracefile.cpp
+
+HEADERS += \
+    ../shmring.h \
+    ../tracefile.h
+
+LIBS += -lrt
+
+INCLUDEPATH += ..
+INCLUDEPATH += /home/ilyes/DirectFB-git/src
+INCLUDEPATH += /home/ilyes/DirectFB-git/include
+INCLUDEPATH += /home/ilyes/DirectFB-git/lib
@@ -0,0 +1,220 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "shmring.h"
+
+ShmRing::ShmRing()
+{
+    m_header = NULL;
+    m_records = NULL;
+
+    m_size = 0;
+    m_stride = 0;
+    m_mask = 0;
+
+    m_name[0] = 0;
+    m_owner = false;
+}
+
+ShmRing::~ShmRing()
+{
+    close();
+}
+
+bool ShmRing::map(int fd, size_t size)
+{
+    void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    // The mapping holds its own reference on the object
+    ::close(fd);
+
+    if (data == MAP_FAILED)
+        return false;
+
+    m_header = static_cast<ShmRingHeader*>(data);
+    m_records = static_cast<char*>(data) + sizeof(ShmRingHeader);
+    m_size = size;
+
+    return true;
+}
+
+// The magic is published and checked as a single 8 bytes word
+static unsigned long long* magicWord(ShmRingHeader* header)
+{
+    return reinterpret_cast<unsigned long long*>(header->magic);
+}
+
+static unsigned long long ringMagic()
+{
+    unsigned long long magic;
+
+    memcpy(&magic, SHM_RING_MAGIC, sizeof(magic));
+
+    return magic;
+}
+
+bool ShmRing::create(const char* name, unsigned int capacity)
+{
+    unsigned int records = 1;
+
+    close();
+
+    // Round up to a power of two so that indexes wrap with a mask
+    while (records < capacity)
+        records <<= 1;
+
+    snprintf(m_name, sizeof(m_name), "/%s", name);
+
+    // Start from a clean ring, a stale one may be left over by a crash
+    shm_unlink(m_name);
+
+    int fd = shm_open(m_name, O_RDWR | O_CREAT | O_EXCL, 0600);
+
+    if (fd < 0)
+        return false;
+
+    unsigned int stride = (sizeof(unsigned int) + sizeof(DFBTracingPacket) + 7) & ~7;
+    size_t size = sizeof(ShmRingHeader) + (size_t)records * stride;
+
+    if ((ftruncate(fd, size) < 0) || !map(fd, size)) {
+        shm_unlink(m_name);
+        return false;
+    }
+
+    m_header->recordSize = sizeof(DFBTracingPacket);
+    m_header->capacity = records;
+    m_header->head = m_header->tail = m_header->dropped = 0;
+
+    m_stride = stride;
+    m_mask = records - 1;
+    m_owner = true;
+
+    // Publish the ring once it is fully initialized
+    __atomic_store_n(magicWord(m_header), ringMagic(), __ATOMIC_RELEASE);
+
+    return true;
+}
+
+bool ShmRing::attach(const char* name)
+{
+    struct stat st;
+
+    close();
+
+    snprintf(m_name, sizeof(m_name), "/%s", name);
+
+    int fd = shm_open(m_name, O_RDWR, 0);
+
+    if (fd < 0)
+        return false;
+
+    if (fstat(fd, &st) || ((size_t)st.st_size < sizeof(ShmRingHeader)) || !map(fd, st.st_size))
+        return false;
+
+    // The header is only valid once the magic is there, read it first
+    if (__atomic_load_n(magicWord(m_header), __ATOMIC_ACQUIRE) != ringMagic()) {
+        close();
+        return false;
+    }
+
+    unsigned int capacity = m_header->capacity;
+    unsigned int stride = (sizeof(unsigned int) + m_header->recordSize + 7) & ~7;
+
+    // Refuse rings that don't match what this side was built for
+    if ((m_header->recordSize != sizeof(DFBTracingPacket))
+        || !capacity || (capacity & (capacity - 1))
+        || (m_size < (sizeof(ShmRingHeader) + (size_t)capacity * stride))) {
+        close();
+        return false;
+    }
+
+    m_stride = stride;
+    m_mask = capacity - 1;
+
+    return true;
+}
+
+void ShmRing::close()
+{
+    if (m_header) {
+        munmap(m_header, m_size);
+
+        m_header = NULL;
+        m_records = NULL;
+        m_size = 0;
+    }
+
+    if (m_owner) {
+        shm_unlink(m_name);
+        m_owner = false;
+    }
+}
+
+bool ShmRing::push(const char* buf, unsigned int size)
+{
+    unsigned int head = m_header->head;
+    unsigned int tail = __atomic_load_n(&m_header->tail, __ATOMIC_ACQUIRE);
+
+    if (((head - tail) > m_mask) || (size > m_header->recordSize)) {
+        __atomic_fetch_add(&m_header->dropped, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    char *slot = m_records + (size_t)(head & m_mask) * m_stride;
+
+    memcpy(slot, &size, sizeof(size));
+    memcpy(slot + sizeof(size), buf, size);
+
+    __atomic_store_n(&m_header->head, head + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+unsigned int ShmRing::available() const
+{
+    return __atomic_load_n(&m_header->head, __ATOMIC_ACQUIRE) - m_header->tail;
+}
+
+const char* ShmRing::record(unsigned int i, unsigned int& size) const
+{
+    const char *slot = m_records + (size_t)((m_header->tail + i) & m_mask) * m_stride;
+
+    memcpy(&size, slot, sizeof(size));
+
+    // Don't trust the other side with our bounds
+    if (size > m_header->recordSize)
+        size = m_header->recordSize;
+
+    return slot + sizeof(size);
+}
+
+void ShmRing::release(unsigned int count)
+{
+    __atomic_store_n(&m_header->tail, m_header->tail + count, __ATOMIC_RELEASE);
+}
+
+unsigned int ShmRing::dropped() const
+{
+    return __atomic_load_n(&m_header->dropped, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,86 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <stddef.h>
+
+#include <core/remote_tracing.h>
+
+#define SHM_RING_MAGIC "DFBSHMR1"
+
+// Layout of the ring in /dev/shm, shared with the traced process. The
+// producer and consumer indexes live on separate cache lines, records
+// follow the header, each one prefixed with its size.
+struct ShmRingHeader {
+    char magic[8];
+    unsigned int recordSize; // largest record, in bytes
+    unsigned int capacity; // in records, a power of two
+    char pad0[64 - 16];
+
+    unsigned int head; // written by the producer
+    char pad1[64 - sizeof(unsigned int)];
+
+    unsigned int tail; // written by the consumer
+    char pad2[64 - sizeof(unsigned int)];
+
+    unsigned int dropped; // records the producer couldn't fit
+    char pad3[64 - sizeof(unsigned int)];
+};
+
+// Single-producer/single-consumer ring of DFBTracingPacket records in
+// shared memory. The consumer reads records in place: nothing is copied
+// until the decoder extracts the events.
+class ShmRing
+{
+public:
+    ShmRing();
+    ~ShmRing();
+
+    // Consumer side: creates the ring and removes it on close()
+    bool create(const char* name, unsigned int capacity);
+
+    // Producer side: maps a ring created by the consumer
+    bool attach(const char* name);
+
+    void close();
+
+    bool isOpen() const { return m_header != NULL; }
+
+    bool push(const char* buf, unsigned int size);
+
+    unsigned int available() const;
+    const char* record(unsigned int i, unsigned int& size) const;
+    void release(unsigned int count);
+
+    unsigned int dropped() const;
+
+private:
+    bool map(int fd, size_t size);
+
+    ShmRingHeader *m_header;
+    char *m_records;
+
+    size_t m_size;
+    unsigned int m_stride;
+    unsigned int m_mask;
+
+    char m_name[256];
+    bool m_owner;
+};
+
+#endif // SHMRING_H
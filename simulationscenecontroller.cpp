@@ -0,0 +1,215 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <QPainter>
+
+#include <algorithm>
+
+#include "simulationscenecontroller.h"
+
+// Rows left between the bands, with the label of each
+#define LANE_HEADER_HEIGHT 14
+
+SimulationSceneController::SimulationSceneController(QObject *parent, PoolState *state) :
+    SceneController(parent, state), m_simulator(state)
+{
+    m_poolSize = state->poolSize();
+    m_bandHeight = 0;
+
+    for (const char* const* name = AllocatorPolicy::names(); *name; name++)
+        m_simulator.addPolicy(AllocatorPolicy::create(*name));
+
+    // The recorded band follows the scene's own notifications
+    for (unsigned int i = 1; i < m_simulator.laneCount(); i++) {
+        LaneObserver *observer = new LaneObserver(this, i);
+
+        m_simulator.lane(i).state->addObserver(observer);
+        m_laneObservers.append(observer);
+    }
+}
+
+SimulationSceneController::~SimulationSceneController()
+{
+    for (int i = 0; i < m_laneObservers.size(); i++) {
+        m_simulator.lane(i + 1).state->removeObserver(m_laneObservers[i]);
+        delete m_laneObservers[i];
+    }
+}
+
+void SimulationSceneController::setSceneRect(const QRectF &rect)
+{
+    setSceneRect(rect.x(), rect.y(), rect.width(), rect.height());
+}
+
+void SimulationSceneController::setSceneRect(qreal x, qreal y, qreal w, qreal h)
+{
+    QGraphicsScene::setSceneRect(x, y, w, h);
+
+    m_bandHeight = std::max(0, ((int)h / (int)m_simulator.laneCount()) - LANE_HEADER_HEIGHT);
+    m_renderAspectRatio = ((int)w * m_bandHeight) / (float)m_poolSize;
+
+    m_occupancy = QImage((int)w, (int)h, QImage::Format_RGB32);
+    redraw();
+}
+
+float SimulationSceneController::aspectRatio()
+{
+    return m_renderAspectRatio;
+}
+
+QRectF SimulationSceneController::spanRect(unsigned int offset, unsigned int size)
+{
+    (void)offset;
+    (void)size;
+
+    return sceneRect();
+}
+
+void SimulationSceneController::fillLane(int lane, const PoolAllocation& allocation)
+{
+    int top = (lane * (m_bandHeight + LANE_HEADER_HEIGHT)) + LANE_HEADER_HEIGHT;
+
+    fillSpan(m_occupancy, top, m_bandHeight, allocation.offset, allocation.size, formatColor(allocation.format));
+}
+
+void SimulationSceneController::clearLane(int lane, const PoolAllocation& allocation)
+{
+    int top = (lane * (m_bandHeight + LANE_HEADER_HEIGHT)) + LANE_HEADER_HEIGHT;
+
+    // The allocation is already gone from the lane's pool
+    clearSpan(m_occupancy, top, m_bandHeight, m_simulator.lane(lane).state, allocation.offset, allocation.size);
+}
+
+void SimulationSceneController::redraw()
+{
+    m_occupancy.fill(qRgb(0, 0, 0));
+
+    for (unsigned int lane = 0; lane < m_simulator.laneCount(); lane++) {
+        const PoolState *state = m_simulator.lane(lane).state;
+
+        for (unsigned int i = 0; i < state->count(); i++) {
+            fillLane(lane, state->at(i));
+        }
+    }
+}
+
+void SimulationSceneController::allocationAdded(const PoolAllocation& allocation)
+{
+    fillLane(0, allocation);
+
+    emit statusChanged();
+}
+
+void SimulationSceneController::allocationRemoved(const PoolAllocation& allocation)
+{
+    clearLane(0, allocation);
+
+    emit statusChanged();
+}
+
+void SimulationSceneController::poolReset()
+{
+    // The simulated pools are reset along, redraw them all at once
+    redraw();
+
+    emit statusChanged();
+}
+
+void SimulationSceneController::LaneObserver::allocationAdded(const PoolAllocation& allocation)
+{
+    m_scene->fillLane(m_lane, allocation);
+}
+
+void SimulationSceneController::LaneObserver::allocationRemoved(const PoolAllocation& allocation)
+{
+    m_scene->clearLane(m_lane, allocation);
+}
+
+void SimulationSceneController::LaneObserver::poolReset()
+{
+}
+
+void SimulationSceneController::sampleFragmentation(double position)
+{
+    m_simulator.setPosition(position);
+
+    SceneController::sampleFragmentation(position);
+}
+
+void SimulationSceneController::drawBackground(QPainter *painter, const QRectF &rect)
+{
+    QRect r = rect.toAlignedRect() & m_occupancy.rect();
+
+    painter->drawImage(r.topLeft(), m_occupancy, r);
+}
+
+void SimulationSceneController::drawForeground(QPainter *painter, const QRectF &rect)
+{
+    (void)rect;
+
+    if (!m_bandHeight)
+        return;
+
+    QFont font = painter->font();
+
+    font.setPixelSize(LANE_HEADER_HEIGHT - 3);
+    painter->setFont(font);
+    painter->setPen(Qt::white);
+
+    for (unsigned int i = 0; i < m_simulator.laneCount(); i++) {
+        const SimulationLane& lane = m_simulator.lane(i);
+        QString label;
+
+        label.sprintf("%s: peak footprint %.1fM, fragmentation %.1f%% (peak %.1f%%), %llu failures",
+                      m_simulator.laneName(i), lane.peakFootprint / (1024.0 * 1024.0),
+                      lane.state->fragmentation(), lane.peakFragmentation, lane.failures);
+
+        painter->drawText(QRectF(2, i * (m_bandHeight + LANE_HEADER_HEIGHT), width() - 4, LANE_HEADER_HEIGHT),
+                          Qt::AlignLeft | Qt::AlignVCenter, label);
+    }
+}
+
+void SimulationSceneController::getStatus(QString& status)
+{
+    status.sprintf("Currently allocated: %d (ratio: %.2f%%), Live allocations: %d\n"
+                   "Peak usage: %d, Lowest usage: %d\n",
+                   m_state->allocated(), m_state->usageRatio(), m_state->count(),
+                   m_state->peakUsage(), m_state->lowestUsage());
+
+    appendFragmentationStatus(status);
+
+    for (unsigned int i = 0; i < m_simulator.laneCount(); i++) {
+        const SimulationLane& lane = m_simulator.lane(i);
+        QString line;
+
+        line.sprintf("%s: peak footprint %d, lowest largest free block %d, wasted %d, failures %llu",
+                     m_simulator.laneName(i), lane.peakFootprint, lane.lowestLargestFree, lane.peakWasted,
+                     lane.failures);
+        status += line;
+
+        if (lane.firstFailure) {
+            line.sprintf(", first at allocation %llu (position %.0f, %d bytes)",
+                         lane.firstFailure, lane.firstFailurePosition, lane.firstFailureSize);
+            status += line;
+        }
+
+        status += "\n";
+    }
+
+    if (m_state->isStale())
+        status += "Out of sync, waiting for a pool snapshot\n";
+}
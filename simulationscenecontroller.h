@@ -0,0 +1,88 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef SIMULATIONSCENECONTROLLER_H
+#define SIMULATIONSCENECONTROLLER_H
+
+#include <QGraphicsScene>
+#include <QImage>
+#include <QVector>
+
+#include "scenecontroller.h"
+#include "allocatorsimulator.h"
+
+// Replays the pool through every allocator policy and draws their layouts
+// side by side, one occupancy band per policy below the recorded one.
+class SimulationSceneController : public SceneController
+{
+    Q_OBJECT
+public:
+    explicit SimulationSceneController(QObject *parent, PoolState* state);
+    ~SimulationSceneController();
+
+    void setSceneRect(const QRectF &rect);
+    void setSceneRect(qreal x, qreal y, qreal w, qreal h);
+
+    float aspectRatio();
+
+    // An event moves allocations in every band
+    QRectF spanRect(unsigned int offset, unsigned int size);
+
+    void allocationAdded(const PoolAllocation& allocation);
+    void allocationRemoved(const PoolAllocation& allocation);
+    void poolReset();
+
+    void getStatus(QString& status);
+
+    void sampleFragmentation(double position);
+
+    const AllocatorSimulator& simulator() const { return m_simulator; }
+
+protected:
+    void drawBackground(QPainter *painter, const QRectF &rect);
+    void drawForeground(QPainter *painter, const QRectF &rect);
+
+private:
+    class LaneObserver : public PoolStateObserver {
+    public:
+        LaneObserver(SimulationSceneController *scene, int lane) : m_scene(scene), m_lane(lane) {}
+
+        void allocationAdded(const PoolAllocation& allocation);
+        void allocationRemoved(const PoolAllocation& allocation);
+        void poolReset();
+
+    private:
+        SimulationSceneController *m_scene;
+        int m_lane;
+    };
+
+    // Paint the band of a lane, in the layout shared with the occupancy scene
+    void fillLane(int lane, const PoolAllocation& allocation);
+    void clearLane(int lane, const PoolAllocation& allocation);
+    void redraw();
+
+    unsigned int m_poolSize;
+
+    AllocatorSimulator m_simulator;
+    QVector<LaneObserver *> m_laneObservers;
+
+    int m_bandHeight;
+
+    QImage m_occupancy;
+};
+
+#endif // SIMULATIONSCENECONTROLLER_H
@@ -14,10 +14,58 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <math.h>
+
 #include "tracecontrollerdialog.h"
 #include "ui_tracecontrollerdialog.h"
 
-TraceControllerDialog::TraceControllerDialog(AllocationRenderController *controller, int period) :
+// The pace slider goes from 0.1x to 1000x in 10 steps per decade, its
+// last position plays as fast as possible
+#define MIN_SPEED 0.1
+#define SPEED_STEPS_PER_DECADE 10
+#define MAX_SPEED_POSITION 41
+
+static double sliderSpeed(int value)
+{
+    if (value >= MAX_SPEED_POSITION)
+        return 0.0;
+
+    return MIN_SPEED * pow(10.0, (double)value / SPEED_STEPS_PER_DECADE);
+}
+
+static int speedPosition(double speed)
+{
+    if (speed <= 0.0)
+        return MAX_SPEED_POSITION;
+
+    int value = (int)floor(log10(speed / MIN_SPEED) * SPEED_STEPS_PER_DECADE + 0.5);
+
+    return (value < 0) ? 0 : ((value < MAX_SPEED_POSITION) ? value : (MAX_SPEED_POSITION - 1));
+}
+
+static QString speedText(double speed)
+{
+    QString text;
+
+    if (speed <= 0.0)
+        text = "Playback speed (as fast as possible)";
+    else
+        text.sprintf("Playback speed (%gx)", speed);
+
+    return text;
+}
+
+static QString formatTime(double seconds)
+{
+    QString text;
+    unsigned long long ms = (unsigned long long)(seconds * 1000.0 + 0.5);
+
+    text.sprintf("%02llu:%02llu:%02llu.%03llu", ms / 3600000, (ms / 60000) % 60, (ms / 1000) % 60, ms % 1000);
+
+    return text;
+}
+
+TraceControllerDialog::TraceControllerDialog(AllocationRenderController *controller, double speed) :
     QDialog(0),
     ui(new Ui::TraceControllerDialog)
 {
@@ -25,23 +73,26 @@ TraceControllerDialog::TraceControllerDialog(AllocationRenderController *control
     ui->setupUi(this);
 
     connect(ui->play, SIGNAL(toggled(bool)), this, SLOT(playPausePressed(bool)));
-    connect(ui->renderPace, SIGNAL(sliderMoved(int)), this, SLOT(renderPace(int)));
+    connect(ui->renderPace, SIGNAL(valueChanged(int)), this, SLOT(renderPace(int)));
 
     connect(ui->timelineSlider, SIGNAL(sliderMoved(int)), this, SLOT(timeLineSliderMoved(int)));
     connect(ui->timelineSlider, SIGNAL(sliderReleased()), this, SLOT(timeLineSliderReleased()));
 
+    connect(ui->usageTimeline, SIGNAL(seekRequested(int)), this, SLOT(usageTimeLineClicked(int)));
+
     ui->play->setText("&Play");
 
     setFixedSize(width(), height());
 
-    ui->renderPace->setValue(period);
+    ui->renderPace->blockSignals(true);
+    ui->renderPace->setRange(0, MAX_SPEED_POSITION);
+    ui->renderPace->setValue(speedPosition(speed));
+    ui->renderPace->blockSignals(false);
 
     m_max = 0;
+    m_indexed = 100;
 
-    char buf[64];
-
-    sprintf(buf, "Rendering Pace (%d ms)", period);
-    ui->label->setText(buf);
+    ui->label->setText(speedText(speed));
 
     setWindowTitle("Trace Controller");
 }
@@ -64,35 +115,33 @@ void TraceControllerDialog::playPausePressed(bool toggled)
 
 void TraceControllerDialog::renderPace(int value)
 {
-    char buf[64];
+    double speed = sliderSpeed(value);
 
-    sprintf(buf, "Rendering Pace (%d ms)", value);
-    ui->label->setText(buf);
+    ui->label->setText(speedText(speed));
 
-    emit renderPaceChanged(value);
+    emit playbackSpeedChanged(speed);
 }
 
-void TraceControllerDialog::setTimeLineMinMax(int min, int max)
+void TraceControllerDialog::setTimeLineMinMax(int min, int max, double duration)
 {
-    char buf[64];
-
-    sprintf(buf, "Timeline (%d frames)", max);
-    ui->label_2->setText(buf);
-
     m_max = max;
+    m_duration = formatTime(duration);
+
+    m_timeLine = QString("%1, %2 packets").arg(m_duration).arg(max);
+    showTimeLine();
 
     ui->timelineSlider->setMinimum(min);
     ui->timelineSlider->setMaximum(max);
 }
 
-void TraceControllerDialog::setTimeLinePosition(int value)
+void TraceControllerDialog::setTimeLinePosition(int value, double time)
 {
-    char buf[64];
-
-    sprintf(buf, "Timeline (%d/%d frames)", value, m_max);
-    ui->label_2->setText(buf);
+    m_timeLine = QString("%1 / %2, packet %3/%4").arg(formatTime(time)).arg(m_duration)
+                                                  .arg(value).arg(m_max);
+    showTimeLine();
 
     ui->timelineSlider->setValue(value);
+    ui->usageTimeline->setPosition(value);
 }
 
 void TraceControllerDialog::stop()
@@ -101,8 +150,32 @@ void TraceControllerDialog::stop()
     ui->play->setChecked(false);
 
     ui->timelineSlider->setValue(0);
+    ui->usageTimeline->setPosition(0);
+
+    m_timeLine.clear();
+    showTimeLine();
+}
+
+void TraceControllerDialog::setIndexProgress(unsigned int packets, unsigned int packetCount)
+{
+    m_indexed = ((packets < packetCount) && packetCount) ? (int)((100ull * packets) / packetCount) : 100;
+
+    showTimeLine();
+}
+
+void TraceControllerDialog::setIndexer(TraceIndexer* indexer)
+{
+    ui->usageTimeline->setIndexer(indexer);
+}
+
+void TraceControllerDialog::showTimeLine()
+{
+    QString details = m_timeLine;
+
+    if (m_indexed < 100)
+        details += QString(details.isEmpty() ? "%1% indexed" : ", %1% indexed").arg(m_indexed);
 
-    ui->label_2->setText("Timeline");
+    ui->label_2->setText(details.isEmpty() ? QString("Timeline") : QString("Timeline (%1)").arg(details));
 }
 
 void TraceControllerDialog::timeLineSliderMoved(int value)
@@ -115,3 +188,11 @@ void TraceControllerDialog::timeLineSliderReleased()
     int value = ui->timelineSlider->value();
     emit timeLineReleased(value);
 }
+
+void TraceControllerDialog::usageTimeLineClicked(int value)
+{
+    ui->timelineSlider->setValue(value);
+    ui->usageTimeline->setPosition(value);
+
+    emit timeLineReleased(value);
+}
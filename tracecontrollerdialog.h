@@ -32,16 +32,25 @@ class TraceControllerDialog : public QDialog
     Q_OBJECT
 
 public:
-    TraceControllerDialog(AllocationRenderController *controller, int period);
+    // A speed of 0 plays as fast as possible
+    TraceControllerDialog(AllocationRenderController *controller, double speed);
     ~TraceControllerDialog();
 
-    void setTimeLineMinMax(int min, int max);
-    void setTimeLinePosition(int value);
+    // How much of the trace the background indexer went through
+    void setIndexProgress(unsigned int packets, unsigned int packetCount);
+
+    // Plots the pool usages it summarizes under the timeline
+    void setIndexer(TraceIndexer* indexer);
 
     void stop();
 
+public slots:
+    // Packet positions, along with their time since the first packet
+    void setTimeLineMinMax(int min, int max, double duration);
+    void setTimeLinePosition(int value, double time);
+
 signals:
-    void renderPaceChanged(int value);
+    void playbackSpeedChanged(double speed);
     void pausePlayback();
     void resumePlayback();
     void timeLineTracking(int value);
@@ -52,13 +61,20 @@ private slots:
     void renderPace(int value);
     void timeLineSliderMoved(int value);
     void timeLineSliderReleased();
+    void usageTimeLineClicked(int value);
 
 private:
+    void showTimeLine();
+
     Ui::TraceControllerDialog *ui;
 
     AllocationRenderController *m_parent;
 
     int m_max;
+    QString m_duration;
+
+    QString m_timeLine;
+    int m_indexed; // in %
 };
 
 #endif // TRACECONTROLLERDIALOG_H
@@ -0,0 +1,143 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "tracefile.h"
+
+#define REVERSE_PREFETCH_WINDOW (1024 * 1024) // in bytes
+
+TraceFile::TraceFile()
+{
+    m_data = NULL;
+    m_size = 0;
+
+    m_pattern = ACCESS_SEQUENTIAL;
+    m_prefetchedFrom = 0;
+}
+
+TraceFile::~TraceFile()
+{
+    close();
+}
+
+bool TraceFile::open(const char* traceName)
+{
+    struct stat st;
+
+    close();
+
+    int fd = ::open(traceName, O_RDONLY);
+
+    if (fd < 0)
+        return false;
+
+    if (fstat(fd, &st) || !st.st_size) {
+        ::close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // The mapping holds its own reference on the file
+    ::close(fd);
+
+    if (data == MAP_FAILED)
+        return false;
+
+    m_data = static_cast<const char*>(data);
+    m_size = st.st_size;
+
+    advise(ACCESS_SEQUENTIAL);
+
+    return true;
+}
+
+void TraceFile::close()
+{
+    if (m_data) {
+        munmap(const_cast<char*>(m_data), m_size);
+
+        m_data = NULL;
+        m_size = 0;
+    }
+}
+
+const char* TraceFile::packet(unsigned int i)
+{
+    if (i >= packetCount())
+        return NULL;
+
+    // The kernel only reads ahead forward, fetch the window below us ourselves
+    if ((m_pattern == ACCESS_REVERSE) && (i < m_prefetchedFrom)) {
+        size_t end = (size_t)(i + 1) * sizeof(DFBTracingPacket);
+        size_t start = (end > REVERSE_PREFETCH_WINDOW) ? (end - REVERSE_PREFETCH_WINDOW) : 0;
+
+        adviseRange(start, end, MADV_WILLNEED);
+
+        m_prefetchedFrom = start / sizeof(DFBTracingPacket);
+    }
+
+    return m_data + (size_t)i * sizeof(DFBTracingPacket);
+}
+
+void TraceFile::advise(AccessPattern pattern)
+{
+    if (!m_data)
+        return;
+
+    switch (pattern) {
+    case ACCESS_SEQUENTIAL:
+        adviseRange(0, m_size, MADV_SEQUENTIAL);
+        break;
+    case ACCESS_REVERSE:
+    case ACCESS_RANDOM:
+        adviseRange(0, m_size, MADV_RANDOM);
+        break;
+    }
+
+    m_pattern = pattern;
+    m_prefetchedFrom = packetCount();
+}
+
+void TraceFile::prefetch(unsigned int first, unsigned int last)
+{
+    if (first > last) {
+        unsigned int tmp = first;
+        first = last;
+        last = tmp;
+    }
+
+    size_t end = (size_t)last * sizeof(DFBTracingPacket);
+
+    adviseRange((size_t)first * sizeof(DFBTracingPacket), (end < m_size) ? end : m_size, MADV_WILLNEED);
+}
+
+void TraceFile::adviseRange(size_t start, size_t end, int advice)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+
+    start &= ~(page - 1);
+
+    if (end <= start)
+        return;
+
+    madvise(const_cast<char*>(m_data) + start, end - start, advice);
+}
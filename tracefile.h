@@ -0,0 +1,61 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef TRACEFILE_H
+#define TRACEFILE_H
+
+#include <stddef.h>
+
+#include <core/remote_tracing.h>
+
+// Read-only memory mapping of a recorded trace. Packets are handed out as
+// pointers into the mapping, the pages are only faulted in when touched.
+class TraceFile
+{
+public:
+    typedef enum {
+        ACCESS_SEQUENTIAL,
+        ACCESS_REVERSE,
+        ACCESS_RANDOM
+    } AccessPattern;
+
+    TraceFile();
+    ~TraceFile();
+
+    bool open(const char* traceName);
+    void close();
+
+    bool isOpen() const { return m_data != NULL; }
+
+    size_t size() const { return m_size; }
+    unsigned int packetCount() const { return m_size / sizeof(DFBTracingPacket); }
+
+    const char* packet(unsigned int i);
+
+    void advise(AccessPattern pattern);
+    void prefetch(unsigned int first, unsigned int last);
+
+private:
+    void adviseRange(size_t start, size_t end, int advice);
+
+    const char* m_data;
+    size_t m_size;
+
+    AccessPattern m_pattern;
+    unsigned int m_prefetchedFrom;
+};
+
+#endif // TRACEFILE_H
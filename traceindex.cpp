@@ -0,0 +1,320 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "traceindex.h"
+
+TraceIndexWriter::TraceIndexWriter(unsigned int keyframeInterval) : m_decoder(&m_tracker)
+{
+    m_keyframeInterval = keyframeInterval ? keyframeInterval : DEFAULT_KEYFRAME_INTERVAL;
+
+    m_index = NULL;
+
+    m_packetIndex = 0;
+    m_traceOffset = 0;
+}
+
+TraceIndexWriter::~TraceIndexWriter()
+{
+    close();
+}
+
+bool TraceIndexWriter::open(const char* traceName)
+{
+    close();
+
+    return openIndex(traceName);
+}
+
+bool TraceIndexWriter::rotate(const char* traceName)
+{
+    closeIndex();
+
+    return openIndex(traceName);
+}
+
+bool TraceIndexWriter::openIndex(const char* traceName)
+{
+    TraceIndexHeader header;
+
+    std::string indexName = TraceIndex::indexName(traceName);
+
+    m_packetIndex = 0;
+    m_traceOffset = 0;
+
+    m_index = fopen(indexName.c_str(), "wb");
+
+    if (!m_index)
+        return false;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_INDEX_MAGIC, sizeof(header.magic));
+
+    header.packetSize = sizeof(DFBTracingPacket);
+    header.keyframeInterval = m_keyframeInterval;
+
+    fwrite(&header, sizeof(header), 1, m_index);
+
+    return true;
+}
+
+void TraceIndexWriter::close()
+{
+    closeIndex();
+
+    m_tracker.clear();
+    m_decoder.reset();
+}
+
+void TraceIndexWriter::closeIndex()
+{
+    if (m_index) {
+        fclose(m_index);
+        m_index = NULL;
+    }
+}
+
+void TraceIndexWriter::addPacket(const char* buf, int size)
+{
+    const DFBTracingPacket *packet = reinterpret_cast<const DFBTracingPacket*>(buf);
+
+    if (!m_index)
+        return;
+
+    if (!(m_packetIndex % m_keyframeInterval))
+        writeKeyframe(packet->header.nSeq);
+
+    m_decoder.receivePacket(buf, size);
+
+    m_packetIndex++;
+    m_traceOffset += size;
+}
+
+void TraceIndexWriter::writeKeyframe(unsigned int nSeq)
+{
+    TraceKeyframeHeader header;
+    std::map<unsigned int, PoolState *>::const_iterator it;
+
+    header.magic = TRACE_INDEX_KEYFRAME_MAGIC;
+    header.packetIndex = m_packetIndex;
+    header.nSeq = nSeq;
+    header.poolCount = m_tracker.pools().size();
+    header.traceOffset = m_traceOffset;
+
+    fwrite(&header, sizeof(header), 1, m_index);
+
+    for (it = m_tracker.pools().begin(); it != m_tracker.pools().end(); ++it) {
+        PoolState *state = it->second;
+        DFBTracingBufferData info;
+
+        memset(&info, 0, sizeof(info));
+
+        info.poolId = state->poolId();
+        info.poolSize = state->poolSize();
+        strncpy(info.name, state->name(), sizeof(info.name) - 1);
+
+        unsigned int count = state->count();
+
+        fwrite(&info, sizeof(info), 1, m_index);
+        fwrite(&count, sizeof(count), 1, m_index);
+
+        for (unsigned int i = 0; i < count; i++)
+            fwrite(&state->at(i), sizeof(PoolAllocation), 1, m_index);
+    }
+
+    // Players follow the index while it's being built
+    fflush(m_index);
+}
+
+bool TraceIndexWriter::build(const char* traceName, unsigned int keyframeInterval)
+{
+    DFBTracingPacket packet;
+    TraceIndexWriter writer(keyframeInterval);
+
+    FILE* trace = fopen(traceName, "rb");
+
+    if (!trace)
+        return false;
+
+    if (!writer.open(traceName)) {
+        fclose(trace);
+        return false;
+    }
+
+    while (fread(&packet, sizeof(packet), 1, trace) == 1)
+        writer.addPacket(reinterpret_cast<const char*>(&packet), sizeof(packet));
+
+    fclose(trace);
+
+    return true;
+}
+
+TraceIndex::TraceIndex()
+{
+    m_nextPosition = 0;
+}
+
+std::string TraceIndex::indexName(const char* traceName)
+{
+    return std::string(traceName) + ".idx";
+}
+
+void TraceIndex::clear()
+{
+    m_indexName.clear();
+    m_keyframes.clear();
+
+    m_nextPosition = 0;
+}
+
+bool TraceIndex::load(const char* traceName)
+{
+    clear();
+
+    m_indexName = TraceIndex::indexName(traceName);
+
+    return update();
+}
+
+bool TraceIndex::update()
+{
+    TraceIndexHeader header;
+    TraceKeyframeHeader keyframe;
+    struct stat st;
+
+    if (m_indexName.empty() || stat(m_indexName.c_str(), &st))
+        return isValid();
+
+    FILE* index = fopen(m_indexName.c_str(), "rb");
+
+    if (!index)
+        return isValid();
+
+    if (!m_nextPosition) {
+        if ((fread(&header, sizeof(header), 1, index) != 1)
+            || memcmp(header.magic, TRACE_INDEX_MAGIC, sizeof(header.magic))
+            || (header.packetSize != sizeof(DFBTracingPacket))) {
+            fclose(index);
+            return false;
+        }
+
+        m_nextPosition = ftell(index);
+    }
+
+    fseek(index, m_nextPosition, SEEK_SET);
+
+    for (;;) {
+        Entry entry;
+
+        entry.position = ftell(index);
+
+        if ((fread(&keyframe, sizeof(keyframe), 1, index) != 1) || (keyframe.magic != TRACE_INDEX_KEYFRAME_MAGIC))
+            break;
+
+        // Skip over the pools, only the keyframe positions are kept in memory
+        long skip = 0;
+
+        for (unsigned int i = 0; i < keyframe.poolCount; i++) {
+            unsigned int count;
+
+            if (fseek(index, sizeof(DFBTracingBufferData), SEEK_CUR) || (fread(&count, sizeof(count), 1, index) != 1)) {
+                skip = -1;
+                break;
+            }
+
+            skip = (long)count * sizeof(PoolAllocation);
+
+            if (fseek(index, skip, SEEK_CUR)) {
+                skip = -1;
+                break;
+            }
+        }
+
+        // A truncated keyframe (recording interrupted, or still being
+        // written) ends the index for now
+        if ((skip < 0) || (ftell(index) > st.st_size))
+            break;
+
+        entry.packetIndex = keyframe.packetIndex;
+        m_keyframes.push_back(entry);
+
+        m_nextPosition = ftell(index);
+    }
+
+    fclose(index);
+
+    return isValid();
+}
+
+bool TraceIndex::keyframe(unsigned int packetIndex, TraceKeyframe& keyframe)
+{
+    TraceKeyframeHeader header;
+
+    if (!isValid() || (m_keyframes[0].packetIndex > packetIndex))
+        return false;
+
+    unsigned int lo = 0, hi = m_keyframes.size();
+
+    // Last keyframe with a packetIndex <= packetIndex
+    while ((hi - lo) > 1) {
+        unsigned int mid = (lo + hi) / 2;
+
+        if (m_keyframes[mid].packetIndex <= packetIndex)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    FILE* index = fopen(m_indexName.c_str(), "rb");
+
+    if (!index)
+        return false;
+
+    if (fseek(index, m_keyframes[lo].position, SEEK_SET) || (fread(&header, sizeof(header), 1, index) != 1)) {
+        fclose(index);
+        return false;
+    }
+
+    bool ret = true;
+
+    keyframe.packetIndex = header.packetIndex;
+    keyframe.nSeq = header.nSeq;
+    keyframe.traceOffset = header.traceOffset;
+    keyframe.pools.clear();
+
+    for (unsigned int i = 0; ret && (i < header.poolCount); i++) {
+        TraceKeyframePool pool;
+        unsigned int count;
+
+        ret = (fread(&pool.info, sizeof(pool.info), 1, index) == 1) && (fread(&count, sizeof(count), 1, index) == 1);
+
+        if (ret && count) {
+            pool.allocations.resize(count);
+            ret = (fread(&pool.allocations[0], sizeof(PoolAllocation), count, index) == count);
+        }
+
+        if (ret)
+            keyframe.pools.push_back(pool);
+    }
+
+    fclose(index);
+
+    return ret;
+}
@@ -0,0 +1,137 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef TRACEINDEX_H
+#define TRACEINDEX_H
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include <core/remote_tracing.h>
+
+#include "poolstate.h"
+#include "packetdecoder.h"
+
+// A trace "packettrace-X" is indexed by a "packettrace-X.idx" companion
+// file: a header followed by keyframes, each one holding the full state
+// of every pool right before a given packet. Seeking loads the closest
+// keyframe and only replays the packets after it.
+
+#define TRACE_INDEX_MAGIC "DFBTIDX1"
+#define TRACE_INDEX_KEYFRAME_MAGIC 0x4b455946 // 'KEYF'
+
+#define DEFAULT_KEYFRAME_INTERVAL 4096 // in packets
+
+struct TraceIndexHeader {
+    char magic[8];
+    unsigned int packetSize;
+    unsigned int keyframeInterval;
+};
+
+struct TraceKeyframeHeader {
+    unsigned int magic;
+    unsigned int packetIndex;
+    unsigned int nSeq; // of the packet at packetIndex
+    unsigned int poolCount;
+    unsigned long long traceOffset;
+};
+
+struct TraceKeyframePool {
+    DFBTracingBufferData info;
+    std::vector<PoolAllocation> allocations;
+};
+
+struct TraceKeyframe {
+    unsigned int packetIndex;
+    unsigned int nSeq;
+    unsigned long long traceOffset;
+
+    std::vector<TraceKeyframePool> pools;
+};
+
+class TraceIndexWriter
+{
+public:
+    explicit TraceIndexWriter(unsigned int keyframeInterval = DEFAULT_KEYFRAME_INTERVAL);
+    ~TraceIndexWriter();
+
+    // Indexes a trace written from its start
+    bool open(const char* traceName);
+    void close();
+
+    // Moves on to a new trace, keeping the pool states. The new index
+    // starts with a keyframe so the new trace can be played on its own.
+    bool rotate(const char* traceName);
+
+    bool isOpen() const { return m_index != NULL; }
+
+    void addPacket(const char* buf, int size);
+
+    // Builds the index of an existing raw trace
+    static bool build(const char* traceName, unsigned int keyframeInterval = DEFAULT_KEYFRAME_INTERVAL);
+
+private:
+    bool openIndex(const char* traceName);
+    void closeIndex();
+
+    void writeKeyframe(unsigned int nSeq);
+
+    unsigned int m_keyframeInterval;
+
+    FILE* m_index;
+
+    unsigned int m_packetIndex;
+    unsigned long long m_traceOffset;
+
+    // Mirrors the pool states the viewer ends up with
+    PoolStateTracker m_tracker;
+    PacketDecoder m_decoder;
+};
+
+class TraceIndex
+{
+public:
+    TraceIndex();
+
+    bool load(const char* traceName);
+    void clear();
+
+    // Picks up the keyframes written since, the index may still be being
+    // built in the background
+    bool update();
+
+    bool isValid() const { return !m_keyframes.empty(); }
+
+    // Loads the last keyframe at or before packetIndex
+    bool keyframe(unsigned int packetIndex, TraceKeyframe& keyframe);
+
+    static std::string indexName(const char* traceName);
+
+private:
+    struct Entry {
+        unsigned int packetIndex;
+        long position; // in the index file
+    };
+
+    std::string m_indexName;
+    std::vector<Entry> m_keyframes;
+
+    long m_nextPosition; // 0 until the header checked out
+};
+
+#endif // TRACEINDEX_H
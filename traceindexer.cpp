@@ -0,0 +1,201 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <QMutexLocker>
+
+#include <sys/stat.h>
+#include <string.h>
+#include <time.h>
+
+#include "traceindexer.h"
+#include "traceindex.h"
+#include "tracefile.h"
+
+// The timeline isn't updated more often than that
+#define PROGRESS_PERIOD 100000000ull // in ns
+#define PROGRESS_CHECK_PACKETS 4096 // also the usage samples handed over at once
+
+static unsigned long long monotonicNs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+TraceIndexer::TraceIndexer(QString traceName, QObject *parent) :
+    QThread(parent), m_decoder(&m_tracker)
+{
+    struct stat st;
+
+    m_traceName = traceName;
+    m_running = true;
+
+    m_packetCount = stat(m_traceName.toStdString().c_str(), &st) ? 0 : (st.st_size / sizeof(DFBTracingPacket));
+    m_indexedPackets = 0;
+}
+
+TraceIndexer::PoolUsage::PoolUsage(const PoolState* state, unsigned int origin) : pyramid(origin)
+{
+    memset(&info, 0, sizeof(info));
+
+    info.poolId = state->poolId();
+    info.poolSize = state->poolSize();
+    strncpy(info.name, state->name(), sizeof(info.name) - 1);
+}
+
+TraceIndexer::~TraceIndexer()
+{
+    stop();
+
+    std::map<unsigned int, PoolUsage *>::iterator it;
+
+    for (it = m_usage.begin(); it != m_usage.end(); ++it)
+        delete it->second;
+}
+
+void TraceIndexer::stop()
+{
+    m_running = false;
+
+    wait();
+}
+
+unsigned int TraceIndexer::indexedPackets() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_indexedPackets;
+}
+
+void TraceIndexer::pools(std::vector<DFBTracingBufferData>& pools) const
+{
+    std::map<unsigned int, PoolUsage *>::const_iterator it;
+
+    QMutexLocker locker(&m_mutex);
+
+    pools.clear();
+
+    for (it = m_usage.begin(); it != m_usage.end(); ++it)
+        pools.push_back(it->second->info);
+}
+
+bool TraceIndexer::usage(unsigned int poolId, double first, double last, unsigned int count,
+                         std::vector<UsageBucket>& buckets) const
+{
+    QMutexLocker locker(&m_mutex);
+
+    std::map<unsigned int, PoolUsage *>::const_iterator it = m_usage.find(poolId);
+
+    if (it == m_usage.end())
+        return false;
+
+    it->second->pyramid.query(first, last, count, buckets);
+
+    return true;
+}
+
+void TraceIndexer::run()
+{
+    TraceFile trace;
+    TraceIndex index;
+    TraceIndexWriter writer;
+
+    std::string traceName = m_traceName.toStdString();
+
+    if (!trace.open(traceName.c_str()))
+        return;
+
+    // An index recorded along with the trace is kept as is
+    bool building = !index.load(traceName.c_str()) && writer.open(traceName.c_str(), false);
+
+    unsigned int count = (trace.packetCount() < m_packetCount) ? trace.packetCount() : m_packetCount;
+    unsigned long long lastProgress = monotonicNs();
+    unsigned int i;
+
+    for (i = 0; (i < count) && m_running; i++) {
+        const char *packet = trace.packet(i);
+
+        if (building)
+            writer.addPacket(packet, sizeof(DFBTracingPacket));
+
+        m_decoder.receivePacket(packet, sizeof(DFBTracingPacket));
+
+        summarize(i);
+
+        if (!((i + 1) % PROGRESS_CHECK_PACKETS)) {
+            unsigned long long now = monotonicNs();
+
+            flush(i + 1);
+
+            if ((now - lastProgress) >= PROGRESS_PERIOD) {
+                emit indexProgress(i + 1, m_packetCount);
+
+                lastProgress = now;
+            }
+        }
+    }
+
+    writer.close();
+
+    flush(i);
+
+    emit indexProgress(i, m_packetCount);
+}
+
+void TraceIndexer::summarize(unsigned int packetIndex)
+{
+    std::map<unsigned int, PoolState *>::const_iterator it;
+    std::map<unsigned int, PendingUsage>::iterator pending = m_pending.begin();
+
+    // Both by pool id, and pools are never forgotten: walked side by side
+    for (it = m_tracker.pools().begin(); it != m_tracker.pools().end(); ++it) {
+        while ((pending != m_pending.end()) && (pending->first < it->first))
+            ++pending;
+
+        if ((pending == m_pending.end()) || (pending->first != it->first)) {
+            pending = m_pending.insert(pending, std::make_pair(it->first, PendingUsage()));
+            pending->second.origin = packetIndex;
+            pending->second.samples.reserve(PROGRESS_CHECK_PACKETS);
+        }
+
+        pending->second.samples.push_back(it->second->allocated());
+    }
+}
+
+void TraceIndexer::flush(unsigned int indexedPackets)
+{
+    std::map<unsigned int, PendingUsage>::iterator it;
+
+    // One lock for a whole batch, the timeline queries in between
+    QMutexLocker locker(&m_mutex);
+
+    for (it = m_pending.begin(); it != m_pending.end(); ++it) {
+        PoolUsage *&usage = m_usage[it->first];
+        std::vector<unsigned int>& samples = it->second.samples;
+
+        if (!usage)
+            usage = new PoolUsage(m_tracker.pool(it->first), it->second.origin);
+
+        for (unsigned int i = 0; i < samples.size(); i++)
+            usage->pyramid.add(samples[i]);
+
+        samples.clear();
+    }
+
+    m_indexedPackets = indexedPackets;
+}
@@ -0,0 +1,93 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef TRACEINDEXER_H
+#define TRACEINDEXER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QString>
+
+#include <vector>
+#include <map>
+
+#include <core/remote_tracing.h>
+
+#include "packetdecoder.h"
+#include "usagepyramid.h"
+
+// Streams through a trace in the background as soon as it's opened: builds
+// its index when there is none and keeps the usage of every pool as a
+// pyramid, from which any part of the trace is summarized at once.
+// Playback starts right away, seeks use the keyframes written so far.
+class TraceIndexer : public QThread
+{
+    Q_OBJECT
+public:
+    explicit TraceIndexer(QString traceName, QObject *parent = 0);
+    ~TraceIndexer();
+
+    void stop();
+
+    unsigned int indexedPackets() const;
+    unsigned int packetCount() const { return m_packetCount; }
+
+    // The pools seen so far
+    void pools(std::vector<DFBTracingBufferData>& pools) const;
+
+    // Usage of a pool over count equal slices of [first, last), in packets
+    bool usage(unsigned int poolId, double first, double last, unsigned int count,
+               std::vector<UsageBucket>& buckets) const;
+
+signals:
+    void indexProgress(unsigned int packets, unsigned int packetCount);
+
+protected:
+    void run();
+
+private:
+    struct PoolUsage {
+        PoolUsage(const PoolState* state, unsigned int origin);
+
+        DFBTracingBufferData info;
+        UsagePyramid pyramid;
+    };
+
+    // Usage samples not handed over yet, kept by the indexing thread alone
+    struct PendingUsage {
+        unsigned int origin;
+        std::vector<unsigned int> samples;
+    };
+
+    void summarize(unsigned int packetIndex);
+    void flush(unsigned int indexedPackets);
+
+    QString m_traceName;
+    volatile bool m_running;
+
+    unsigned int m_packetCount;
+
+    PoolStateTracker m_tracker;
+    PacketDecoder m_decoder;
+
+    std::map<unsigned int, PendingUsage> m_pending;
+
+    mutable QMutex m_mutex; // guards what follows
+    unsigned int m_indexedPackets;
+    std::map<unsigned int, PoolUsage *> m_usage;
+};
+
+#endif // TRACEINDEXER_H
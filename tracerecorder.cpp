@@ -0,0 +1,345 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <QMutexLocker>
+#include <QFile>
+
+#include <string.h>
+
+#include "tracerecorder.h"
+
+#define DEFAULT_FLUSH_INTERVAL 1000 // in ms
+
+static unsigned long long monotonicNs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned long long monotonicMs()
+{
+    return monotonicNs() / 1000000;
+}
+
+TraceRecorder::TraceRecorder(unsigned int blockSize, unsigned int blockCount)
+{
+    m_blockSize = blockSize;
+
+    for (unsigned int i = 0; i < blockCount; i++) {
+        Block *block = new Block;
+
+        block->data = new char[m_blockSize];
+        block->times = new unsigned long long[m_blockSize / sizeof(DFBTracingPacket)];
+        block->used = 0;
+        block->filled = 0;
+
+        m_blocks.append(block);
+    }
+
+    m_current = m_blocks.first();
+    m_freeBlocks = m_blocks.mid(1);
+
+    m_flushSize = m_blockSize;
+    m_flushInterval = DEFAULT_FLUSH_INTERVAL;
+
+    m_rotationSize = 0;
+    m_rotationInterval = 0;
+
+    m_recording = false;
+
+    m_traceSize = 0;
+    m_traceStart = 0;
+
+    m_droppedPackets = 0;
+    m_writtenBytes = 0;
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    stopRecording();
+
+    for (int i = 0; i < m_blocks.size(); i++) {
+        delete[] m_blocks[i]->data;
+        delete[] m_blocks[i]->times;
+        delete m_blocks[i];
+    }
+}
+
+void TraceRecorder::setFlushThresholds(unsigned int bytes, unsigned int ms)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_flushSize = (bytes && (bytes < m_blockSize)) ? bytes : m_blockSize;
+    m_flushInterval = ms ? ms : DEFAULT_FLUSH_INTERVAL;
+}
+
+void TraceRecorder::setRotation(unsigned int megabytes, unsigned int seconds)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_rotationSize = (unsigned long long)megabytes * 1024 * 1024;
+    m_rotationInterval = seconds;
+}
+
+QString TraceRecorder::traceName()
+{
+    struct tm date;
+    char buf[64];
+
+    time_t t = time(NULL);
+    localtime_r(&t, &date);
+
+    sprintf(buf, "packettrace-%04d%02d%02d%02d%02d%02d", date.tm_year + 1900,
+                                                         date.tm_mon + 1,
+                                                         date.tm_mday,
+                                                         date.tm_hour,
+                                                         date.tm_min,
+                                                         date.tm_sec);
+
+    // Rotating more than once per second must not append to the previous trace
+    QString name = buf;
+
+    for (int i = 1; QFile::exists(name); i++)
+        name = QString("%1-%2").arg(buf).arg(i);
+
+    return name;
+}
+
+bool TraceRecorder::openTrace()
+{
+    m_traceName = traceName();
+
+    m_output.open(m_traceName.toStdString().c_str(), ios_base::out | ios_base::binary);
+
+    if (!m_output.is_open())
+        return false;
+
+    if (m_indexWriter.isOpen())
+        m_indexWriter.rotate(m_traceName.toStdString().c_str());
+    else
+        m_indexWriter.open(m_traceName.toStdString().c_str());
+
+    m_timestampWriter.open(m_traceName.toStdString().c_str());
+
+    m_traceSize = 0;
+    m_traceStart = time(NULL);
+
+    return true;
+}
+
+bool TraceRecorder::startRecording()
+{
+    if (m_recording)
+        return true;
+
+    if (!openTrace())
+        return false;
+
+    m_droppedPackets = 0;
+    m_writtenBytes = 0;
+
+    m_recording = true;
+
+    start();
+
+    return true;
+}
+
+void TraceRecorder::stopRecording()
+{
+    m_mutex.lock();
+
+    if (!m_recording) {
+        m_mutex.unlock();
+        return;
+    }
+
+    // Whatever is pending gets written before the thread goes away
+    if (m_current->used)
+        m_fullBlocks.enqueue(m_current);
+    else
+        m_freeBlocks.append(m_current);
+
+    m_current = 0;
+
+    m_recording = false;
+    m_blockReady.wakeOne();
+
+    m_mutex.unlock();
+
+    wait();
+
+    // Every block is back in the free list by now
+    m_current = m_freeBlocks.takeFirst();
+
+    m_output.close();
+    m_indexWriter.close();
+    m_timestampWriter.close();
+}
+
+void TraceRecorder::write(const char* buf, int size)
+{
+    // Traces are made of fixed-size records, as expected by the playback
+    const int recordSize = sizeof(DFBTracingPacket);
+
+    QMutexLocker locker(&m_mutex);
+
+    if (!m_recording)
+        return;
+
+    if (size > recordSize) {
+        m_droppedPackets++;
+        return;
+    }
+
+    if ((m_current->used + recordSize) > m_blockSize) {
+        // Never stall the receiver on the disk, account for the loss instead
+        if (m_freeBlocks.isEmpty() || ((unsigned int)recordSize > m_blockSize)) {
+            m_droppedPackets++;
+            return;
+        }
+
+        m_fullBlocks.enqueue(m_current);
+        m_current = m_freeBlocks.takeFirst();
+
+        m_blockReady.wakeOne();
+    }
+
+    if (!m_current->used)
+        m_current->filled = monotonicMs();
+
+    m_current->times[m_current->used / recordSize] = monotonicNs();
+
+    memcpy(m_current->data + m_current->used, buf, size);
+    memset(m_current->data + m_current->used + size, 0, recordSize - size);
+    m_current->used += recordSize;
+
+    if ((m_current->used >= m_flushSize) && !m_freeBlocks.isEmpty()) {
+        m_fullBlocks.enqueue(m_current);
+        m_current = m_freeBlocks.takeFirst();
+
+        m_blockReady.wakeOne();
+    }
+}
+
+void TraceRecorder::writeBlock(Block *block)
+{
+    bool rotate = false;
+
+    // Blocks only hold whole packets, so traces are split on a block boundary
+    if (m_rotationSize && m_traceSize && ((m_traceSize + block->used) > m_rotationSize))
+        rotate = true;
+
+    if (m_rotationInterval && ((unsigned int)(time(NULL) - m_traceStart) >= m_rotationInterval))
+        rotate = true;
+
+    if (rotate) {
+        QString previous = m_traceName;
+
+        m_output.close();
+
+        if (openTrace()) {
+            emit traceRotated(m_traceName);
+        } else {
+            emit rotationFailed(m_traceName);
+
+            // Carry on with the previous trace, the next attempt comes a
+            // rotation period later. Its index and arrival times were left open.
+            m_traceName = previous;
+
+            m_output.clear();
+            m_output.open(m_traceName.toStdString().c_str(), ios_base::out | ios_base::binary | ios_base::app);
+
+            m_traceSize = 0;
+            m_traceStart = time(NULL);
+        }
+    }
+
+    m_output.write(block->data, block->used);
+    m_output.flush();
+
+    m_traceSize += block->used;
+
+    m_timestampWriter.write(block->times, block->used / sizeof(DFBTracingPacket));
+
+    unsigned int offset = 0;
+
+    while ((block->used - offset) >= sizeof(DFBTracingPacket)) {
+        m_indexWriter.addPacket(block->data + offset, sizeof(DFBTracingPacket));
+
+        offset += sizeof(DFBTracingPacket);
+    }
+}
+
+void TraceRecorder::run()
+{
+    unsigned long long lastReport = monotonicMs();
+    unsigned long long reportedBytes = 0;
+
+    m_mutex.lock();
+
+    for (;;) {
+        if (m_fullBlocks.isEmpty() && m_recording) {
+            m_blockReady.wait(&m_mutex, m_flushInterval);
+
+            unsigned long long now = monotonicMs();
+
+            // Hand over a partially filled block that has waited for too long
+            // stopRecording() may have taken the current block meanwhile
+            if (m_recording && m_current && m_fullBlocks.isEmpty() && m_current->used && !m_freeBlocks.isEmpty()
+                && ((now - m_current->filled) >= m_flushInterval)) {
+                m_fullBlocks.enqueue(m_current);
+                m_current = m_freeBlocks.takeFirst();
+            }
+        }
+
+        unsigned long long now = monotonicMs();
+
+        if ((now - lastReport) >= 1000) {
+            unsigned int throughput = ((m_writtenBytes - reportedBytes) * 1000) / (now - lastReport);
+
+            emit statistics(throughput, m_fullBlocks.size(), m_droppedPackets);
+
+            reportedBytes = m_writtenBytes;
+            lastReport = now;
+        }
+
+        if (m_fullBlocks.isEmpty()) {
+            if (!m_recording)
+                break;
+
+            continue;
+        }
+
+        Block *block = m_fullBlocks.dequeue();
+
+        m_mutex.unlock();
+
+        writeBlock(block);
+
+        m_mutex.lock();
+
+        m_writtenBytes += block->used;
+
+        block->used = 0;
+        m_freeBlocks.append(block);
+    }
+
+    m_mutex.unlock();
+}
@@ -0,0 +1,108 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QList>
+#include <QString>
+
+#include <time.h>
+#include <fstream>
+
+using namespace std;
+
+#include "traceindex.h"
+#include "tracetimestamps.h"
+
+// Records packets to "packettrace-*" files from a dedicated thread. The
+// receiver only copies packets into large blocks, the writer thread puts
+// them on disk along with their arrival times, maintains the index and
+// rotates the files.
+class TraceRecorder : public QThread
+{
+    Q_OBJECT
+public:
+    explicit TraceRecorder(unsigned int blockSize = 4 * 1024 * 1024, unsigned int blockCount = 2);
+    ~TraceRecorder();
+
+    bool startRecording();
+    void stopRecording();
+
+    bool isRecording() const { return m_recording; }
+
+    void setFlushThresholds(unsigned int bytes, unsigned int ms);
+    void setRotation(unsigned int megabytes, unsigned int seconds);
+
+    void write(const char* buf, int size);
+
+signals:
+    void statistics(unsigned int bytesPerSecond, unsigned int queueDepth, unsigned int droppedPackets);
+    void traceRotated(QString traceName);
+    void rotationFailed(QString traceName);
+
+protected:
+    void run();
+
+private:
+    struct Block {
+        char *data;
+        unsigned long long *times; // arrival of each packet, in ns
+        unsigned int used;
+        unsigned long long filled; // when the first packet landed in it, in ms
+    };
+
+    bool openTrace();
+    void writeBlock(Block *block);
+
+    static QString traceName();
+
+    QMutex m_mutex;
+    QWaitCondition m_blockReady;
+    QWaitCondition m_blockFree;
+
+    QList<Block *> m_blocks;
+    QList<Block *> m_freeBlocks;
+    QQueue<Block *> m_fullBlocks;
+    Block *m_current;
+
+    unsigned int m_blockSize;
+
+    unsigned int m_flushSize;
+    unsigned int m_flushInterval; // in ms
+
+    unsigned long long m_rotationSize;
+    unsigned int m_rotationInterval; // in seconds
+
+    bool m_recording;
+
+    ofstream m_output;
+    TraceIndexWriter m_indexWriter;
+    TraceTimestampWriter m_timestampWriter;
+
+    QString m_traceName;
+    unsigned long long m_traceSize;
+    time_t m_traceStart;
+
+    unsigned int m_droppedPackets;
+    unsigned long long m_writtenBytes;
+};
+
+#endif // TRACERECORDER_H
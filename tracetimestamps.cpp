@@ -0,0 +1,157 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <core/remote_tracing.h>
+
+#include "tracetimestamps.h"
+
+TraceTimestampWriter::TraceTimestampWriter()
+{
+    m_file = NULL;
+}
+
+TraceTimestampWriter::~TraceTimestampWriter()
+{
+    close();
+}
+
+bool TraceTimestampWriter::open(const char* traceName)
+{
+    TraceTimestampsHeader header;
+
+    close();
+
+    m_file = fopen(TraceTimestamps::timestampsName(traceName).c_str(), "wb");
+
+    if (!m_file)
+        return false;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_TIMESTAMPS_MAGIC, sizeof(header.magic));
+    header.packetSize = sizeof(DFBTracingPacket);
+
+    if (fwrite(&header, sizeof(header), 1, m_file) != 1) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void TraceTimestampWriter::close()
+{
+    if (m_file) {
+        fclose(m_file);
+        m_file = NULL;
+    }
+}
+
+void TraceTimestampWriter::write(const unsigned long long* times, unsigned int count)
+{
+    if (!m_file)
+        return;
+
+    // Written along with the trace blocks, a crash loses as much of both
+    fwrite(times, sizeof(times[0]), count, m_file);
+    fflush(m_file);
+}
+
+TraceTimestamps::TraceTimestamps()
+{
+    m_map = NULL;
+    m_mapSize = 0;
+
+    m_times = NULL;
+    m_count = 0;
+    m_first = 0;
+}
+
+TraceTimestamps::~TraceTimestamps()
+{
+    clear();
+}
+
+void TraceTimestamps::clear()
+{
+    if (m_map) {
+        munmap(m_map, m_mapSize);
+
+        m_map = NULL;
+        m_mapSize = 0;
+    }
+
+    m_times = NULL;
+    m_count = 0;
+    m_first = 0;
+}
+
+bool TraceTimestamps::load(const char* traceName)
+{
+    struct stat st;
+
+    clear();
+
+    int fd = open(timestampsName(traceName).c_str(), O_RDONLY);
+
+    if (fd < 0)
+        return false;
+
+    if (fstat(fd, &st) || ((size_t)st.st_size <= sizeof(TraceTimestampsHeader))) {
+        close(fd);
+        return false;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if (map == MAP_FAILED)
+        return false;
+
+    const TraceTimestampsHeader *header = static_cast<const TraceTimestampsHeader*>(map);
+
+    if (memcmp(header->magic, TRACE_TIMESTAMPS_MAGIC, sizeof(header->magic))
+        || (header->packetSize != sizeof(DFBTracingPacket))) {
+        munmap(map, st.st_size);
+        return false;
+    }
+
+    m_map = map;
+    m_mapSize = st.st_size;
+
+    m_times = reinterpret_cast<const unsigned long long*>(header + 1);
+    m_count = (st.st_size - sizeof(TraceTimestampsHeader)) / sizeof(m_times[0]);
+
+    if (!m_count) {
+        clear();
+        return false;
+    }
+
+    m_first = m_times[0];
+
+    return true;
+}
+
+std::string TraceTimestamps::timestampsName(const char* traceName)
+{
+    return std::string(traceName) + ".ts";
+}
@@ -0,0 +1,86 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef TRACETIMESTAMPS_H
+#define TRACETIMESTAMPS_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include <string>
+
+// The arrival time of each packet of "packettrace-X" is kept in a
+// "packettrace-X.ts" companion file: a header followed by one
+// CLOCK_MONOTONIC value in ns per packet, in trace order. Playback uses
+// it to reproduce the recorded timing.
+
+#define TRACE_TIMESTAMPS_MAGIC "DFBTTS01"
+
+struct TraceTimestampsHeader {
+    char magic[8];
+    unsigned int packetSize;
+    unsigned int reserved;
+};
+
+class TraceTimestampWriter
+{
+public:
+    TraceTimestampWriter();
+    ~TraceTimestampWriter();
+
+    bool open(const char* traceName);
+    void close();
+
+    bool isOpen() const { return m_file != NULL; }
+
+    void write(const unsigned long long* times, unsigned int count);
+
+private:
+    FILE *m_file;
+};
+
+// Maps the file rather than reading it, so loading doesn't depend on the
+// length of the trace
+class TraceTimestamps
+{
+public:
+    TraceTimestamps();
+    ~TraceTimestamps();
+
+    bool load(const char* traceName);
+    void clear();
+
+    unsigned int count() const { return m_count; }
+
+    // Since the first packet of the trace, in ns. Senders merged in one
+    // trace may step back a little, playback re-anchors when they do.
+    unsigned long long at(unsigned int i) const { return (m_times[i] > m_first) ? (m_times[i] - m_first) : 0; }
+
+    // CLOCK_MONOTONIC of the first packet, in ns, to line segments up
+    unsigned long long origin() const { return m_first; }
+
+    static std::string timestampsName(const char* traceName);
+
+private:
+    void *m_map;
+    size_t m_mapSize;
+
+    const unsigned long long *m_times;
+    unsigned int m_count;
+    unsigned long long m_first;
+};
+
+#endif // TRACETIMESTAMPS_H
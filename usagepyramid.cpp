@@ -0,0 +1,182 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <limits.h>
+#include <math.h>
+
+#include "usagepyramid.h"
+
+UsagePyramid::UsagePyramid(unsigned int origin)
+{
+    m_origin = origin;
+    m_samples = 0;
+
+    m_levels.resize(1);
+    m_open.resize(1);
+
+    clearAccumulator(m_open[0]);
+}
+
+void UsagePyramid::clearAccumulator(Accumulator& accumulator)
+{
+    accumulator.minUsage = UINT_MAX;
+    accumulator.maxUsage = 0;
+    accumulator.sum = 0;
+    accumulator.count = 0;
+}
+
+void UsagePyramid::add(unsigned int usage)
+{
+    UsageBucket sample;
+
+    sample.minUsage = sample.maxUsage = sample.meanUsage = usage;
+
+    push(0, sample);
+
+    m_samples++;
+}
+
+void UsagePyramid::push(unsigned int level, const UsageBucket& bucket)
+{
+    Accumulator& open = m_open[level];
+
+    if (bucket.minUsage < open.minUsage)
+        open.minUsage = bucket.minUsage;
+
+    if (bucket.maxUsage > open.maxUsage)
+        open.maxUsage = bucket.maxUsage;
+
+    open.sum += bucket.meanUsage;
+
+    if (++open.count < (level ? USAGE_PYRAMID_FANOUT : USAGE_PYRAMID_BASE))
+        return;
+
+    UsageBucket closed;
+
+    closed.minUsage = open.minUsage;
+    closed.maxUsage = open.maxUsage;
+    closed.meanUsage = open.sum / open.count;
+
+    clearAccumulator(open);
+
+    m_levels[level].push_back(closed);
+
+    // Every child holds as many samples, the mean of the means is exact
+    if ((level + 1) == m_levels.size()) {
+        Accumulator empty;
+
+        clearAccumulator(empty);
+
+        m_levels.resize(level + 2);
+        m_open.push_back(empty);
+    }
+
+    push(level + 1, closed);
+}
+
+void UsagePyramid::range(unsigned int start, unsigned int end, UsageBucket& bucket) const
+{
+    unsigned long long sum = 0, weight = 0;
+    unsigned int level = 0, size = USAGE_PYRAMID_BASE;
+
+    bucket.minUsage = UINT_MAX;
+    bucket.maxUsage = 0;
+
+    // The coarsest buckets that still fit in the range: at most
+    // FANOUT + 1 of them cover it
+    while (((level + 1) < m_levels.size()) && ((size * USAGE_PYRAMID_FANOUT) <= (end - start))) {
+        level++;
+        size *= USAGE_PYRAMID_FANOUT;
+    }
+
+    // Going down a level for the part the current one hasn't closed yet.
+    // Buckets overlapping the edges are taken whole, peaks are never missed.
+    for (;;) {
+        const std::vector<UsageBucket>& buckets = m_levels[level];
+        unsigned int first = start / size, last = (end + size - 1) / size;
+
+        for (unsigned int i = first; (i < last) && (i < buckets.size()); i++) {
+            if (buckets[i].minUsage < bucket.minUsage)
+                bucket.minUsage = buckets[i].minUsage;
+
+            if (buckets[i].maxUsage > bucket.maxUsage)
+                bucket.maxUsage = buckets[i].maxUsage;
+
+            sum += (unsigned long long)buckets[i].meanUsage * size;
+            weight += size;
+        }
+
+        if ((last <= buckets.size()) || !level)
+            break;
+
+        if (start < (buckets.size() * size))
+            start = buckets.size() * size;
+
+        level--;
+        size /= USAGE_PYRAMID_FANOUT;
+    }
+
+    // The samples not summarized at any level yet
+    const Accumulator& open = m_open[0];
+
+    if (open.count && (end > (m_levels[0].size() * USAGE_PYRAMID_BASE))) {
+        if (open.minUsage < bucket.minUsage)
+            bucket.minUsage = open.minUsage;
+
+        if (open.maxUsage > bucket.maxUsage)
+            bucket.maxUsage = open.maxUsage;
+
+        sum += open.sum;
+        weight += open.count;
+    }
+
+    bucket.meanUsage = weight ? (sum / weight) : 0;
+}
+
+void UsagePyramid::query(double first, double last, unsigned int count, std::vector<UsageBucket>& buckets) const
+{
+    double step = count ? ((last - first) / count) : 0;
+
+    buckets.resize(count);
+
+    for (unsigned int i = 0; i < count; i++) {
+        UsageBucket& bucket = buckets[i];
+
+        // Zoomed in beyond a packet per slice, neighbours share it
+        double a = floor(first + i * step), b = floor(first + (i + 1) * step);
+
+        if (b <= a)
+            b = a + 1;
+
+        a -= m_origin;
+        b -= m_origin;
+
+        if (a < 0)
+            a = 0;
+
+        if (b > m_samples)
+            b = m_samples;
+
+        if (a >= b) {
+            bucket.minUsage = 1;
+            bucket.maxUsage = 0;
+            bucket.meanUsage = 0;
+            continue;
+        }
+
+        range((unsigned int)a, (unsigned int)b, bucket);
+    }
+}
@@ -0,0 +1,73 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef USAGEPYRAMID_H
+#define USAGEPYRAMID_H
+
+#include <vector>
+
+// Buckets of the finest level hold that many samples, each level above
+// merges that many buckets of the one below
+#define USAGE_PYRAMID_BASE 16
+#define USAGE_PYRAMID_FANOUT 16
+
+// Over a bucket or a slice, in bytes. A slice without samples has a
+// minUsage above its maxUsage.
+struct UsageBucket {
+    unsigned int minUsage;
+    unsigned int maxUsage;
+    unsigned int meanUsage;
+};
+
+// The usage of a pool after every packet of a trace, as a min/max/mean
+// pyramid: any slice of the trace is summarized from at most a couple of
+// dozen buckets whatever its length, and the peaks are kept at every
+// level. Has no dependency on Qt.
+class UsagePyramid
+{
+public:
+    // The first sample is the usage after packet origin
+    explicit UsagePyramid(unsigned int origin = 0);
+
+    unsigned int origin() const { return m_origin; }
+    unsigned int end() const { return m_origin + m_samples; }
+
+    void add(unsigned int usage);
+
+    // Fills buckets with count equal slices of [first, last), in packets
+    void query(double first, double last, unsigned int count, std::vector<UsageBucket>& buckets) const;
+
+private:
+    struct Accumulator {
+        unsigned int minUsage;
+        unsigned int maxUsage;
+        unsigned long long sum;
+        unsigned int count;
+    };
+
+    void push(unsigned int level, const UsageBucket& bucket);
+    void range(unsigned int start, unsigned int end, UsageBucket& bucket) const;
+
+    static void clearAccumulator(Accumulator& accumulator);
+
+    unsigned int m_origin;
+    unsigned int m_samples;
+
+    std::vector<std::vector<UsageBucket> > m_levels;
+    std::vector<Accumulator> m_open; // the bucket being filled, per level
+};
+
+#endif // USAGEPYRAMID_H
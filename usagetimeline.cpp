@@ -0,0 +1,261 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <QPainter>
+#include <QPolygonF>
+#include <QMouseEvent>
+#include <QWheelEvent>
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "usagetimeline.h"
+#include "traceindexer.h"
+
+#define TIMELINE_REFRESH_PERIOD 250 // in ms
+
+// Zooming in stops at that many packets across the chart
+#define MIN_VIEW_LENGTH 64
+
+// A press moving less than that is a click
+#define DRAG_THRESHOLD 3 // in pixels
+
+static const QColor poolColors[] = {
+    QColor(64, 160, 255),
+    QColor(255, 160, 0),
+    QColor(0, 200, 96),
+    QColor(224, 64, 224),
+    QColor(255, 255, 64),
+    QColor(0, 224, 224)
+};
+
+UsageTimeline::UsageTimeline(QWidget *parent) :
+    QWidget(parent)
+{
+    m_indexer = 0;
+
+    m_viewFirst = m_viewLast = 0;
+    m_position = 0;
+
+    m_pressX = 0;
+    m_pressFirst = 0;
+    m_dragging = false;
+
+    // Picks up what the indexer went through, and the playback position
+    m_refreshTimer.setInterval(TIMELINE_REFRESH_PERIOD);
+    connect(&m_refreshTimer, SIGNAL(timeout()), this, SLOT(update()));
+}
+
+void UsageTimeline::setIndexer(TraceIndexer* indexer)
+{
+    m_indexer = indexer;
+
+    m_viewFirst = m_viewLast = 0;
+
+    if (m_indexer)
+        m_refreshTimer.start();
+    else
+        m_refreshTimer.stop();
+
+    update();
+}
+
+double UsageTimeline::length() const
+{
+    return m_indexer ? m_indexer->packetCount() : 0;
+}
+
+double UsageTimeline::packetAt(int x) const
+{
+    double first = m_viewFirst, last = m_viewLast;
+
+    if (last <= first) {
+        first = 0;
+        last = length();
+    }
+
+    return first + ((double)x / (width() ? width() : 1)) * (last - first);
+}
+
+void UsageTimeline::setView(double first, double last)
+{
+    double span = last - first, total = length();
+
+    if (span < MIN_VIEW_LENGTH)
+        span = MIN_VIEW_LENGTH;
+
+    // Back to the whole trace rather than past its ends
+    if (span >= total) {
+        m_viewFirst = m_viewLast = 0;
+    } else {
+        if (first < 0)
+            first = 0;
+
+        if ((first + span) > total)
+            first = total - span;
+
+        m_viewFirst = first;
+        m_viewLast = first + span;
+    }
+
+    update();
+}
+
+void UsageTimeline::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+
+    QPainter painter(this);
+
+    painter.fillRect(rect(), QColor(0, 0, 0));
+
+    painter.setPen(QColor(96, 96, 96));
+    painter.drawRect(rect().adjusted(0, 0, -1, -1));
+
+    if (!m_indexer || !m_indexer->packetCount())
+        return;
+
+    double first = packetAt(0), last = packetAt(width());
+    double w = width(), h = height() - 1;
+    int x;
+
+    // Not indexed yet
+    double indexed = m_indexer->indexedPackets();
+
+    if (indexed < last) {
+        x = (indexed > first) ? (int)(((indexed - first) / (last - first)) * w) : 0;
+
+        painter.fillRect(QRect(x, 1, width() - x - 1, height() - 2), QColor(32, 32, 32));
+    }
+
+    std::vector<DFBTracingBufferData> pools;
+    std::vector<UsageBucket> buckets;
+
+    m_indexer->pools(pools);
+
+    // Usages in % of their pool, all of them over the same scale
+    for (unsigned int i = 0; i < pools.size(); i++) {
+        QColor color = poolColors[i % (sizeof(poolColors) / sizeof(poolColors[0]))];
+        double scale = pools[i].poolSize ? (h / pools[i].poolSize) : 0;
+
+        if (!m_indexer->usage(pools[i].poolId, first, last, width(), buckets))
+            continue;
+
+        QPolygonF mean;
+
+        color.setAlpha(96);
+        painter.setPen(color);
+
+        for (x = 0; x < (int)buckets.size(); x++) {
+            const UsageBucket& bucket = buckets[x];
+
+            if (bucket.minUsage > bucket.maxUsage)
+                continue;
+
+            painter.drawLine(QPointF(x, h - bucket.minUsage * scale), QPointF(x, h - bucket.maxUsage * scale));
+
+            mean.append(QPointF(x, h - bucket.meanUsage * scale));
+        }
+
+        color.setAlpha(255);
+        painter.setPen(color);
+        painter.drawPolyline(mean);
+
+        painter.drawText(rect().adjusted(4, 2 + i * painter.fontMetrics().height(), -4, -2),
+                         Qt::AlignLeft | Qt::AlignTop, pools[i].name);
+    }
+
+    if ((m_position >= first) && (m_position <= last)) {
+        x = (int)(((m_position - first) / (last - first)) * w);
+
+        painter.setPen(QColor(255, 255, 255));
+        painter.drawLine(x, 0, x, height());
+    }
+
+    QString legend;
+
+    legend.sprintf("Packets %.0f - %.0f", first, last);
+    painter.setPen(QColor(160, 160, 160));
+    painter.drawText(rect().adjusted(4, 2, -4, -2), Qt::AlignRight | Qt::AlignTop, legend);
+}
+
+void UsageTimeline::mousePressEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton)
+        return;
+
+    m_pressX = event->x();
+    m_pressFirst = packetAt(0);
+    m_dragging = false;
+}
+
+void UsageTimeline::mouseMoveEvent(QMouseEvent *event)
+{
+    if (!(event->buttons() & Qt::LeftButton) || (m_viewLast <= m_viewFirst))
+        return;
+
+    int dx = event->x() - m_pressX;
+
+    if (!m_dragging && (abs(dx) < DRAG_THRESHOLD))
+        return;
+
+    m_dragging = true;
+
+    double span = m_viewLast - m_viewFirst;
+    double first = m_pressFirst - (dx / (double)width()) * span;
+
+    setView(first, first + span);
+}
+
+void UsageTimeline::mouseReleaseEvent(QMouseEvent *event)
+{
+    if ((event->button() != Qt::LeftButton) || m_dragging || !m_indexer)
+        return;
+
+    double position = packetAt(event->x());
+
+    if (position < 0)
+        position = 0;
+
+    if (position > length())
+        position = length();
+
+    emit seekRequested((int)position);
+}
+
+void UsageTimeline::mouseDoubleClickEvent(QMouseEvent *event)
+{
+    Q_UNUSED(event);
+
+    setView(0, length());
+}
+
+void UsageTimeline::wheelEvent(QWheelEvent *event)
+{
+    if (!m_indexer)
+        return;
+
+    // Twice closer per notch, the packet under the pointer stays there
+    double factor = pow(2.0, -event->delta() / 120.0);
+    double anchor = packetAt(event->x());
+    double first = packetAt(0), last = packetAt(width());
+
+    setView(anchor - (anchor - first) * factor, anchor + (last - anchor) * factor);
+
+    event->accept();
+}
@@ -0,0 +1,73 @@
+// DFbGraphicsPerf
+// Copyright (C) 2011, Ilyes Gouta, ilyes.gouta@gmail.com
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef USAGETIMELINE_H
+#define USAGETIMELINE_H
+
+#include <QWidget>
+#include <QTimer>
+
+class TraceIndexer;
+
+// Strip chart of the usage of every pool across the trace, from the
+// pyramids of the indexer: the min/max envelope keeps the peaks at any
+// zoom level. The wheel zooms, dragging pans, a double click shows the
+// whole trace again and a click asks to seek there.
+class UsageTimeline : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit UsageTimeline(QWidget *parent = 0);
+
+    // 0 plots nothing, the indexer must outlive the chart or be unset first
+    void setIndexer(TraceIndexer* indexer);
+
+    // The playback cursor, in packets
+    void setPosition(int position) { m_position = position; }
+
+signals:
+    void seekRequested(int position);
+
+protected:
+    void paintEvent(QPaintEvent *event);
+
+    void mousePressEvent(QMouseEvent *event);
+    void mouseMoveEvent(QMouseEvent *event);
+    void mouseReleaseEvent(QMouseEvent *event);
+    void mouseDoubleClickEvent(QMouseEvent *event);
+    void wheelEvent(QWheelEvent *event);
+
+private:
+    double length() const;
+    double packetAt(int x) const;
+    void setView(double first, double last);
+
+    TraceIndexer *m_indexer;
+
+    // Visible packets, an empty view shows the whole trace
+    double m_viewFirst;
+    double m_viewLast;
+
+    volatile int m_position;
+
+    int m_pressX;
+    double m_pressFirst;
+    bool m_dragging;
+
+    QTimer m_refreshTimer;
+};
+
+#endif // USAGETIMELINE_H